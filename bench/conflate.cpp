@@ -0,0 +1,105 @@
+/** bench/conflate.cpp -- a Watch fed ticks at 10x the rate it can take
+ *  Each dispatched event is followed by WORK_NS of busy work standing in
+ *  for a costly handler (a display refresh, say), on top of the output
+ *  the Watch formats into /dev/null. That cost per tick is measured
+ *  first. Ticks then become due every cost/OVERLOAD ns for
+ *  DURATION seconds; the loop posts whatever is due and runs one event,
+ *  as a source and its consumer sharing one core would. Without
+ *  conflation the queue stays full and most ticks are refused.
+ *  COUNT_MERGE turns each burst into one Watch_ADVANCE_EVT carrying the
+ *  number of ticks, so every tick reaches the clock.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "active.h"
+#include "watch.h"
+#include "log.h"
+
+#define OVERLOAD 10
+#define DURATION 1.0
+#define Q_LEN    64
+#define WORK_NS  2000
+
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void work(unsigned n) {                /* n events worth of it */
+    double until = now() + n * WORK_NS * 1e-9;
+    while (now() < until) {
+    }
+}
+
+static Msg const tickMsg = { Watch_TICK_EVT };
+static Msg const setMsg = { Watch_SET_EVT };
+
+static void startWatch(Watch *watch) {
+    Log::setMode(LOG_OFF);
+    watch->onStart();
+    for (int i = 0; i < 4; ++i) {            /* leave setting mode first */
+        watch->onEvent(&setMsg);
+    }
+    Log::setMode(LOG_SYNC);
+}
+
+static double tickCost() {
+    Watch watch;
+    startWatch(&watch);
+    double t0 = now();
+    for (int i = 0; i < 10000; ++i) {
+        watch.onEvent(&tickMsg);
+        work(1);
+    }
+    return (now() - t0) / 10000;
+}
+
+static void run(char const *what, int policy, double period) {
+    Watch watch;
+    QSlot sto[Q_LEN];
+    Active ao(&watch, sto, Q_LEN);
+    Conflation tickConf;
+    if (policy >= 0) {
+        ao.conflate(&tickConf, Watch_TICK_EVT, (ConflatePolicy)policy,
+                    Watch_ADVANCE_EVT);
+    }
+    startWatch(&watch);
+
+    unsigned long offered = 0, refused = 0, dispatched = 0;
+    double t0 = now(), t;
+    while ((t = now() - t0) < DURATION) {
+        for (; offered * period < t; ++offered) {          /* ticks due */
+            if (!ao.post(&tickMsg)) {
+                ++refused;
+            }
+        }
+        unsigned n = ao.dispatch(1);
+        work(n);
+        dispatched += n;
+    }
+    while (!ao.isIdle()) {
+        dispatched += ao.dispatch(Q_LEN);
+    }
+    Log::setMode(LOG_OFF);
+    unsigned long applied = policy == CONFLATE_COUNT_MERGE
+                            ? offered - refused : dispatched;
+    printf("%-12s %8lu ticks offered, %8lu refused, %7lu dispatches, "
+           "%5.1f%% of ticks reach the clock\n", what, offered, refused,
+           dispatched, 100.0 * applied / offered);
+}
+
+int main() {
+    FILE *devNull = fopen("/dev/null", "w");
+    Log::out = devNull;
+    double cost = tickCost();
+    printf("tick dispatch %.0f ns, a tick due every %.0f ns\n", cost * 1e9,
+           cost * 1e9 / OVERLOAD);
+    run("none", -1, cost / OVERLOAD);
+    run("count-merge", CONFLATE_COUNT_MERGE, cost / OVERLOAD);
+    run("keep-latest", CONFLATE_KEEP_LATEST, cost / OVERLOAD);
+    run("drop-dup", CONFLATE_DROP_DUP, cost / OVERLOAD);
+    fclose(devNull);
+    return 0;
+}
@@ -0,0 +1,45 @@
+/** bench/explore.cpp -- exhaustive exploration of the Watch
+ *  usage: bench_explore [workers] [max snapshots] [dfs] [ticks]
+ *  By default the events are the two buttons, MODE and SET. Setting
+ *  reaches every hour, minute, day and month, and the search completes
+ *  within the default 4M snapshots.
+ *  With "ticks" Watch_TICK_EVT is explored as well. Ticks reach every
+ *  second of every day of the 400-year calendar cycle, about 10^10
+ *  snapshots, so that search ends when the table is full. Handler
+ *  logging is switched off while exploring, the report goes to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "watch.h"
+#include "explore.h"
+#include "log.h"
+
+static Hsm *makeWatch() {
+    return new Watch;
+}
+
+static void destroyWatch(Hsm *m) {
+    delete (Watch *)m;
+}
+
+static Msg const watchMsg[] = { { Watch_MODE_EVT }, { Watch_SET_EVT },
+                                { Watch_TICK_EVT } };
+
+int main(int argc, char **argv) {
+    unsigned workers = argc > 1 ? (unsigned)atoi(argv[1]) : 4;
+    unsigned long maxStates = argc > 2 ? strtoul(argv[2], 0, 0) : 4000000;
+    bool dfs = false, ticks = false;
+    for (int i = 3; i < argc; ++i) {
+        dfs = dfs || strcmp(argv[i], "dfs") == 0;
+        ticks = ticks || strcmp(argv[i], "ticks") == 0;
+    }
+    Msg const *events[] = { &watchMsg[0], &watchMsg[1], &watchMsg[2] };
+
+    Log::setMode(LOG_OFF);
+    Explorer x(&makeWatch, &destroyWatch, events, ticks ? 3 : 2);
+    ((Watch *)x.getProto())->reg(&x);
+    bool complete = x.run(workers, maxStates, dfs);
+    x.report(stderr);
+    return complete ? 0 : 2;
+}
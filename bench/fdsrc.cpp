@@ -0,0 +1,129 @@
+/** bench/fdsrc.cpp -- FdSource throughput over local pipes
+ *  Each Echo machine owns a pipe and consumes one byte per readiness
+ *  event. The writer feeds all pipes, then FdSource delivers the
+ *  readiness batch and the Active objects dispatch it.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "fdsrc.h"
+
+#define N_PIPES  32
+#define N_ROUNDS 20000
+
+enum EchoEvents { RX_SIG };
+
+class Echo : public Hsm {
+protected:
+    State idle;
+public:
+    FdSource *src;
+    Active *ao;
+    int fd, rx;
+    unsigned long received;
+    Echo();
+    Msg const *topHndlr(Msg const *msg);
+    Msg const *idleHndlr(Msg const *msg);
+};
+
+Msg const *Echo::topHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        STATE_START(&idle);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *Echo::idleHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case ENTRY_EVT:
+        rx = src->add(ao, fd, FD_READ, RX_SIG);
+        return 0;
+    case EXIT_EVT:
+        src->remove(rx);
+        return 0;
+    case RX_SIG: {
+        if (src->take(msg) == 0) {
+            return 0;                             /* removed meanwhile */
+        }
+        char c;
+        if (::read(fd, &c, 1) == 1) {
+            ++received;
+        }
+        src->arm(rx);
+        return 0;
+    }
+    }
+    return msg;
+}
+
+Echo::Echo()
+: Hsm("Echo", (EvtHndlr)&Echo::topHndlr),
+  idle("idle", &top, (EvtHndlr)&Echo::idleHndlr),
+  received(0)
+{}
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(bool tryUring) {
+    static QSlot qSto[N_PIPES][16];
+    FdSource src;
+    if (!src.open(tryUring) || (tryUring && !src.usesUring())) {
+        printf("%-9s not available\n", tryUring ? "io_uring" : "epoll");
+        return;
+    }
+    Echo echo[N_PIPES];
+    Active *ao[N_PIPES];
+    int wr[N_PIPES];
+    for (int i = 0; i < N_PIPES; ++i) {
+        int p[2];
+        if (pipe(p) != 0) {
+            return;
+        }
+        ao[i] = new Active(&echo[i], qSto[i], 16);
+        echo[i].src = &src;
+        echo[i].ao = ao[i];
+        echo[i].fd = p[0];
+        wr[i] = p[1];
+        echo[i].onStart();
+    }
+    unsigned long events = 0, batches = 0;
+    double t0 = now();
+    for (int r = 0; r < N_ROUNDS; ++r) {
+        for (int i = 0; i < N_PIPES; ++i) {
+            if (write(wr[i], "x", 1) != 1) {
+                return;
+            }
+        }
+        unsigned got = 0;
+        while (got < N_PIPES) {
+            got += src.poll(-1);
+            ++batches;
+            for (int i = 0; i < N_PIPES; ++i) {
+                events += ao[i]->dispatch(16);
+            }
+        }
+    }
+    double dt = now() - t0;
+    printf("%-9s %lu events in %.3fs: %.0f ns/event, %.1f events/batch\n",
+           tryUring ? "io_uring" : "epoll", events, dt,
+           dt * 1e9 / events, (double)events / batches);
+    for (int i = 0; i < N_PIPES; ++i) {
+        src.removeAll(ao[i]);
+        close(echo[i].fd);
+        close(wr[i]);
+        delete ao[i];
+    }
+}
+
+int main() {
+    run(false);
+    run(true);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/** bench/guard.cpp -- no allocation and no syscall per event, checked
+ *  usage: make guard (builds build/guard with HSM_GUARD and runs it)
+ *  Drives the dispatch paths in steady state under Guard (guard.h):
+ *  Hsm::onEvent() and onStart() of Watches, Active post() and dispatch()
+ *  through conflation and a priority level, timers of a VClock re-armed
+ *  by handlers, and logging in LOG_ASYNC mode. Each path is warmed up
+ *  first, then run guarded; any allocation, free or syscall is reported
+ *  with its call stack and fails the run. Last, handlers logging in
+ *  LOG_SYNC mode (fprintf) must be caught, or the guard itself is broken.
+ *  Built by "make bench" without HSM_GUARD it only says so.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <vector>
+#include "guard.h"
+#include "active.h"
+#include "vclock.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_WATCHES 64
+#define N_EVENTS  200000
+#define Q_LEN     256
+
+static Msg const watchMsg[] = { { Watch_MODE_EVT }, { Watch_SET_EVT },
+                                { Watch_TICK_EVT }, { Watch_TICK_EVT } };
+
+static unsigned long long x = 88172645463325252ull;
+
+static unsigned pick() {                                     /* xorshift64 */
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return (unsigned)(x >> 32);
+}
+
+static void dispatch(Watch *w, unsigned n) {  /* guarded by the hooks */
+    for (unsigned i = 0; i < n; ++i) {
+        unsigned p = pick();
+        w[p % N_WATCHES].onEvent(&watchMsg[p >> 30]);
+    }
+}
+
+/* one path: warm up, then guarded; true if it stayed clean...............*/
+static bool check(char const *path, void (*run)(bool warm)) {
+    run(true);
+    Guard::reset();
+    run(false);
+    unsigned long n = Guard::offences();
+    printf("%-34s %s\n", path, n == 0 ? "clean" : "FAILED");
+    if (n != 0) {
+        Guard::report(stdout);
+    }
+    return n == 0;
+}
+
+static Watch *watches;
+
+static void watchEvents(bool) {
+    dispatch(watches, N_EVENTS);
+}
+
+static void watchStart(bool) {
+    for (unsigned i = 0; i < N_WATCHES; ++i) {
+        new (&watches[i]) Watch();
+        GuardScope g;
+        watches[i].onStart();
+    }
+}
+
+static void activeQueue(bool) {
+    static QSlot sto[Q_LEN], hiSto[Q_LEN];
+    static Watch w;
+    static Active *ao;
+    static MsgQueue hi(hiSto, Q_LEN);
+    static Conflation ticks;
+    if (ao == 0) {
+        w.onStart();
+        ao = new Active(&w, sto, Q_LEN);
+        ao->conflate(&ticks, Watch_TICK_EVT, CONFLATE_COUNT_MERGE,
+                     Watch_TICK_EVT);
+        ao->addLevel(1, &hi);
+        ao->prioritize(Watch_SET_EVT, 1);
+    }
+    for (unsigned i = 0; i < N_EVENTS / 16; ++i) {
+        GuardScope g;
+        for (unsigned k = 0; k < 16; ++k) {
+            ao->post(&watchMsg[pick() >> 30]);
+        }
+        ao->dispatch(16);
+    }
+}
+
+class Pinger : public Hsm {       /* re-arms its own timer, at varying delays */
+    unsigned n;
+public:
+    Pinger() : Hsm("Pinger", (EvtHndlr)&Pinger::topHndlr), n(0) {}
+    Msg const *topHndlr(Msg const *msg) {
+        switch (msg->evt) {
+        case Watch_TICK_EVT:
+            VClock::after((1 + ++n % 7) * VT_MS, msg);
+            return 0;
+        case Watch_MODE_EVT:              /* warmed up: count from here */
+            Guard::reset();
+            return 0;
+        }
+        return msg;
+    }
+};
+
+static void vclockTimers(bool warm) {
+    if (warm) {             /* a clock runs once, it warms up in the run */
+        return;
+    }
+    VClock c(1, 10 * VT_MS);              /* one shard: no reset() races */
+    std::vector<Pinger> pingers(N_WATCHES);
+    Watch *w = new Watch[N_WATCHES];
+    for (unsigned i = 0; i < N_WATCHES; ++i) {
+        unsigned id = c.add(&pingers[i]);
+        c.at(id, i * VT_MS / 8, &watchMsg[2]);
+        c.every(c.add(&w[i]), VT_SEC, i * VT_MS, &watchMsg[2]);
+    }
+    c.at(0, 60 * VT_SEC, &watchMsg[0]);
+    c.run(300 * VT_SEC);
+    delete[] w;
+}
+
+static void asyncLog(bool) {
+    Log::setMode(LOG_ASYNC);
+    dispatch(watches, N_EVENTS);
+    Log::setMode(LOG_OFF);
+}
+
+int main() {
+    if (!Guard::start()) {
+        printf("built without HSM_GUARD, nothing checked: try make guard\n");
+        return 0;
+    }
+    FILE *sink = fopen("/dev/null", "w");
+    Log::setMode(LOG_OFF);
+    watches = (Watch *)operator new(N_WATCHES * sizeof(Watch));
+    watchStart(true);
+    bool ok = check("Watch onStart", &watchStart);
+    ok = check("Watch onEvent", &watchEvents) && ok;
+    ok = check("Active post/dispatch, levels", &activeQueue) && ok;
+    ok = check("VClock timers", &vclockTimers) && ok;
+    Log::start(sink);
+    ok = check("LOG_ASYNC in handlers", &asyncLog) && ok;
+    Log::stop();
+
+    Log::setMode(LOG_SYNC);                 /* fprintf() from handlers */
+    Guard::reset();
+    dispatch(watches, N_EVENTS);
+    Log::setMode(LOG_OFF);
+    bool caught = Guard::offences() != 0;
+    printf("%-34s %s\n", "LOG_SYNC in handlers, must fail",
+           caught ? "caught" : "NOT CAUGHT");
+    Guard::stop();
+    fclose(sink);
+    printf("%s\n", ok && caught ? "guard: ok" : "guard: FAILED");
+    return ok && caught ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/** bench/hibernate.cpp -- memory and wake-up cost of hibernated Watches
+ *  usage: bench_hibernate [machines]
+ *  Builds a population of Watches twice, once left awake and once put to
+ *  sleep as it is built, and compares the resident memory each takes.
+ *  Then events go to random sleeping machines, each woken, dispatched and
+ *  put back to sleep, while N_CHECK of them are mirrored by plain Watches
+ *  that never sleep; their records must come out identical. Last, a hot
+ *  set that moves on every round is kept awake by its events while the
+ *  sweeps put the machines it left behind to sleep.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include "hibernate.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_MACHINES 10000000
+#define N_EVENTS   2000000
+#define N_CHECK    1000                  /* machines mirrored awake */
+#define N_HOT      10000            /* machines busy during the sweeps */
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double residentMB() {
+    unsigned long size = 0, rss = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%lu %lu", &size, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(f);
+    }
+    return rss * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+static unsigned next(unsigned *x) {                            /* xorshift */
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static Hsm *buildWatch(void *mem) {
+    return new (mem) Watch();
+}
+
+static void destroyWatch(Hsm *m) {
+    ((Watch *)m)->~Watch();
+}
+
+static Msg const modeMsg = { Watch_MODE_EVT };
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+static Msg const *const events[] = { &modeMsg, &setMsg, &tickMsg };
+
+static double population(HsmClass *cls, unsigned n, bool asleep) {
+    double mb = residentMB();
+    Hibernator hib(n);
+    unsigned char id = hib.addClass(cls);
+    for (unsigned i = 0; i < n; ++i) {
+        unsigned h = hib.spawn(id);
+        if (asleep) {
+            hib.hibernate(h);
+        }
+    }
+    mb = residentMB() - mb;
+    printf("%-7s %u machines: %7.1f MB, %5.1f bytes each\n",
+           asleep ? "asleep" : "awake", n, mb, mb * (1 << 20) / n);
+    return mb;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : N_MACHINES;
+    Log::setMode(LOG_OFF);
+    HsmClass cls(&buildWatch, &destroyWatch, sizeof(Watch));
+    ((Watch *)cls.getProto())->reg(&cls);
+    printf("Watch: %zu bytes awake, a %u byte record asleep\n",
+           sizeof(Watch), cls.getRecordSize());
+
+    double asleep = population(&cls, n, true);
+    double awake = population(&cls, n, false);
+    printf("hibernation keeps %.2fx less resident\n", awake / asleep);
+
+    Hibernator hib(n);
+    unsigned char id = hib.addClass(&cls);
+    for (unsigned i = 0; i < n; ++i) {
+        hib.hibernate(hib.spawn(id));
+    }
+    Watch *mirror = new Watch[N_CHECK];
+    for (unsigned i = 0; i < N_CHECK; ++i) {
+        mirror[i].onStart();
+    }
+    unsigned x = 2463534242u;
+    double t0 = now();
+    for (unsigned e = 0; e < N_EVENTS; ++e) {
+        unsigned h = next(&x) % n;
+        Msg const *msg = events[next(&x) % 3];
+        hib.onEvent(h, msg);
+        hib.hibernate(h);
+        if (h < N_CHECK) {
+            mirror[h].onEvent(msg);
+        }
+    }
+    double dt = now() - t0;
+    unsigned bad = 0;
+    unsigned char a[64], b[64];
+    for (unsigned i = 0; i < N_CHECK; ++i) {
+        cls.pack(hib.get(i), a);
+        cls.pack(&mirror[i], b);
+        bad += memcmp(a, b, cls.getRecordSize()) != 0;
+    }
+    printf("wake, dispatch, sleep: %.1f ns per event, %u of %u mirrors "
+           "differ\n", dt * 1e9 / N_EVENTS, bad, N_CHECK);
+
+    unsigned long slept = 0;
+    t0 = now();
+    for (unsigned r = 0; r < 10; ++r) {
+        for (unsigned h = r * N_HOT; h < (r + 1) * N_HOT && h < n; ++h) {
+            hib.onEvent(h, &tickMsg);
+        }
+        slept += hib.sweep(2);
+    }
+    printf("10 sweeps: %.1f ms each, %lu put to sleep, %lu of %u asleep\n",
+           (now() - t0) * 100, slept, hib.asleep(), hib.size());
+    delete[] mirror;
+    return 0;
+}
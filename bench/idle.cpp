@@ -0,0 +1,145 @@
+/** bench/idle.cpp -- wake-up latency against CPU burn of each Idle strategy
+ *  usage: bench_idle [ms per run=200]
+ *  A Kernel thread dispatches to an Echo machine, which records how long
+ *  each event took from post() to its handler. The main thread posts
+ *  time-stamped events at a fixed gap, busy-waiting between them below
+ *  100us and sleeping above. For every strategy of idle.h and every gap
+ *  the program prints the latency p50 and p99, the CPU the kernel thread
+ *  used as a share of the wall time, how many waits ended while polling,
+ *  the sched_yield() calls, the futex parks and the spin limit the Idle
+ *  settled on. "park" is the spin-then-park strategy with the spin limit
+ *  at 0, a plain futex wait.
+ *
+ *  On one CPU the polling strategies compete with the producer for the
+ *  core, so their latency there is the scheduler's time slice, not what
+ *  they achieve with a core of their own.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <thread>
+#include "kernel.h"
+#include "hdr.h"
+#include "log.h"
+
+#define Q_LEN      1024
+#define MAX_EVENTS 20000
+#define SLEEP_NS   100000     /* gaps from here on are slept, not spun */
+
+enum EchoEvents { PING_SIG };
+
+struct PingMsg : public Msg {
+    unsigned long long posted;                            /* hdrTicks() */
+};
+
+class Echo : public Hsm {                 /* one level down, as the Watch */
+protected:
+    State on;
+public:
+    unsigned long long hist[HDR_BUCKETS];          /* post to handler */
+    unsigned long long n;
+    Echo();
+    Msg const *topHndlr(Msg const *msg);
+    Msg const *onHndlr(Msg const *msg);
+};
+
+Msg const *Echo::topHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        STATE_START(&on);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *Echo::onHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case PING_SIG:
+        ++hist[hdrIndex(hdrTicks() - ((PingMsg const *)msg)->posted)];
+        ++n;
+        return 0;
+    }
+    return msg;
+}
+
+Echo::Echo()
+: Hsm("Echo", (EvtHndlr)&Echo::topHndlr),
+  on("on", &top, (EvtHndlr)&Echo::onHndlr),
+  hist(), n(0)
+{}
+
+static double clockNs(clockid_t c) {
+    timespec ts;
+    clock_gettime(c, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static PingMsg pings[MAX_EVENTS];
+
+static void run(char const *name, IdleStrategy s, unsigned spinNs,
+                unsigned gapNs, unsigned ms, double nsPerTick)
+{
+    static QSlot sto[Q_LEN];
+    Echo echo;
+    Active ao(&echo, sto, Q_LEN);
+    Kernel k;
+    echo.onStart();
+    k.add(&ao, 1);
+    k.setIdle(s, spinNs);
+    if (!k.start()) {
+        return;
+    }
+    unsigned n = (unsigned)(ms * 1000000ULL / gapNs);
+    n = n < 200 ? 200 : n > MAX_EVENTS ? MAX_EVENTS : n;
+    timespec gap = { 0, (long)gapNs };
+    double w0 = clockNs(CLOCK_MONOTONIC);
+    double p0 = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    double m0 = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    for (unsigned i = 0; i < n; ++i) {
+        if (gapNs >= SLEEP_NS) {
+            nanosleep(&gap, 0);
+        }
+        else {
+            double until = clockNs(CLOCK_MONOTONIC) + gapNs;
+            while (clockNs(CLOCK_MONOTONIC) < until) {
+            }
+        }
+        pings[i].evt = PING_SIG;
+        pings[i].posted = hdrTicks();
+        while (!k.post(1, &pings[i])) {
+            std::this_thread::yield();                  /* queue is full */
+        }
+    }
+    while (!ao.isIdle()) {
+        std::this_thread::yield();
+    }
+    double wall = clockNs(CLOCK_MONOTONIC) - w0;
+    double burn = clockNs(CLOCK_PROCESS_CPUTIME_ID) - p0
+                  - (clockNs(CLOCK_THREAD_CPUTIME_ID) - m0);
+    IdleStats st = k.idleStats();
+    k.stop();
+    printf("%-10s %7.1f %9.1f %9.1f %6.1f%% %6.1f%% %8lu %7lu %7.1f\n",
+           name, gapNs / 1e3,
+           hdrPercentile(echo.hist, echo.n, 50) * nsPerTick / 1e3,
+           hdrPercentile(echo.hist, echo.n, 99) * nsPerTick / 1e3,
+           100.0 * burn / wall, st.waits ? 100.0 * st.spun / st.waits : 0.0,
+           st.yields, st.parks, st.spinNs / 1e3);
+}
+
+int main(int argc, char **argv) {
+    unsigned ms = argc > 1 ? (unsigned)atoi(argv[1]) : 200;
+    static unsigned const gaps[] = { 5000, 50000, 500000, 5000000 };
+    Log::setMode(LOG_OFF);
+    double nsPerTick = hdrNsPerTick(10);
+    printf("%u cores, latency and spin in us\n",
+           std::thread::hardware_concurrency());
+    printf("%-10s %7s %9s %9s %7s %7s %8s %7s %7s\n", "strategy", "gap",
+           "p50", "p99", "cpu", "polled", "yields", "parks", "spin");
+    for (unsigned g : gaps) {
+        run("spin", IDLE_SPIN, IDLE_SPIN_NS, g, ms, nsPerTick);
+        run("yield", IDLE_YIELD, IDLE_SPIN_NS, g, ms, nsPerTick);
+        run("spin+park", IDLE_PARK, IDLE_SPIN_NS, g, ms, nsPerTick);
+        run("park", IDLE_PARK, 0, g, ms, nsPerTick);
+    }
+    return 0;
+}
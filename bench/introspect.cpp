@@ -0,0 +1,136 @@
+/** bench/introspect.cpp -- what the live view costs, and a local client
+ *  usage: bench_introspect [watches=10000]
+ *  Times dispatch to Watches picked at random with and without the
+ *  introspection hook. Then a thread keeps dispatching while this one
+ *  connects to the socket like any client, asks for list, counters and a
+ *  sample of watch 0, and prints the replies, shortened.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include "introspect.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_EVENTS 4000000
+#define SOCKET   "/tmp/hsm-introspect.sock"
+
+static Msg const watchMsg[] = { { Watch_MODE_EVT }, { Watch_SET_EVT },
+                                { Watch_TICK_EVT }, { Watch_TICK_EVT } };
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(Watch *w, unsigned n, unsigned const *pick) {
+    double t0 = now();
+    for (unsigned i = 0; i < N_EVENTS; ++i) {
+        w[pick[i] % n].onEvent(&watchMsg[pick[i] >> 30]);
+    }
+    return (now() - t0) * 1e9 / N_EVENTS;
+}
+
+static void dispatcher(Watch *w, unsigned n, unsigned const *pick,
+                       std::atomic<bool> *stop)
+{
+    for (unsigned i = 0; !stop->load(std::memory_order_relaxed); ++i) {
+        unsigned p = pick[i % N_EVENTS];
+        w[p % n].onEvent(&watchMsg[p >> 30]);
+        if (i % 64 == 0) {
+            w[0].onEvent(&watchMsg[2]);              /* watch 0 is busy */
+        }
+    }
+}
+
+/* send a request, print the first lines of the reply, count them..........*/
+static unsigned ask(int fd, char const *req, unsigned show) {
+    char buf[1 << 16];
+    size_t n = 0;
+    unsigned lines = 0;
+    printf("> %s", req);
+    if (send(fd, req, strlen(req), 0) < 0) {
+        return 0;
+    }
+    for (;;) {
+        ssize_t k = recv(fd, buf + n, sizeof(buf) - 1 - n, 0);
+        if (k <= 0) {
+            return lines;
+        }
+        n += (size_t)k;
+        char *line = buf, *nl;
+        while ((nl = (char *)memchr(line, '\n', buf + n - line)) != 0) {
+            *nl = '\0';
+            if (strcmp(line, ".") == 0) {
+                if (lines > show) {
+                    printf("  ... %u lines\n", lines);
+                }
+                return lines;
+            }
+            if (lines++ < show) {
+                printf("  %s\n", line);
+            }
+            line = nl + 1;
+        }
+        n -= (size_t)(line - buf);
+        memmove(buf, line, n);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : 10000;
+    unsigned *pick = new unsigned[N_EVENTS];
+    unsigned long long x = 88172645463325252ull;
+    for (unsigned i = 0; i < N_EVENTS; ++i) {              /* xorshift64 */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        pick[i] = (unsigned)(x >> 32);
+    }
+    Log::setMode(LOG_OFF);
+    Watch *w = new Watch[n];
+    Introspect in(n);
+    for (unsigned i = 0; i < n; ++i) {
+        w[i].onStart();
+        w[i].reg(&in, in.add(&w[i]));
+    }
+
+    run(w, n, pick);                                          /* warm up */
+    double off = run(w, n, pick);
+    if (!in.start(SOCKET)) {
+        fprintf(stderr, "cannot serve %s\n", SOCKET);
+        return 1;
+    }
+    double on = run(w, n, pick);
+    printf("%u watches: %.1f ns/event, %.1f with the live view\n", n, off,
+           on);
+
+    std::atomic<bool> stop(false);
+    std::thread t(&dispatcher, w, n, pick, &stop);
+    sockaddr_un a;
+    memset(&a, 0, sizeof(a));
+    a.sun_family = AF_UNIX;
+    strcpy(a.sun_path, SOCKET);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool ok = fd >= 0 && connect(fd, (sockaddr *)&a, sizeof(a)) == 0;
+    if (ok) {
+        ok = ask(fd, "list\n", 4) == n;
+        ask(fd, "counters\n", 12);
+        ok = ask(fd, "sample 0 8\n", 8) == 8 && ok;
+        ask(fd, "bogus\n", 1);
+        close(fd);
+    }
+    stop.store(true);
+    t.join();
+    in.stop();
+    printf("client %s\n", ok ? "ok" : "FAILED");
+    delete[] w;
+    delete[] pick;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/** bench/kernel.cpp -- worst-case dispatch latency of the Kernel
+ *  A bulk machine at the lowest priority is kept busy with ~10us RTC
+ *  steps by a feeder thread. A sensor thread posts time-stamped trips to
+ *  an interlock machine at the highest priority; the interlock handler
+ *  records post-to-handler latency. Every 64th bulk step also trips the
+ *  interlock from inside the handler to measure synchronous preemption.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include "kernel.h"
+
+#define N_TRIPS   2000
+#define BULK_PRIO 1
+#define SAFE_PRIO KERNEL_MAX_PRIO
+
+enum BenchEvents { WORK_SIG, TRIP_SIG };
+
+struct TripMsg : public Msg {
+    long long postedNs;
+};
+
+static long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static Kernel kernel;
+static long long asyncLat[N_TRIPS], syncLat[N_TRIPS];
+static std::atomic<unsigned> nAsync(0), nSync(0);
+
+class Interlock : public Hsm {
+protected:
+    State armed;
+public:
+    Interlock();
+    Msg const *topHndlr(Msg const *msg);
+    Msg const *armedHndlr(Msg const *msg);
+};
+
+Msg const *Interlock::topHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        STATE_START(&armed);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *Interlock::armedHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case TRIP_SIG: {
+        TripMsg const *t = (TripMsg const *)msg;
+        long long lat = nowNs() - t->postedNs;
+        if (t->postedNs < 0) {                        /* from a handler */
+            lat = nowNs() + t->postedNs;
+            if (nSync < N_TRIPS) {
+                syncLat[nSync++] = lat;
+            }
+        }
+        else {
+            asyncLat[nAsync.load()] = lat;
+            nAsync.fetch_add(1);                /* releases the sensor */
+        }
+        return 0;
+    }
+    }
+    return msg;
+}
+
+Interlock::Interlock()
+: Hsm("Interlock", (EvtHndlr)&Interlock::topHndlr),
+  armed("armed", &top, (EvtHndlr)&Interlock::armedHndlr)
+{}
+
+class Bulk : public Hsm {
+protected:
+    State busy;
+    unsigned long steps;
+    TripMsg trip;
+public:
+    Bulk();
+    Msg const *topHndlr(Msg const *msg);
+    Msg const *busyHndlr(Msg const *msg);
+};
+
+Msg const *Bulk::topHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        STATE_START(&busy);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *Bulk::busyHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case WORK_SIG: {
+        long long end = nowNs() + 10000;
+        while (nowNs() < end) {                   /* ~10us of bulk work */
+        }
+        if (++steps % 64 == 0 && nSync < N_TRIPS) {
+            trip.evt = TRIP_SIG;
+            trip.postedNs = -nowNs();
+            kernel.post(SAFE_PRIO, &trip);           /* preempts us here */
+        }
+        return 0;
+    }
+    }
+    return msg;
+}
+
+Bulk::Bulk()
+: Hsm("Bulk", (EvtHndlr)&Bulk::topHndlr),
+  busy("busy", &top, (EvtHndlr)&Bulk::busyHndlr),
+  steps(0)
+{}
+
+static std::atomic<bool> feeding(true);
+static Msg const workMsg = { WORK_SIG };
+
+static void *feeder(void *) {
+    while (feeding.load()) {
+        if (!kernel.post(BULK_PRIO, &workMsg)) {
+            usleep(50);                              /* queue is full */
+        }
+    }
+    return 0;
+}
+
+static void report(char const *what, long long *lat, unsigned n) {
+    std::sort(lat, lat + n);
+    printf("%-22s n=%u p50=%lldns p99=%lldns max=%lldns\n", what, n,
+           lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+}
+
+int main() {
+    static QSlot bulkSto[256], safeSto[4];
+    Bulk bulk;
+    Interlock lock;
+    Active bulkAo(&bulk, bulkSto, 256), safeAo(&lock, safeSto, 4);
+    bulk.onStart();
+    lock.onStart();
+    kernel.add(&bulkAo, BULK_PRIO);
+    kernel.add(&safeAo, SAFE_PRIO);
+    if (!kernel.start()) {
+        return 1;
+    }
+    pthread_t feed;
+    pthread_create(&feed, 0, &feeder, 0);
+
+    static TripMsg trip;
+    for (unsigned i = 0; i < N_TRIPS; ++i) {
+        usleep(200 + rand() % 200);
+        trip.evt = TRIP_SIG;
+        trip.postedNs = nowNs();
+        kernel.post(SAFE_PRIO, &trip);
+        while (nAsync.load() == i) {              /* wait for the handler */
+            sched_yield();
+        }
+    }
+    feeding.store(false);
+    pthread_join(feed, 0);
+    kernel.stop();
+    report("posted by thread", asyncLat, N_TRIPS);
+    report("posted by handler", syncLat, nSync);
+    return 0;
+}
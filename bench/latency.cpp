@@ -0,0 +1,105 @@
+/** bench/latency.cpp -- what the latency histograms cost, and a sample
+ *  Cycles a Watch through its states with the histograms off and on; the
+ *  difference less two hdrTicks() reads is the recording cost. Then a
+ *  second thread posts the same events through an Active queue, paced so
+ *  they wait a little, and the merged histograms of both threads are
+ *  printed, as a table or (with -csv) as CSV.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include "active.h"
+#include "watch.h"
+#include "latency.h"
+#include "log.h"
+
+#define N_ROUNDS 1000000
+#define Q_LEN    64
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Msg const modeMsg = { Watch_MODE_EVT };
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+static Msg const *const cycle[] = {                       /* 9 dispatches */
+    &setMsg, &modeMsg, &setMsg, &setMsg, &setMsg, &setMsg, &modeMsg,
+    &modeMsg, &tickMsg
+};
+#define N_CYCLE (sizeof(cycle) / sizeof(cycle[0]))
+
+static char const *sigName(Event evt) {
+    switch (evt) {
+    case Watch_MODE_EVT: return "MODE";
+    case Watch_SET_EVT:  return "SET";
+    case Watch_TICK_EVT: return "TICK";
+    }
+    return 0;
+}
+
+static double perDispatch(Watch *watch) {
+    double t0 = now();
+    for (int r = 0; r < N_ROUNDS; ++r) {
+        for (unsigned i = 0; i < N_CYCLE; ++i) {
+            watch->onEvent(cycle[i]);
+        }
+    }
+    return (now() - t0) * 1e9 / (N_ROUNDS * N_CYCLE);
+}
+
+static double perTicks() {
+    unsigned long long sum = 0;
+    double t0 = now();
+    for (int i = 0; i < N_ROUNDS; ++i) {
+        sum += hdrTicks();
+    }
+    double dt = now() - t0;
+    return sum ? dt * 1e9 / N_ROUNDS : 0.0;
+}
+
+static void producer(Active *ao, unsigned n) {
+    for (unsigned r = 0; r < n; ++r) {
+        for (unsigned i = 0; i < N_CYCLE; ++i) {
+            while (!ao->post(cycle[i])) {
+                std::this_thread::yield();
+            }
+        }
+        if (r % 64 == 0) {                      /* let the queue drain */
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool csv = argc > 1 && strcmp(argv[1], "-csv") == 0;
+    Log::setMode(LOG_OFF);
+    Watch watch;
+    watch.onStart();
+
+    double off = perDispatch(&watch);
+    Latency::start();
+    double on = perDispatch(&watch);
+    double clock = perTicks();
+    fprintf(stderr, "off %.1f ns/dispatch, on %.1f ns/dispatch, "
+            "hdrTicks() %.1f ns, so recording %.1f ns\n",
+            off, on, clock, on - off - 2 * clock);
+
+    Watch queued;
+    QSlot sto[Q_LEN];
+    unsigned long long stamps[Q_LEN];                 /* time the queue */
+    Active ao(&queued, sto, Q_LEN, stamps);
+    queued.onStart();
+    std::thread t(&producer, &ao, N_ROUNDS / 10);
+    unsigned long n = 0;
+    while (n < N_ROUNDS / 10 * N_CYCLE) {
+        n += ao.dispatch(Q_LEN);
+    }
+    t.join();
+    Latency::stop();
+    Latency::dump(stdout, csv, &sigName);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/** bench/layout.cpp -- false sharing between machines of different threads
+ *  usage: bench_layout [threads=2] [machines per thread=1024]
+ *  Machine i belongs to thread i % threads, so neighbours in memory are
+ *  dispatched by different threads. Each thread ticks its own Watches.
+ *  Two layouts are compared: a packed Watch[] and HsmAligned<Watch>[]
+ *  (hsm.h), one instance per cache line or more.
+ *
+ *  For each layout the program prints what "perf c2c report" would point
+ *  at: how many cache lines hold bytes of machines of more than one
+ *  thread. Those lines bounce between cores on every dispatch. It also
+ *  prints ns/event with all threads running. The lines are a property of
+ *  the layout. The timing shows their cost only with threads on separate
+ *  cores; on one core they take turns and both layouts run the same. To
+ *  see HITM records, run "perf c2c record ./bench_layout" on a multicore
+ *  host.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+#include "watch.h"
+#include "log.h"
+
+#define N_ROUNDS 400
+
+static Msg const tickMsg = { Watch_TICK_EVT };
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* lines holding bytes of machines that more than one thread owns.........*/
+template<class M>
+static unsigned sharedLines(M *m, unsigned n, unsigned threads) {
+    std::vector<std::set<unsigned> > owners;
+    uintptr_t first = (uintptr_t)m / HSM_CACHE_LINE;
+    owners.resize(((uintptr_t)(m + n) - 1) / HSM_CACHE_LINE - first + 1);
+    for (unsigned i = 0; i < n; ++i) {
+        uintptr_t a = (uintptr_t)&m[i];
+        for (uintptr_t l = a / HSM_CACHE_LINE;
+             l <= (a + sizeof(M) - 1) / HSM_CACHE_LINE; ++l) {
+            owners[l - first].insert(i % threads);
+        }
+    }
+    unsigned shared = 0;
+    for (std::set<unsigned> const &o : owners) {
+        shared += o.size() > 1;
+    }
+    return shared;
+}
+
+template<class M>
+static void ticker(M *m, unsigned n, unsigned threads, unsigned me,
+                   std::atomic<unsigned> *go)
+{
+    go->fetch_sub(1);
+    while (go->load() != 0) {                    /* start all at once */
+    }
+    for (unsigned r = 0; r < N_ROUNDS; ++r) {
+        for (unsigned i = me; i < n; i += threads) {
+            m[i].onEvent(&tickMsg);
+        }
+    }
+}
+
+template<class M>
+static void run(char const *layout, unsigned threads, unsigned perThread) {
+    unsigned n = threads * perThread;
+    M *m = new M[n];
+    for (unsigned i = 0; i < n; ++i) {
+        m[i].onStart();
+    }
+    std::atomic<unsigned> go(threads);
+    std::vector<std::thread> t;
+    double t0 = now();
+    for (unsigned k = 0; k < threads; ++k) {
+        t.emplace_back(&ticker<M>, m, n, threads, k, &go);
+    }
+    for (std::thread &x : t) {
+        x.join();
+    }
+    double ns = (now() - t0) * 1e9 / ((double)n * N_ROUNDS);
+    unsigned lines = (unsigned)((sizeof(M) * n + HSM_CACHE_LINE - 1)
+                                / HSM_CACHE_LINE);
+    printf("%-20s %4zu bytes, %6u lines, %6u shared by threads, "
+           "%5.1f ns/event\n",
+           layout, sizeof(M), lines, sharedLines(m, n, threads), ns);
+    delete[] m;
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = argc > 1 ? (unsigned)atoi(argv[1]) : 2;
+    unsigned perThread = argc > 2 ? (unsigned)atoi(argv[2]) : 1024;
+    Log::setMode(LOG_OFF);
+    printf("%u threads x %u Watches, %u cores\n", threads, perThread,
+           std::thread::hardware_concurrency());
+    for (int rep = 0; rep < 2; ++rep) {
+        run<Watch>("Watch[] packed", threads, perThread);
+        run<HsmAligned<Watch> >("HsmAligned<Watch>[]", threads, perThread);
+    }
+    return 0;
+}
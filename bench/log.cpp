@@ -0,0 +1,81 @@
+/** bench/log.cpp -- dispatch cost of the Watch with and without logging
+ *  Runs Watch_TICK_EVT through a Watch showing the time (every tick logs
+ *  twice) with handler output off, formatted synchronously like printf,
+ *  and recorded for the background formatter. Output goes to /dev/null.
+ *
+ *  Ticks run in chunks that fill at most half a ring. Between chunks,
+ *  off the clock, the program waits for the formatter to catch up, so
+ *  the async run times recording, not the drop path of a full ring. The
+ *  last column is the cost over "off" per record actually kept.
+ */
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "watch.h"
+#include "log.h"
+
+#define N_TICKS 2000000
+#define CHUNK   (LOG_RING / 4)              /* two records per tick */
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+
+static double offNs;                          /* per dispatch, no output */
+
+static void run(char const *what, LogMode mode, FILE *devNull) {
+    Watch watch;
+    Log::out = devNull;
+    Log::setMode(LOG_OFF);
+    watch.onStart();
+    for (int i = 0; i < 4; ++i) {         /* hour, minute, day, month, time */
+        watch.onEvent(&setMsg);
+    }
+    if (mode == LOG_ASYNC) {
+        Log::start(devNull);
+    }
+    Log::setMode(mode);
+    unsigned long dropped = Log::dropped();
+    double dt = 0;
+    for (int i = 0; i < N_TICKS; i += CHUNK) {
+        double t0 = now();
+        for (int k = 0; k < CHUNK; ++k) {
+            watch.onEvent(&tickMsg);
+        }
+        dt += now() - t0;
+        while (mode == LOG_ASYNC && Log::pending() != 0) {
+            usleep(100);                          /* let the ring drain */
+        }
+    }
+    Log::setMode(LOG_OFF);
+    dropped = Log::dropped() - dropped;
+    Log::stop();
+    unsigned long kept = mode == LOG_OFF ? 0 : 2UL * N_TICKS - dropped;
+    double ns = dt * 1e9 / N_TICKS;
+    if (mode == LOG_OFF) {
+        offNs = ns;
+    }
+    printf("%-8s %6.1f ns/dispatch, %8lu records, %lu dropped", what, ns,
+           kept, dropped);
+    if (kept != 0) {
+        printf(", %5.1f ns/record", (ns - offNs) * N_TICKS / kept);
+    }
+    printf("\n");
+}
+
+int main() {
+    FILE *devNull = fopen("/dev/null", "w");
+    if (devNull == 0) {
+        return 1;
+    }
+    run("off", LOG_OFF, devNull);
+    run("printf", LOG_SYNC, devNull);
+    run("async", LOG_ASYNC, devNull);
+    fclose(devNull);
+    return 0;
+}
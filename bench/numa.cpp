@@ -0,0 +1,82 @@
+/** bench/numa.cpp -- node-local versus interleaved machine placement
+ *  N_MACHINES Watches per node are dispatched by a pinned worker per node
+ *  while the main thread posts N_EVENTS across all of them. "local" puts
+ *  each machine and its queue in memory of its worker's node, "interleave"
+ *  spreads all memory over every node like a NUMA-unaware process, and
+ *  "remote" makes each machine on the next node over, the worst case.
+ *  On a single-node host the topology is faked as two nodes sharing the
+ *  one memory node, so the three runs should come out the same there.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "numa.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_MACHINES 256                                       /* per node */
+#define N_EVENTS   2000000
+#define Q_LEN      32
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Msg const modeMsg = { Watch_MODE_EVT };
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+static Msg const *const cycle[] = {
+    &setMsg, &modeMsg, &setMsg, &setMsg, &setMsg, &setMsg, &modeMsg,
+    &modeMsg, &tickMsg
+};
+#define N_CYCLE (sizeof(cycle) / sizeof(cycle[0]))
+
+static void run(char const *what, NumaTopo const *topo, NumaPlacement pl,
+                unsigned shift)
+{
+    Numa numa(topo, 1, 64 << 20, pl);
+    unsigned nAll = topo->nNodes * N_MACHINES;
+    Placed **placed = new Placed *[nAll];
+    for (unsigned i = 0; i < nAll; ++i) {
+        unsigned node = i % topo->nNodes;
+        Watch *w = numa.make<Watch>((node + shift) % topo->nNodes);
+        placed[i] = numa.adopt(w, node, Q_LEN);
+    }
+    numa.start();
+    double t0 = now();
+    unsigned long refused = 0;
+    for (unsigned long e = 0; e < N_EVENTS; ++e) {
+        Placed *p = placed[e % nAll];
+        while (!numa.post(p, cycle[e / nAll % N_CYCLE])) {
+            ++refused;
+            sched_yield();
+        }
+    }
+    while (numa.dispatched() < N_EVENTS) {
+        sched_yield();
+    }
+    double dt = now() - t0;
+    numa.stop();
+    printf("%-10s %6.1f ns/event, %lu posts retried\n", what,
+           dt * 1e9 / N_EVENTS, refused);
+    delete[] placed;
+}
+
+int main() {
+    NumaTopo topo;
+    Log::setMode(LOG_OFF);
+    if (!topo.discover() || topo.nNodes < 2) {
+        topo.fake(2);
+        printf("single node: faking %u nodes on %u memory node(s)\n",
+               topo.nNodes, topo.nMemNodes);
+    }
+    for (unsigned n = 0; n < topo.nNodes; ++n) {
+        printf("node %u: %u CPUs from %u, memory node %u\n", n,
+               topo.nCpus[n], topo.cpu[n][0], topo.mem[n]);
+    }
+    run("local", &topo, NUMA_LOCAL, 0);
+    run("interleave", &topo, NUMA_INTERLEAVE, 0);
+    run("remote", &topo, NUMA_LOCAL, 1);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/** bench/priority.cpp -- urgent events under a flood of ticks
+ *  A flooder thread keeps a Watch's queue full of Watch_TICK_EVT while
+ *  another thread posts a Watch_SET_EVT every PERIOD_US, and the main
+ *  thread dispatches. Run once with every event in the one queue, and
+ *  once with SET at priority level 1; prints the queueing delay of both
+ *  signals from the latency histograms (latency.h).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include <vector>
+#include "active.h"
+#include "watch.h"
+#include "latency.h"
+#include "log.h"
+
+#define Q_LEN     1024                             /* the flooded queue */
+#define HI_LEN    64
+#define N_URGENT  2000
+#define PERIOD_US 200
+
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+
+static void flood(Active *ao, std::atomic<bool> *stop) {
+    while (!stop->load(std::memory_order_relaxed)) {
+        if (!ao->post(&tickMsg)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+static void urgent(Active *ao, std::atomic<bool> *done) {
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (unsigned i = 0; i < N_URGENT; ++i) {
+        next.tv_nsec += PERIOD_US * 1000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            ++next.tv_sec;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0);
+        while (!ao->post(&setMsg)) {
+            std::this_thread::yield();
+        }
+    }
+    done->store(true);
+}
+
+/* queueing delay of a signal so far, in buckets...........................*/
+static LatencySeries queued(Event evt) {
+    LatencySeries none;
+    memset(&none, 0, sizeof(none));
+    for (LatencySeries const &s : Latency::snapshot()) {
+        if (s.kind == LATENCY_QUEUE && s.evt == evt) {
+            return s;
+        }
+    }
+    return none;
+}
+
+static void report(char const *what, Event evt, LatencySeries const &before)
+{
+    LatencySeries s = queued(evt);
+    s.count -= before.count;
+    s.sum -= before.sum;
+    for (unsigned i = 0; i < HDR_BUCKETS; ++i) {
+        s.bucket[i] -= before.bucket[i];
+    }
+    printf("  %-4s %9llu queued, p50 %9.0f  p99 %9.0f  p99.9 %9.0f  "
+           "max %9.0f ns\n", what, s.count, s.percentile(50),
+           s.percentile(99), s.percentile(99.9), s.percentile(100));
+}
+
+static void run(bool prioritized) {
+    Watch watch;
+    std::vector<QSlot> sto(Q_LEN), hiSto(HI_LEN);
+    std::vector<unsigned long long> stamps(Q_LEN), hiStamps(HI_LEN);
+    Active ao(&watch, sto.data(), Q_LEN, stamps.data());
+    MsgQueue hi(hiSto.data(), HI_LEN, hiStamps.data());
+    if (prioritized) {
+        ao.addLevel(1, &hi);
+        ao.prioritize(Watch_SET_EVT, 1);
+    }
+    watch.onStart();
+    LatencySeries setBefore = queued(Watch_SET_EVT);
+    LatencySeries tickBefore = queued(Watch_TICK_EVT);
+    std::atomic<bool> done(false), stop(false);
+    std::thread f(&flood, &ao, &stop);
+    std::thread u(&urgent, &ao, &done);
+    while (!done.load(std::memory_order_relaxed)) {
+        if (ao.dispatch(64) == 0) {
+            std::this_thread::yield();
+        }
+    }
+    stop.store(true);
+    u.join();
+    f.join();
+    while (ao.dispatch(Q_LEN) != 0) {
+    }
+    printf("%s:\n", prioritized ? "SET at level 1" : "one queue");
+    report("SET", Watch_SET_EVT, setBefore);
+    report("TICK", Watch_TICK_EVT, tickBefore);
+}
+
+int main() {
+    Log::setMode(LOG_OFF);
+    Latency::start();
+    run(false);
+    run(true);
+    Latency::stop();
+    return 0;
+}
@@ -0,0 +1,149 @@
+/** bench/registry.cpp -- routing events to a million machines by ID
+ *  Registers N_MACHINES Watches under scattered 64-bit IDs, then measures
+ *  lookups per second against a mutex-guarded std::unordered_map (what
+ *  callers kept in front of onEvent() before), routed post() plus the
+ *  dispatch, and lookups by N_READERS threads while a writer keeps
+ *  removing and re-adding machines. Every removed machine must come back
+ *  through the release hook exactly once.
+ */
+#include <stdio.h>
+#include <time.h>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "registry.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_MACHINES (1 << 20)
+#define N_LOOKUPS  10000000
+#define N_READERS  2
+#define N_CHURN    200000                        /* removals by the writer */
+#define Q_LEN      2
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long idOf(unsigned i) {        /* scattered, never 0 */
+    return ((unsigned long long)i * 0xD6E8FEB86659FD93ULL) | 1ULL << 63;
+}
+
+static unsigned next(unsigned *x) {                            /* xorshift */
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static std::atomic<unsigned long> nReleased(0);
+
+static void onRelease(Active *, void *) {       /* the Actives are reused */
+    nReleased.fetch_add(1, std::memory_order_relaxed);
+}
+
+static Msg const tickMsg = { Watch_TICK_EVT };
+
+static void reader(Registry *reg, unsigned seed, std::atomic<bool> *stop,
+                   unsigned long *n, unsigned long *found)
+{
+    unsigned x = seed;
+    unsigned long i = 0, f = 0;
+    while (!stop->load(std::memory_order_relaxed)) {
+        EpochGuard guard;
+        f += reg->find(idOf(next(&x) % N_MACHINES)) != 0;
+        ++i;
+    }
+    *n = i;
+    *found = f;
+}
+
+int main() {
+    Log::setMode(LOG_OFF);
+    Watch *watch = new Watch[N_MACHINES];
+    Active *ao = (Active *)operator new(N_MACHINES * sizeof(Active));
+    QSlot *sto = new QSlot[N_MACHINES * Q_LEN];
+    for (unsigned i = 0; i < N_MACHINES; ++i) {
+        watch[i].onStart();
+        new (&ao[i]) Active(&watch[i], &sto[i * Q_LEN], Q_LEN);
+    }
+
+    Registry reg(&onRelease);
+    double t0 = now();
+    for (unsigned i = 0; i < N_MACHINES; ++i) {
+        reg.add(idOf(i), &ao[i]);
+    }
+    printf("add:    %.1f ns each, %lu machines\n",
+           (now() - t0) * 1e9 / N_MACHINES, reg.size());
+
+    unsigned x = 12345;
+    unsigned long hits = 0;
+    t0 = now();
+    for (unsigned i = 0; i < N_LOOKUPS; ++i) {
+        EpochGuard guard;
+        hits += reg.find(idOf(next(&x) % N_MACHINES)) != 0;
+    }
+    double dt = now() - t0;
+    printf("find:   %.1f ns, %.1f M/s, %lu found\n", dt * 1e9 / N_LOOKUPS,
+           N_LOOKUPS / dt * 1e-6, hits);
+
+    std::unordered_map<unsigned long long, Active *> map;
+    std::mutex mapLock;
+    for (unsigned i = 0; i < N_MACHINES; ++i) {
+        map[idOf(i)] = &ao[i];
+    }
+    hits = 0;
+    t0 = now();
+    for (unsigned i = 0; i < N_LOOKUPS; ++i) {
+        std::lock_guard<std::mutex> lock(mapLock);
+        hits += map.find(idOf(next(&x) % N_MACHINES)) != map.end();
+    }
+    dt = now() - t0;
+    printf("locked: %.1f ns, %.1f M/s, %lu found (unordered_map)\n",
+           dt * 1e9 / N_LOOKUPS, N_LOOKUPS / dt * 1e-6, hits);
+    map.clear();
+
+    t0 = now();
+    for (unsigned i = 0; i < N_LOOKUPS; ++i) {
+        unsigned m = next(&x) % N_MACHINES;
+        reg.post(idOf(m), &tickMsg);
+        ao[m].dispatch(1);
+    }
+    dt = now() - t0;
+    printf("post:   %.1f ns per routed post and dispatch\n",
+           dt * 1e9 / N_LOOKUPS);
+
+    std::atomic<bool> stop(false);
+    unsigned long n[N_READERS], found[N_READERS];
+    std::vector<std::thread> readers;
+    t0 = now();
+    for (unsigned r = 0; r < N_READERS; ++r) {
+        readers.emplace_back(&reader, &reg, 777 + r, &stop, &n[r], &found[r]);
+    }
+    unsigned y = 99;
+    for (unsigned c = 0; c < N_CHURN; ++c) {
+        unsigned m = next(&y) % N_MACHINES;
+        if (reg.remove(idOf(m))) {
+            reg.add(idOf(m), &ao[m]);
+        }
+    }
+    stop.store(true);
+    for (std::thread &t : readers) {
+        t.join();
+    }
+    dt = now() - t0;
+    unsigned long total = 0, totalFound = 0;
+    for (unsigned r = 0; r < N_READERS; ++r) {
+        total += n[r];
+        totalFound += found[r];
+    }
+    Epoch::barrier();
+    printf("churn:  %u remove+add in %.2f s beside %lu lookups "
+           "(%.1f M/s, %lu found), %lu released\n", N_CHURN, dt, total,
+           total / dt * 1e-6, totalFound, nReleased.load());
+    return 0;
+}
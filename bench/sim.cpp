@@ -0,0 +1,139 @@
+/** bench/sim.cpp -- scripted Watch runs, and how fast they go
+ *  usage: bench_sim                        measure, on generated scripts
+ *         bench_sim script [n] [mode]      run script on n Watches
+ *  mode is off, states (default) or actions, the trace goes to stdout:
+ *
+ *      ./build/bench_sim test/watch.sim 1 actions | diff - test/watch.golden
+ *
+ *  "compile" instead of a mode writes the binary form of a text script.
+ *  Signals are those of the interactive watch: 0=mode, 1=set, 2=tick,
+ *  3=+1 day.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_EVENTS 50000000                 /* in each generated script */
+#define N_MANY   1024                       /* machines of the second run */
+
+static Msg const modeMsg = { Watch_MODE_EVT };
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+static AdvanceMsg const dayMsg = { { Watch_ADVANCE_EVT }, 24UL * 60 * 60 };
+static Msg const *const msgs[] = { &modeMsg, &setMsg, &tickMsg, &dayMsg };
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Watch *watches(unsigned n, Hsm **all) {
+    Watch *w = new Watch[n];
+    for (unsigned i = 0; i < n; ++i) {
+        w[i].onStart();
+        all[i] = &w[i];
+    }
+    return w;
+}
+
+/* random signals, every 64th of them to another machine, as text.........*/
+static bool generate(char const *path, unsigned nMachines) {
+    FILE *f = fopen(path, "w");
+    if (f == 0) {
+        return false;
+    }
+    unsigned x = 2463534242u;
+    fprintf(f, "# %u random watch events\n", N_EVENTS);
+    for (unsigned i = 0; i < N_EVENTS; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if (nMachines > 1 && i % 64 == 0) {
+            fprintf(f, "\n@%u ", x % nMachines);
+        }
+        fputc("0112222"[x % 7], f);               /* mostly ticks, no days */
+        fputc(' ', f);
+    }
+    fputc('\n', f);
+    return fclose(f) == 0;
+}
+
+static void measure(char const *what, SimScript const *s, unsigned nMachines,
+                    SimTraceMode mode, FILE *out)
+{
+    Hsm **all = new Hsm *[nMachines];
+    Watch *w = watches(nMachines, all);
+    Sim sim(all, nMachines, msgs, 4);
+    double t0 = now();
+    unsigned long n = sim.run(s, out, mode);
+    double dt = now() - t0;
+    printf("%-32s %5.1f M events/s, %lu events\n", what, n / dt * 1e-6, n);
+    delete[] w;
+    delete[] all;
+}
+
+static int bench() {
+    static char const *const modes[] = { "off", "states" };
+    FILE *null = fopen("/dev/null", "w");
+    for (unsigned many = 0; many < 2; ++many) {
+        unsigned nMachines = many ? N_MANY : 1;
+        char const *text = "/tmp/bench_sim.txt", *bin = "/tmp/bench_sim.bin";
+        SimScript ts, bs;
+        FILE *f;
+        if (!generate(text, nMachines) || !ts.open(text)
+            || (f = fopen(bin, "w")) == 0 || !ts.compile(f) || fclose(f)
+            || !bs.open(bin))
+        {
+            fprintf(stderr, "cannot write the scripts to /tmp\n");
+            return 1;
+        }
+        for (unsigned m = 0; m < 2; ++m) {
+            char what[64];
+            snprintf(what, sizeof(what), "%u watch(es), text, %s",
+                     nMachines, modes[m]);
+            measure(what, &ts, nMachines, (SimTraceMode)m, null);
+            snprintf(what, sizeof(what), "%u watch(es), binary, %s",
+                     nMachines, modes[m]);
+            measure(what, &bs, nMachines, (SimTraceMode)m, null);
+        }
+        remove(text);
+        remove(bin);
+    }
+    fclose(null);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Log::setMode(LOG_OFF);
+    if (argc < 2) {
+        return bench();
+    }
+    SimScript script;
+    if (!script.open(argv[1])) {
+        fprintf(stderr, "cannot map %s\n", argv[1]);
+        return 1;
+    }
+    unsigned n = argc > 2 ? (unsigned)atoi(argv[2]) : 1;
+    char const *mode = argc > 3 ? argv[3] : "states";
+    if (strcmp(mode, "compile") == 0) {
+        return script.compile(stdout) ? 0 : 1;
+    }
+    Hsm **all = new Hsm *[n];
+    Watch *w = watches(n, all);
+    Sim sim(all, n, msgs, 4);
+    sim.run(&script, stdout,
+            strcmp(mode, "off") == 0 ? SIM_TRACE_OFF
+            : strcmp(mode, "actions") == 0 ? SIM_TRACE_ACTIONS
+            : SIM_TRACE_STATES);
+    if (sim.skipped() != 0) {
+        fprintf(stderr, "%lu events skipped\n", sim.skipped());
+    }
+    delete[] w;
+    delete[] all;
+    return 0;
+}
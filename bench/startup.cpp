@@ -0,0 +1,33 @@
+/** bench/startup.cpp -- cost of bringing up many Watch machines
+ *  usage: bench_startup [machines]
+ *  Times the constructors of a fresh array of watches, then the initial
+ *  transitions (onStart) with handler output off.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "watch.h"
+#include "log.h"
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : 1000000;
+    Log::setMode(LOG_OFF);
+    double t0 = now();
+    Watch *w = new Watch[n];
+    double t1 = now();
+    for (unsigned i = 0; i < n; ++i) {
+        w[i].onStart();
+    }
+    double t2 = now();
+    printf("%u watches of %zu bytes: construct %.1f ms (%.1f ns each), "
+           "onStart %.1f ms\n", n, sizeof(Watch), (t1 - t0) * 1e3,
+           (t1 - t0) * 1e9 / n, (t2 - t1) * 1e3);
+    delete[] w;
+    return 0;
+}
@@ -0,0 +1,90 @@
+/** bench/state.cpp -- dispatch across many Watch machines
+ *  usage: bench_state [machines]
+ *  Sends mode/set/tick events to machines picked at random, so the cost
+ *  is dominated by how much of each machine and its topology has to be
+ *  brought in. L1D read misses are counted with perf_event_open() where
+ *  the kernel exposes the hardware counter.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "watch.h"
+#include "log.h"
+
+#define N_EVENTS 4000000
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int openL1Misses() {                     /* -1 when not available */
+    perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HW_CACHE;
+    a.config = PERF_COUNT_HW_CACHE_L1D |
+               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    a.disabled = 1;
+    a.exclude_kernel = 1;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+static Msg const watchMsg[] = { { Watch_MODE_EVT }, { Watch_SET_EVT },
+                                { Watch_TICK_EVT }, { Watch_TICK_EVT } };
+
+int main(int argc, char **argv) {
+    unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : 16384;
+    unsigned *pick = new unsigned[N_EVENTS];
+    unsigned long long x = 88172645463325252ull;
+    for (unsigned i = 0; i < N_EVENTS; ++i) {              /* xorshift64 */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        pick[i] = (unsigned)(x >> 32);
+    }
+
+    Log::setMode(LOG_OFF);
+    Watch *w = new Watch[n];
+    for (unsigned i = 0; i < n; ++i) {
+        w[i].onStart();
+    }
+    int fd = openL1Misses();
+    unsigned long long misses = 0;
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    double t0 = now();
+    for (unsigned i = 0; i < N_EVENTS; ++i) {
+        w[pick[i] % n].onEvent(&watchMsg[pick[i] >> 30]);
+    }
+    double dt = now() - t0;
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) {
+            misses = 0;
+        }
+        close(fd);
+    }
+
+    printf("sizeof(State) %zu, sizeof(Watch) %zu, %u machines (%zu KB)\n",
+           sizeof(State), sizeof(Watch), n, n * sizeof(Watch) / 1024);
+    printf("%.1f ns/event, ", dt * 1e9 / N_EVENTS);
+    if (fd >= 0) {
+        printf("%.2f L1D read misses/event\n", (double)misses / N_EVENTS);
+    }
+    else {
+        printf("L1D miss counter not available\n");
+    }
+    delete[] w;
+    delete[] pick;
+    return 0;
+}
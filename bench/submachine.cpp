@@ -0,0 +1,292 @@
+/** bench/submachine.cpp -- a pasted setting hierarchy against a shared one
+ *  N_CLASSES clock classes, stamped out by a template, each either with
+ *  its own copy of the hour/minute/day/month states (CopyClock<K>) or
+ *  with the SetClock submachine embedded (SubClock<K>). MODE and SET go
+ *  to instances picked at random, so with copies the handlers of many
+ *  classes compete for the instruction cache. The clocks of both kinds
+ *  must come out set the same. Prints ns/event of each kind; nm -S on
+ *  the binary shows the handler code behind them.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <utility>
+#include "setclock.h"
+#include "log.h"
+
+#define N_CLASSES   64
+#define N_PER_CLASS 16
+#define N_EVENTS    4000000
+
+enum ClockEvents { MODE_EVT, SET_EVT };
+
+static Msg const clockMsg[] = { { MODE_EVT }, { SET_EVT } };
+
+template<int K>
+class CopyClock : public Hsm {          /* setting states pasted, per K */
+    enum StateIds {
+        S_TOP, S_TIME, S_SETTING, S_HOUR, S_MINUTE, S_DAY, S_MONTH, S_COUNT
+    };
+    static State const states[S_COUNT];
+    static EvtHndlr const hndlrs[S_COUNT];
+    static char const *const names[S_COUNT];
+    static HsmTopo const topo;
+public:
+    ClockFields c;
+
+    CopyClock() : Hsm("CopyClock", &topo), c{0, 0, 0, 1, 1, 2000} {}
+    Msg const *topHndlr(Msg const *msg) {
+        if (msg->evt == START_EVT) {
+            STATE_START(&states[S_TIME]);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *timeHndlr(Msg const *msg) {
+        if (msg->evt == SET_EVT) {
+            STATE_TRAN(&states[S_SETTING]);
+            LOG("CopyClock%d::setting", K);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *settingHndlr(Msg const *msg) {
+        if (msg->evt == START_EVT) {
+            STATE_START(&states[S_HOUR]);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *hourHndlr(Msg const *msg) {
+        switch (msg->evt) {
+        case SET_EVT:
+            STATE_TRAN(&states[S_MINUTE]);
+            return 0;
+        case MODE_EVT:
+            if (++c.thour == 24) {
+                c.thour = 0;
+            }
+            LOG("CopyClock%d::hour++: %d", K, c.thour);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *minuteHndlr(Msg const *msg) {
+        switch (msg->evt) {
+        case SET_EVT:
+            STATE_TRAN(&states[S_DAY]);
+            return 0;
+        case MODE_EVT:
+            if (++c.tmin == 60) {
+                c.tmin = 0;
+            }
+            LOG("CopyClock%d::min++: %d", K, c.tmin);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *dayHndlr(Msg const *msg) {
+        switch (msg->evt) {
+        case SET_EVT:
+            STATE_TRAN(&states[S_MONTH]);
+            return 0;
+        case MODE_EVT:
+            if (++c.dday > c.daysInMonth()) {
+                c.dday = 1;
+            }
+            LOG("CopyClock%d::day++: %d", K, c.dday);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *monthHndlr(Msg const *msg) {
+        switch (msg->evt) {
+        case SET_EVT:
+            STATE_TRAN(&states[S_TIME]);
+            return 0;
+        case MODE_EVT:
+            if (++c.dmonth == 13) {
+                c.dmonth = 1;
+            }
+            LOG("CopyClock%d::month++: %d", K, c.dmonth);
+            return 0;
+        }
+        return msg;
+    }
+};
+
+template<int K>
+State const CopyClock<K>::states[S_COUNT] = {
+    State(S_TOP, HSM_NO_SUPER),
+      State(S_TIME, S_TOP),
+      State(S_SETTING, S_TOP),
+        State(S_HOUR, S_SETTING),
+        State(S_MINUTE, S_SETTING),
+        State(S_DAY, S_SETTING),
+        State(S_MONTH, S_SETTING)
+};
+
+template<int K>
+EvtHndlr const CopyClock<K>::hndlrs[S_COUNT] = {
+    (EvtHndlr)&CopyClock::topHndlr,
+      (EvtHndlr)&CopyClock::timeHndlr,
+      (EvtHndlr)&CopyClock::settingHndlr,
+        (EvtHndlr)&CopyClock::hourHndlr,
+        (EvtHndlr)&CopyClock::minuteHndlr,
+        (EvtHndlr)&CopyClock::dayHndlr,
+        (EvtHndlr)&CopyClock::monthHndlr
+};
+
+template<int K>
+char const *const CopyClock<K>::names[S_COUNT] = {
+    "top", "time", "setting", "hour", "minute", "day", "month"
+};
+
+template<int K>
+HsmTopo const CopyClock<K>::topo = { states, hndlrs, names, S_COUNT };
+
+template<int K>
+class SubClock : public Hsm {             /* SetClock embedded, per K */
+    enum StateIds { S_TOP, S_TIME, S_SETTING, S_COUNT };
+    static State const states[S_COUNT];
+    static EvtHndlr const hndlrs[S_COUNT];
+    static char const *const names[S_COUNT];
+    static HsmTopo const topo;
+public:
+    ClockFields c;
+    SetClock setting;
+
+    SubClock()
+            : Hsm("SubClock", &topo), c{0, 0, 0, 1, 1, 2000},
+              setting(&c, MODE_EVT, SET_EVT) {}
+    Msg const *topHndlr(Msg const *msg) {
+        if (msg->evt == START_EVT) {
+            STATE_START(&states[S_TIME]);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *timeHndlr(Msg const *msg) {
+        if (msg->evt == SET_EVT) {
+            STATE_TRAN(&states[S_SETTING]);
+            LOG("SubClock%d::setting", K);
+            return 0;
+        }
+        return msg;
+    }
+    Msg const *settingHndlr(Msg const *msg) {       /* hosts SetClock */
+        switch (msg->evt) {
+        case ENTRY_EVT:
+            setting.enter(SetClock::at(SETCLOCK_HOUR));
+            return 0;
+        case EXIT_EVT:
+            setting.leave();
+            return 0;
+        case START_EVT:
+            return 0;
+        }
+        if (setting.onEvent(msg) != 0) {
+            return msg;
+        }
+        if (setting.takeExit() == SETCLOCK_DONE) {
+            STATE_TRAN(&states[S_TIME]);
+        }
+        return 0;
+    }
+};
+
+template<int K>
+State const SubClock<K>::states[S_COUNT] = {
+    State(S_TOP, HSM_NO_SUPER),
+      State(S_TIME, S_TOP),
+      State(S_SETTING, S_TOP)
+};
+
+template<int K>
+EvtHndlr const SubClock<K>::hndlrs[S_COUNT] = {
+    (EvtHndlr)&SubClock::topHndlr,
+      (EvtHndlr)&SubClock::timeHndlr,
+      (EvtHndlr)&SubClock::settingHndlr
+};
+
+template<int K>
+char const *const SubClock<K>::names[S_COUNT] = {
+    "top", "time", "setting"
+};
+
+template<int K>
+HsmTopo const SubClock<K>::topo = { states, hndlrs, names, S_COUNT };
+
+static Hsm *copies[N_CLASSES * N_PER_CLASS];
+static Hsm *subs[N_CLASSES * N_PER_CLASS];
+static ClockFields *copyClock[N_CLASSES * N_PER_CLASS];
+static ClockFields *subClock[N_CLASSES * N_PER_CLASS];
+
+template<int K>
+static void make(unsigned i) {            /* class K, its i-th instance */
+    unsigned at = i * N_CLASSES + K;           /* classes interleaved */
+    CopyClock<K> *c = new CopyClock<K>;
+    SubClock<K> *s = new SubClock<K>;
+    copies[at] = c;
+    copyClock[at] = &c->c;
+    subs[at] = s;
+    subClock[at] = &s->c;
+}
+
+template<int... K>
+static void makeAll(unsigned i, std::integer_sequence<int, K...>) {
+    (make<K>(i), ...);
+}
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(Hsm *const *m, unsigned const *pick) {
+    double t0 = now();
+    for (unsigned i = 0; i < N_EVENTS; ++i) {
+        m[pick[i] % (N_CLASSES * N_PER_CLASS)]
+            ->onEvent(&clockMsg[pick[i] >> 31]);
+    }
+    return (now() - t0) * 1e9 / N_EVENTS;
+}
+
+int main() {
+    unsigned *pick = new unsigned[N_EVENTS];
+    unsigned long long x = 88172645463325252ull;
+    for (unsigned i = 0; i < N_EVENTS; ++i) {              /* xorshift64 */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        pick[i] = (unsigned)(x >> 32);
+    }
+    Log::setMode(LOG_OFF);
+    for (unsigned i = 0; i < N_PER_CLASS; ++i) {
+        makeAll(i, std::make_integer_sequence<int, N_CLASSES>());
+    }
+    for (unsigned i = 0; i < N_CLASSES * N_PER_CLASS; ++i) {
+        copies[i]->onStart();
+        subs[i]->onStart();
+    }
+
+    run(copies, pick);                                        /* warm up */
+    run(subs, pick);
+    double copyNs = run(copies, pick);
+    double subNs = run(subs, pick);
+    unsigned differ = 0;
+    for (unsigned i = 0; i < N_CLASSES * N_PER_CLASS; ++i) {
+        differ += memcmp(copyClock[i], subClock[i], sizeof(ClockFields)) != 0;
+    }
+    printf("%u classes x %u clocks, %u events\n", N_CLASSES, N_PER_CLASS,
+           N_EVENTS);
+    printf("pasted setting states:  %6.1f ns/event, %zu bytes/clock\n",
+           copyNs, sizeof(CopyClock<0>));
+    printf("shared SetClock:        %6.1f ns/event, %zu bytes/clock\n",
+           subNs, sizeof(SubClock<0>));
+    printf("%u of %u clocks set differently\n", differ,
+           N_CLASSES * N_PER_CLASS);
+    delete[] pick;
+    return differ == 0 ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+/** bench/threaded.cpp -- status-code engine against hsm.h on HsmTest
+ *  Dispatches the HsmTest statechart three ways: its own handlers through
+ *  Hsm::onEvent(), the same handlers through StatusHsm::adapt(), and a
+ *  copy rewritten to return HsmStatus through StatusHsm::onEvent(). First
+ *  all three are traced over the same random events and must enter and
+ *  exit the same states. Then each is timed over the a..h cycle and over
+ *  random events. Branch misses are counted with perf_event_open() where
+ *  the kernel exposes the hardware counter.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "threaded.h"
+#include "log.h"
+
+#define main hsmTestMain                  /* HsmTest, its handlers as is */
+#include "../src/cpp/hsmtst.cpp"
+#undef main
+
+#define N_EVENTS 8000000
+#define N_RANDOM 4096                       /* random events, repeated */
+#define N_TRACED 100000
+
+class StatusTest : public StatusHsm {     /* HsmTest with HsmStatus */
+    int myFoo;
+protected:
+    State s1;
+      State s11;
+    State s2;
+      State s21;
+        State s211;
+public:
+    StatusTest();
+    HsmStatus topHndlr(Msg const *msg);
+    HsmStatus s1Hndlr(Msg const *msg);
+    HsmStatus s11Hndlr(Msg const *msg);
+    HsmStatus s2Hndlr(Msg const *msg);
+    HsmStatus s21Hndlr(Msg const *msg);
+    HsmStatus s211Hndlr(Msg const *msg);
+};
+
+HsmStatus StatusTest::topHndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        LOG("top-INIT;");
+        STATE_START(&s1);
+        return HSM_TRAN;
+    case ENTRY_EVT:
+        LOG("top-ENTRY;");
+        return HSM_HANDLED;
+    case EXIT_EVT:
+        LOG("top-EXIT;");
+        return HSM_HANDLED;
+    case E_SIG:
+        LOG("top-E;");
+        STATUS_TRAN(&s211);
+    }
+    return HSM_IGNORED;
+}
+
+HsmStatus StatusTest::s1Hndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        LOG("s1-INIT;");
+        STATE_START(&s11);
+        return HSM_TRAN;
+    case ENTRY_EVT:
+        LOG("s1-ENTRY;");
+        return HSM_HANDLED;
+    case EXIT_EVT:
+        LOG("s1-EXIT;");
+        return HSM_HANDLED;
+    case A_SIG:
+        LOG("s1-A;");
+        STATUS_TRAN(&s1);
+    case B_SIG:
+        LOG("s1-B;");
+        STATUS_TRAN(&s11);
+    case C_SIG:
+        LOG("s1-C;");
+        STATUS_TRAN(&s2);
+    case D_SIG:
+        LOG("s1-D;");
+        STATUS_TRAN(&top);
+    case F_SIG:
+        LOG("s1-F;");
+        STATUS_TRAN(&s211);
+    }
+    return HSM_SUPER;
+}
+
+HsmStatus StatusTest::s11Hndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case ENTRY_EVT:
+        LOG("s11-ENTRY;");
+        return HSM_HANDLED;
+    case EXIT_EVT:
+        LOG("s11-EXIT;");
+        return HSM_HANDLED;
+    case G_SIG:
+        LOG("s11-G;");
+        STATUS_TRAN(&s211);
+    case H_SIG:
+        if (myFoo) {
+            LOG("s11-H;");
+            myFoo = 0;
+            return HSM_HANDLED;
+        }
+        break;
+    }
+    return HSM_SUPER;
+}
+
+HsmStatus StatusTest::s2Hndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        LOG("s2-INIT;");
+        STATE_START(&s21);
+        return HSM_TRAN;
+    case ENTRY_EVT:
+        LOG("s2-ENTRY;");
+        return HSM_HANDLED;
+    case EXIT_EVT:
+        LOG("s2-EXIT;");
+        return HSM_HANDLED;
+    case C_SIG:
+        LOG("s2-C;");
+        STATUS_TRAN(&s1);
+    case F_SIG:
+        LOG("s2-F;");
+        STATUS_TRAN(&s11);
+    }
+    return HSM_SUPER;
+}
+
+HsmStatus StatusTest::s21Hndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case START_EVT:
+        LOG("s21-INIT;");
+        STATE_START(&s211);
+        return HSM_TRAN;
+    case ENTRY_EVT:
+        LOG("s21-ENTRY;");
+        return HSM_HANDLED;
+    case EXIT_EVT:
+        LOG("s21-EXIT;");
+        return HSM_HANDLED;
+    case B_SIG:
+        LOG("s21-B;");
+        STATUS_TRAN(&s211);
+    case H_SIG:
+        if (!myFoo) {
+            LOG("s21-H;");
+            myFoo = 1;
+            STATUS_TRAN(&s21);
+        }
+        break;
+    }
+    return HSM_SUPER;
+}
+
+HsmStatus StatusTest::s211Hndlr(Msg const *msg) {
+    switch (msg->evt) {
+    case ENTRY_EVT:
+        LOG("s211-ENTRY;");
+        return HSM_HANDLED;
+    case EXIT_EVT:
+        LOG("s211-EXIT;");
+        return HSM_HANDLED;
+    case D_SIG:
+        LOG("s211-D;");
+        STATUS_TRAN(&s21);
+    case G_SIG:
+        LOG("s211-G;");
+        STATUS_TRAN(&top);
+    }
+    return HSM_SUPER;
+}
+
+StatusTest::StatusTest()
+: StatusHsm("HsmTest", (StatusHndlr)&StatusTest::topHndlr),
+    s1("s1", &top, STATUS_HNDLR(&StatusTest::s1Hndlr)),
+    s11("s11", &s1, STATUS_HNDLR(&StatusTest::s11Hndlr)),
+    s2("s2", &top, STATUS_HNDLR(&StatusTest::s2Hndlr)),
+    s21("s21", &s2, STATUS_HNDLR(&StatusTest::s21Hndlr)),
+    s211("s211", &s21, STATUS_HNDLR(&StatusTest::s211Hndlr))
+{
+    myFoo = 0;
+}
+
+enum Engine { ENGINE_HSM, ENGINE_ADAPT, ENGINE_STATUS };
+static char const *const engineName[] = {
+    "Hsm::onEvent", "StatusHsm::adapt", "StatusHsm::onEvent"
+};
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int openBranchMisses() {                 /* -1 when not available */
+    perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = PERF_COUNT_HW_BRANCH_MISSES;
+    a.disabled = 1;
+    a.exclude_kernel = 1;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+static unsigned long long traceHash;    /* FNV-1a of entries and exits */
+
+static void traceHook(Hsm const *me, State const *s, int kind, Event) {
+    if (kind != HSM_TRACE_DISPATCH) {
+        for (char const *c = me->getStateName(s); *c; ++c) {
+            traceHash = (traceHash ^ (unsigned char)*c) * 0x100000001B3ULL;
+        }
+        traceHash = (traceHash ^ (unsigned)kind) * 0x100000001B3ULL;
+    }
+}
+
+static void run(Engine e, Hsm *m, StatusTest *status,
+                unsigned char const *sig, unsigned mask, unsigned long n)
+{
+    switch (e) {                           /* one loop each, no dispatch */
+    case ENGINE_HSM:
+        for (unsigned long i = 0; i < n; ++i) {
+            m->onEvent(&HsmTestMsg[sig[i & mask]]);
+        }
+        break;
+    case ENGINE_ADAPT:
+        for (unsigned long i = 0; i < n; ++i) {
+            StatusHsm::adapt(m, &HsmTestMsg[sig[i & mask]]);
+        }
+        break;
+    case ENGINE_STATUS:
+        for (unsigned long i = 0; i < n; ++i) {
+            status->onEvent(&HsmTestMsg[sig[i & mask]]);
+        }
+        break;
+    }
+}
+
+static void bench(char const *what, unsigned char const *sig, unsigned mask,
+                  Hsm *const *m, StatusTest *status)
+{
+    int fd = openBranchMisses();
+    for (int e = ENGINE_HSM; e <= ENGINE_STATUS; ++e) {
+        unsigned long long misses = 0;
+        run((Engine)e, m[e], status, sig, mask, N_EVENTS / 8); /* warm up */
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        double t0 = now();
+        run((Engine)e, m[e], status, sig, mask, N_EVENTS);
+        double dt = now() - t0;
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) {
+                misses = 0;
+            }
+        }
+        printf("%-7s %-19s %6.1f ns/event", what, engineName[e],
+               dt * 1e9 / N_EVENTS);
+        if (fd >= 0) {
+            printf(", %.3f branch misses/event",
+                   (double)misses / N_EVENTS);
+        }
+        printf("\n");
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    else {
+        printf("(branch miss counter not available)\n");
+    }
+}
+
+int main() {
+    static unsigned char cycle[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    static unsigned char shuffled[N_RANDOM];
+    unsigned long long x = 88172645463325252ull;
+    for (unsigned i = 0; i < N_RANDOM; ++i) {               /* xorshift64 */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        shuffled[i] = (unsigned char)(x >> 61);
+    }
+    Log::setMode(LOG_OFF);
+    HsmTest legacy, adapted;
+    StatusTest status;
+    Hsm *const m[] = { &legacy, &adapted, 0 };       /* status: not an Hsm */
+
+    unsigned long long hash[3];
+    HsmTracer const before = Hsm::tracer.exchange(&traceHook);
+    for (int e = ENGINE_HSM; e <= ENGINE_STATUS; ++e) {
+        traceHash = 0xCBF29CE484222325ULL;
+        if (e == ENGINE_STATUS) {
+            status.onStart();
+        }
+        else {
+            m[e]->onStart();
+        }
+        run((Engine)e, m[e], &status, shuffled, N_RANDOM - 1, N_TRACED);
+        hash[e] = traceHash;
+    }
+    Hsm::tracer.store(before);
+    bool same = hash[ENGINE_ADAPT] == hash[ENGINE_HSM]
+                && hash[ENGINE_STATUS] == hash[ENGINE_HSM];
+    printf("%u random events: entries and exits %s\n", N_TRACED,
+           same ? "match" : "DIFFER");
+
+    bench("a..h", cycle, 7, m, &status);
+    bench("random", shuffled, N_RANDOM - 1, m, &status);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+/** bench/trace.cpp -- cost and output rate of the timeline exporter
+ *  N_THREADS threads each cycle N_WATCHES Watches through the setting and
+ *  timekeeping states, with tracing off and streaming the timeline. The
+ *  saturated runs dispatch flat out, which no writer keeps up with, so the
+ *  rings fill and records drop; the paced runs pause PACE_US after every
+ *  round, closer to a loaded service, and should drop nothing. The trace
+ *  of the last run goes to the file named on the command line, or to
+ *  /dev/null; open it in ui.perfetto.dev or chrome://tracing.
+ */
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "watch.h"
+#include "trace.h"
+#include "log.h"
+
+#define N_THREADS 4
+#define N_WATCHES 64                                       /* per thread */
+#define N_ROUNDS  1000
+#define PACE_US   4000
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Msg const modeMsg = { Watch_MODE_EVT };
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+
+static char const *sigName(Event evt) {
+    switch (evt) {
+    case Watch_MODE_EVT: return "MODE";
+    case Watch_SET_EVT:  return "SET";
+    case Watch_TICK_EVT: return "TICK";
+    }
+    return 0;
+}
+
+static void drive(Watch *w, unsigned long *n, unsigned pace) {
+    for (int r = 0; r < N_ROUNDS; ++r) {
+        for (int i = 0; i < N_WATCHES; ++i) {
+            w[i].onEvent(&setMsg);               /* hour .. month, then time */
+            w[i].onEvent(&modeMsg);
+            for (int k = 0; k < 4; ++k) {
+                w[i].onEvent(&setMsg);
+            }
+            w[i].onEvent(&modeMsg);                /* date and back, or so */
+            w[i].onEvent(&modeMsg);
+            w[i].onEvent(&tickMsg);
+            *n += 9;
+        }
+        if (pace) {
+            usleep(pace);
+        }
+    }
+}
+
+/* wall time of the run less the pauses, total dispatches to *n...........*/
+static double run(FILE *out, unsigned pace, unsigned long *n) {
+    std::vector<Watch> watches(N_THREADS * N_WATCHES);
+    for (Watch &w : watches) {
+        w.onStart();
+    }
+    if (out) {
+        Trace::start(out, &sigName);
+    }
+    std::vector<unsigned long> counts(N_THREADS);
+    std::vector<std::thread> threads;
+    double t0 = now();
+    for (int t = 0; t < N_THREADS; ++t) {
+        threads.emplace_back(&drive, &watches[t * N_WATCHES], &counts[t],
+                             pace);
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double dt = now() - t0 - N_ROUNDS * pace * 1e-6;
+    if (out) {
+        Trace::stop();
+    }
+    *n = 0;
+    for (unsigned long c : counts) {
+        *n += c;
+    }
+    return dt;
+}
+
+int main(int argc, char *argv[]) {
+    char const *path = argc > 1 ? argv[1] : "/dev/null";
+    FILE *out = fopen(path, "w");
+    if (out == 0) {
+        perror(path);
+        return 1;
+    }
+    Log::setMode(LOG_OFF);                     /* the Watch display is noise */
+    FILE *devNull = fopen("/dev/null", "w");
+    for (unsigned pace = 0; pace <= PACE_US; pace += PACE_US) {
+        char const *what = pace ? "paced" : "flat out";
+        unsigned long n, lost = Trace::dropped();
+        double off = run(0, pace, &n);
+        printf("%-8s off    %6.1f ns/dispatch\n", what, off * 1e9 / n);
+        FILE *f = pace ? out : devNull;
+        double on = run(f, pace, &n);
+        printf("%-8s traced %6.1f ns/dispatch, %lu trace events, "
+               "%lu records dropped", what, on * 1e9 / n,
+               Trace::written(), Trace::dropped() - lost);
+        if (f == out) {
+            printf(", %.1f MB", ftell(out) / 1e6);
+        }
+        printf("\n");
+    }
+    fclose(devNull);
+    fclose(out);
+    return 0;
+}
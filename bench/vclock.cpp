@@ -0,0 +1,96 @@
+/** bench/vclock.cpp -- a fleet of Watches through a virtual day
+ *  usage: bench_vclock [watches] [hours] [shards]
+ *  Every Watch is set to timekeeping at virtual time 0 and then ticked at
+ *  1 Hz, each with its own phase within the second, for the given virtual
+ *  hours (default 10^5 Watches for 24 hours). Shards synchronise every
+ *  LOOKAHEAD of virtual time. Afterwards every Watch must read the same
+ *  as one moved forward by the same time with a single Watch_ADVANCE_EVT;
+ *  they are compared through their hibernation records (hibernate.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include <new>
+#include "vclock.h"
+#include "hibernate.h"
+#include "watch.h"
+#include "log.h"
+
+#define N_WATCHES 100000
+#define N_HOURS   24
+#define LOOKAHEAD (100 * VT_MS)
+
+static double now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Hsm *buildWatch(void *mem) {
+    return new (mem) Watch();
+}
+
+static void destroyWatch(Hsm *m) {
+    ((Watch *)m)->~Watch();
+}
+
+static Msg const setMsg = { Watch_SET_EVT };
+static Msg const tickMsg = { Watch_TICK_EVT };
+
+int main(int argc, char *argv[]) {
+    unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : N_WATCHES;
+    unsigned hours = argc > 2 ? (unsigned)atoi(argv[2]) : N_HOURS;
+    unsigned nShards = argc > 3 ? (unsigned)atoi(argv[3])
+                                : std::thread::hardware_concurrency();
+    if (nShards == 0 || nShards > VCLOCK_MAX_SHARDS) {
+        nShards = 1;
+    }
+    Log::setMode(LOG_OFF);
+
+    Watch *w = new Watch[n];
+    VClock clock(nShards, LOOKAHEAD);
+    unsigned x = 2463534242u;
+    for (unsigned i = 0; i < n; ++i) {
+        unsigned id = clock.add(&w[i]);
+        for (unsigned s = 0; s < 4; ++s) {     /* hour, minute, day, month */
+            clock.at(id, 0, &setMsg);
+        }
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        clock.every(id, VT_SEC, VT_SEC + x % 1000 * VT_MS, &tickMsg);
+    }
+    VTime horizon = (VTime)hours * 3600 * VT_SEC + VT_SEC;  /* last tick */
+    double t0 = now();
+    if (!clock.run(horizon)) {
+        fprintf(stderr, "cannot start %u shards\n", nShards);
+        return 1;
+    }
+    double dt = now() - t0;
+    printf("%u Watches, %u virtual hours, %u shard(s): %.2f s wall, "
+           "%.0fx real time\n", n, hours, nShards, dt, hours * 3600.0 / dt);
+    printf("%lu events, %.1f M/s, %lu windows\n", clock.dispatched(),
+           clock.dispatched() / dt * 1e-6, clock.windows());
+
+    HsmClass cls(&buildWatch, &destroyWatch, sizeof(Watch));
+    ((Watch *)cls.getProto())->reg(&cls);
+    Watch ref;
+    ref.onStart();
+    for (unsigned s = 0; s < 4; ++s) {
+        ref.onEvent(&setMsg);
+    }
+    AdvanceMsg day = { { Watch_ADVANCE_EVT }, hours * 3600UL };
+    ref.onEvent(&day);
+    unsigned char a[64], b[64];
+    unsigned bad = 0;
+    cls.pack(&ref, a);
+    for (unsigned i = 0; i < n; ++i) {
+        cls.pack(&w[i], b);
+        bad += memcmp(a, b, cls.getRecordSize()) != 0;
+    }
+    printf("%u of %u Watches differ from one advanced at once\n", bad, n);
+    delete[] w;
+    return bad != 0;
+}
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""fold-states.py -- fold profiles by state machine, state and signal
+
+Turns CPU samples into flame-graph input (one "frame;frame;... count"
+line per stack) whose first frames are the machine, the current state
+and the signal being dispatched, taken from the hsm:dispatch/hsm:done
+USDT probes (build with ENABLE_USDT=1, see src/probe.h). Feed the output
+to flamegraph.pl, speedscope or any other folded-stack viewer.
+
+perf:
+    perf probe -x BIN -a 'sdt_hsm:dispatch' -a 'sdt_hsm:done'
+    perf record -e sdt_hsm:dispatch -e sdt_hsm:done -e cpu-clock \\
+        -g -p PID -- sleep 30
+    perf script --show-mmap-events | fold-states.py --binary BIN
+
+perf reports the probe arguments as addresses. The names are string
+literals in BIN, so they are read back from the file using the load
+address found in the mmap events.
+
+bpftrace (names are read by the probe itself):
+    fold-states.py --bpftrace BIN > states.bt
+    bpftrace -p PID states.bt > samples.txt      # stop with ^C
+    fold-states.py --from-bpftrace < samples.txt
+"""
+import argparse
+import collections
+import re
+import struct
+import sys
+
+BPFTRACE = """usdt:%(bin)s:hsm:dispatch {
+    @machine[tid] = str(arg0); @state[tid] = str(arg1); @sig[tid] = arg2;
+}
+usdt:%(bin)s:hsm:done {
+    delete(@machine[tid]); delete(@state[tid]); delete(@sig[tid]);
+}
+profile:hz:999 /@state[tid] != ""/ {
+    @samples[@machine[tid], @state[tid], @sig[tid], ustack] = count();
+}
+END { clear(@machine); clear(@state); clear(@sig); }
+"""
+
+
+class Binary:
+    """read NUL terminated strings of an ELF file by run-time address"""
+
+    def __init__(self, path):
+        self.path = path
+        self.data = open(path, 'rb').read()
+        self.loads = []                          # (vaddr, memsz, offset)
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 2:
+            sys.exit('%s: not a 64-bit ELF file' % path)
+        e = '<' if self.data[5] == 1 else '>'
+        phoff, = struct.unpack_from(e + 'Q', self.data, 0x20)
+        phentsize, phnum = struct.unpack_from(e + 'HH', self.data, 0x36)
+        for i in range(phnum):
+            p = phoff + i * phentsize
+            ptype, _, offset, vaddr = struct.unpack_from(e + 'IIQQ',
+                                                         self.data, p)
+            memsz, = struct.unpack_from(e + 'Q', self.data, p + 0x28)
+            if ptype == 1:                                     # PT_LOAD
+                self.loads.append((vaddr, memsz, offset))
+        self.bias = None
+
+    def mapped(self, start, pgoff):
+        """executable mapping of this file at start, file offset pgoff"""
+        for vaddr, memsz, offset in self.loads:
+            if offset <= pgoff < offset + memsz:
+                self.bias = start - (vaddr + pgoff - offset)
+                return
+
+    def string(self, addr):
+        if self.bias is None:
+            return '%#x' % addr
+        vaddr = addr - self.bias
+        for base, memsz, offset in self.loads:
+            if base <= vaddr < base + memsz:
+                o = vaddr - base + offset
+                end = self.data.find(b'\0', o)
+                return self.data[o:end].decode('utf-8', 'replace')
+        return '%#x' % addr
+
+
+MMAP = re.compile(r'PERF_RECORD_MMAP2? .*\[(0x[0-9a-f]+)\((0x[0-9a-f]+)\) '
+                  r'@ (0x[0-9a-f]+|\d+)[^\]]*\]: r-xp (\S+)')
+EVENT = re.compile(r'^\s*(\S.*?)\s+(\d+)(?:/(\d+))?\s+(?:\[\d+\]\s+)?'
+                   r'[\d.]+:\s+(?:\d+\s+)?(\S+):')
+ARG = re.compile(r'(\w+)=("(?:[^"\\]|\\.)*"|\S+)')
+FRAME = re.compile(r'^\s+[0-9a-f]+\s+(.*?)(?:\+0x[0-9a-f]+)?\s+\((.*)\)$')
+
+
+def argval(binary, v):
+    if v.startswith('"'):
+        return v[1:-1]
+    try:
+        n = int(v, 0)
+    except ValueError:
+        return v
+    return binary.string(n) if binary else '%#x' % n
+
+
+def fold_perf(lines, binary, out):
+    """perf script text: probe events set the context, samples are folded"""
+    ctx = collections.defaultdict(list)        # tid -> [(machine, state, sig)]
+    folded = collections.Counter()
+    event = None
+    frames = []
+
+    def flush():
+        if event is None:
+            return
+        tid, name, rest = event
+        if name.endswith('hsm:dispatch'):
+            a = [v for _, v in ARG.findall(rest)]
+            if len(a) >= 3:
+                sig = int(a[2], 0) & 0xFFFFFFFF
+                sig -= (sig & 0x80000000) << 1               # signed int
+                ctx[tid].append((argval(binary, a[0]), argval(binary, a[1]),
+                                 'sig %d' % sig))
+        elif name.endswith('hsm:done'):
+            if ctx[tid]:
+                ctx[tid].pop()
+        elif ctx[tid] and frames:
+            stack = ';'.join(reversed(frames))
+            machine, state, sig = ctx[tid][-1]
+            folded['%s;%s;%s;%s' % (machine, state, sig, stack)] += 1
+
+    for line in lines:
+        m = MMAP.search(line)
+        if m and binary and m.group(4) == binary.path:
+            pgoff = m.group(3)
+            binary.mapped(int(m.group(1), 16), int(pgoff, 0))
+            continue
+        if not line.strip():
+            flush()
+            event, frames = None, []
+            continue
+        f = FRAME.match(line)
+        if f and event is not None:
+            frames.append(f.group(1))
+            continue
+        e = EVENT.match(line)
+        if e:
+            flush()
+            tid = e.group(3) or e.group(2)
+            event, frames = (tid, e.group(4), line[e.end():]), []
+    flush()
+    for stack, n in sorted(folded.items()):
+        out.write('%s %d\n' % (stack, n))
+
+
+def fold_bpftrace(lines, out):
+    """@samples[machine, state, sig, ustack]: count, as bpftrace prints it"""
+    key, frames = None, []
+    for line in lines:
+        line = line.rstrip('\n')
+        m = re.match(r'^@samples\[([^,]*), ([^,]*), (-?\d+),\s*$', line)
+        if m:
+            key, frames = m.groups(), []
+            continue
+        m = re.match(r'^\]: (\d+)$', line)
+        if m and key is not None:
+            out.write('%s;%s;sig %s;%s %s\n' % (key + (';'.join(
+                reversed(frames)), m.group(1))))
+            key = None
+            continue
+        if key is not None and line.strip():
+            frames.append(re.sub(r'\+\d+$', '', line.strip()))
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description=__doc__.split('\n')[0],
+        epilog=__doc__.split('\n', 1)[1],
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('--binary', help='program the probes are in (perf)')
+    ap.add_argument('--bpftrace', metavar='BIN',
+                    help='print a bpftrace program for BIN and exit')
+    ap.add_argument('--from-bpftrace', action='store_true',
+                    help='fold the output of that program')
+    a = ap.parse_args()
+    if a.bpftrace:
+        sys.stdout.write(BPFTRACE % {'bin': a.bpftrace})
+    elif a.from_bpftrace:
+        fold_bpftrace(sys.stdin, sys.stdout)
+    else:
+        fold_perf(sys.stdin, Binary(a.binary) if a.binary else None,
+                  sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
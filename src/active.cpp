@@ -0,0 +1,227 @@
+/** active.cpp -- event queue and active object wrapper implementation
+ */
+#include <string.h>
+#include "active.h"
+#include "hdr.h"
+
+std::atomic<ActiveQueueTimer> Active::queueTimer(0);
+
+/* MsgQueue Ctor............................................................*/
+MsgQueue::MsgQueue(QSlot *sto, unsigned len, unsigned long long *stamps)
+        : ring(sto), stamps(stamps), mask(len - 1), head(0), tail(0)
+{
+    assert(len != 0 && (len & (len - 1)) == 0);      /* power of 2 only */
+    for (unsigned i = 0; i < len; ++i) {
+        ring[i].seq.store(i, std::memory_order_relaxed);
+        ring[i].msg = 0;
+    }
+}
+
+/* post a message, safe to call from any thread.............................*/
+bool MsgQueue::post(Msg const *msg) {
+    unsigned pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        QSlot *slot = &ring[pos & mask];
+        unsigned seq = slot->seq.load(std::memory_order_acquire);
+        int dif = (int)(seq - pos);
+        if (dif == 0) {                           /* slot free this lap */
+            if (tail.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+                slot->msg = msg;
+                if (stamps) {
+                    stamps[pos & mask] =
+                        Active::queueTimer.load(std::memory_order_relaxed)
+                        ? hdrTicks() : 0;
+                }
+                slot->seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (dif < 0) {                   /* consumer one lap behind */
+            return false;
+        }
+        else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/* take the oldest message, 0 if the queue is empty.........................*/
+Msg const *MsgQueue::get(unsigned long long *posted) {
+    unsigned pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        QSlot *slot = &ring[pos & mask];
+        unsigned seq = slot->seq.load(std::memory_order_acquire);
+        int dif = (int)(seq - (pos + 1));
+        if (dif == 0) {                           /* slot holds a message */
+            if (head.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+                Msg const *msg = slot->msg;
+                if (posted) {
+                    *posted = stamps ? stamps[pos & mask] : 0;
+                }
+                slot->seq.store(pos + mask + 1, std::memory_order_release);
+                return msg;
+            }
+        }
+        else if (dif < 0) {                            /* nothing queued */
+            return 0;
+        }
+        else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool MsgQueue::isEmpty() const {
+    unsigned pos = head.load(std::memory_order_relaxed);
+    return (int)(ring[pos & mask].seq.load(std::memory_order_acquire)
+                 - (pos + 1)) < 0;
+}
+
+/* Active Ctor..............................................................*/
+Active::Active(Hsm *h, QSlot *qSto, unsigned qLen,
+               unsigned long long *qStamps)
+        : hsm(h), owed(0), ready(0), queue(qSto, qLen, qStamps)
+{
+    memset(conflated, 0, sizeof(conflated));
+    memset(levels, 0, sizeof(levels));
+    memset(levelOf, 0, sizeof(levelOf));
+}
+
+void Active::conflate(Conflation *c, Event sig, ConflatePolicy policy,
+                      Event mergedSig)
+{
+    assert(0 <= sig && sig < ACTIVE_MAX_CONFLATE && conflated[sig] == 0);
+    c->token.evt = sig;
+    c->policy = (unsigned char)policy;
+    c->merged.evt = mergedSig;
+    conflated[sig] = c;
+}
+
+void Active::addLevel(unsigned char level, MsgQueue *q) {
+    assert(0 < level && level < ACTIVE_MAX_LEVELS && levels[level] == 0);
+    levels[level] = q;
+}
+
+void Active::prioritize(Event sig, unsigned char level) {
+    assert(0 <= sig && sig < ACTIVE_MAX_PRIO);
+    assert(level == 0 || (level < ACTIVE_MAX_LEVELS && levels[level] != 0));
+    levelOf[sig] = level;
+}
+
+/* queue in the ring of the level, then flag the level.....................*/
+bool Active::postLevel_(unsigned char level, Msg const *msg) {
+    if (!levels[level]->post(msg)) {
+        return false;
+    }
+    ready.fetch_or(1u << level);
+    return true;
+}
+
+/* the oldest event of the highest ready level, 0 if no level has one......*/
+Msg const *Active::getLevel_(unsigned long long *posted) {
+    unsigned bits;
+    while ((bits = ready.load(std::memory_order_acquire)) != 0) {
+        unsigned level = 31 - __builtin_clz(bits);
+        Msg const *msg = levels[level]->get(posted);
+        if (msg != 0) {
+            return msg;
+        }
+        ready.fetch_and(~(1u << level));
+        if (!levels[level]->isEmpty()) {       /* posted while clearing */
+            ready.fetch_or(1u << level);
+        }
+    }
+    return 0;
+}
+
+/* update the record, queue a token only for the first post of a burst.....*/
+bool Active::postConflated_(Conflation *c, Msg const *msg) {
+    bool first;
+    switch (c->policy) {
+    case CONFLATE_KEEP_LATEST:
+        first = c->pending.exchange(msg, std::memory_order_acq_rel) == 0;
+        break;
+    case CONFLATE_DROP_DUP: {
+        Msg const *none = 0;
+        first = c->pending.compare_exchange_strong(none, msg,
+                                                 std::memory_order_acq_rel);
+        break;
+    }
+    default:                                       /* CONFLATE_COUNT_MERGE */
+        first = c->count.fetch_add(1, std::memory_order_acq_rel) == 0;
+        break;
+    }
+    if (!first || queue.post(&c->token)) {
+        return true;                     /* merged, or token now queued */
+    }
+    /* Queue full: take a count of 1 back, it is ours alone. A pending
+       pointer cannot be: the same Msg reposted meanwhile would read as
+       ours, and the poster that merged it would lose its event. What is
+       not taken back is owed and dispatched without a token. */
+    if (c->policy == CONFLATE_COUNT_MERGE) {
+        unsigned long one = 1;
+        if (c->count.compare_exchange_strong(one, 0)) {
+            return false;
+        }
+    }
+    owed.fetch_or(1u << msg->evt);
+    return true;
+}
+
+/* the event a token stands for, 0 if there is none any more...............*/
+Msg const *Active::resolve_(Conflation *c) {
+    if (c->policy == CONFLATE_COUNT_MERGE) {
+        c->merged.count = c->count.exchange(0, std::memory_order_acq_rel);
+        return c->merged.count ? &c->merged : 0;
+    }
+    return c->pending.exchange(0, std::memory_order_acq_rel);
+}
+
+/* dispatch queued events run-to-completion, one at a time, the highest
+   level first; a prioritized post overtakes the rest at the next step....*/
+unsigned Active::dispatch(unsigned max) {
+    unsigned n = 0;
+    Msg const *msg;
+    unsigned bits;
+    unsigned long long posted;
+    while (n < max) {
+        if (ready.load(std::memory_order_relaxed) == 0
+            || (msg = getLevel_(&posted)) == 0)       /* no level has one */
+        {
+            if ((bits = owed.load(std::memory_order_relaxed)) != 0) {
+                unsigned bit = bits & -bits;     /* lowest owed signal */
+                if ((owed.fetch_and(~bit, std::memory_order_acquire) & bit)
+                        == 0
+                    || (msg = resolve_(conflated[__builtin_ctz(bit)])) == 0)
+                {
+                    continue;
+                }
+                posted = 0;
+            }
+            else if ((msg = queue.get(&posted)) != 0) {
+                Event e = msg->evt;
+                if ((unsigned)e < ACTIVE_MAX_CONFLATE && conflated[e] != 0
+                    && msg == &conflated[e]->token
+                    && (msg = resolve_(conflated[e])) == 0)
+                {
+                    continue;
+                }
+            }
+            else {
+                break;
+            }
+        }
+        if (posted != 0) {                   /* stamped while hooked */
+            ActiveQueueTimer const timed =
+                queueTimer.load(std::memory_order_acquire);
+            if (timed) {
+                (*timed)(hsm, msg->evt, hdrTicks() - posted);
+            }
+        }
+        hsm->onEvent(msg);
+        ++n;
+    }
+    return n;
+}
@@ -0,0 +1,126 @@
+/** active.h -- event queue and active object wrapper for Hsm machines */
+#ifndef active_h
+#define active_h
+
+#include <assert.h>
+#include <atomic>
+#include "hsm.h"
+
+/* One ring slot. The sequence number tells producers and the consumer
+   whether the slot is free or holds a message for the current lap. */
+struct QSlot {
+    std::atomic<unsigned> seq;
+    Msg const *msg;
+};
+
+/* Bounded lock-free multi-producer queue of Msg pointers. The queue does
+   not own the messages; the poster keeps them alive until dispatched.
+   Storage is supplied by the caller, its length must be a power of 2.
+   The consumer's head and the producers' tail have a cache line each.
+   Optional stamps, one per slot, let Active::queueTimer time the wait
+   of each message; queues without them take no time stamps. */
+class MsgQueue {
+    QSlot *ring;                                          /* slot storage */
+    unsigned long long *stamps;      /* hdrTicks() of each post, or 0 */
+    unsigned mask;                                   /* ring length - 1 */
+    alignas(HSM_CACHE_LINE) std::atomic<unsigned> head;  /* next to consume */
+    alignas(HSM_CACHE_LINE) std::atomic<unsigned> tail;  /* next to produce */
+public:
+    MsgQueue(QSlot *sto, unsigned len, unsigned long long *stamps = 0);
+    bool post(Msg const *msg);           /* any thread, false when full */
+    Msg const *get(unsigned long long *posted = 0); /* consumer, 0: none */
+    bool isEmpty() const;
+};
+
+/* the wait of a message in a stamped queue, post to dispatch, in
+   hdrTicks(); see Active::queueTimer */
+typedef void (*ActiveQueueTimer)(Hsm const *me, Event evt,
+                                 unsigned long long ticks);
+
+#define ACTIVE_MAX_CONFLATE 32          /* conflated signals are < this */
+
+enum ConflatePolicy {
+    CONFLATE_KEEP_LATEST,      /* one pending event, the newest payload */
+    CONFLATE_COUNT_MERGE,   /* one pending CountMsg carrying the N posts */
+    CONFLATE_DROP_DUP                  /* one pending event, the oldest */
+};
+
+/* Conflation of one signal. While an event of the signal is pending, a
+   post only updates this record and the queue holds a single token for
+   it, so a burst costs one dispatch. When the queue is full, the first
+   post of a KEEP_LATEST or DROP_DUP burst is owed instead of refused.
+   Storage is supplied by the caller, see Active::conflate(). */
+class Conflation {
+    Msg token;                          /* stands in the queue for us */
+    unsigned char policy;
+    std::atomic<Msg const *> pending;         /* KEEP_LATEST, DROP_DUP */
+    std::atomic<unsigned long> count;                   /* COUNT_MERGE */
+    CountMsg merged;               /* filled by the consumer on dispatch */
+public:
+    Conflation() : policy(0), pending(0), count(0) {}
+    friend class Active;
+};
+
+#define ACTIVE_MAX_LEVELS 8              /* priority levels, 0 the lowest */
+#define ACTIVE_MAX_PRIO   64           /* prioritized signals are < this */
+
+/* Active object: a machine plus the queue that feeds it. Events are
+   posted from any thread and dispatched run-to-completion by the
+   thread that owns the machine.
+
+   Signals can be given a priority level above 0 with prioritize(); they
+   then go to the ring of that level instead of the main queue (level 0),
+   and dispatch() always takes the next event from the highest level that
+   has one, found in a bitmap. Within a level events keep their order.
+
+   What every post() reads comes first. The counters that posters and the
+   owner both write follow on a cache line of their own, then the queue,
+   whose head and tail have theirs.
+
+   While queueTimer is hooked, like Hsm::timer, posts to queues given
+   stamps are stamped and dispatch() reports each one's wait to it. */
+class Active {
+    Hsm *hsm;                                        /* machine driven */
+    Conflation *conflated[ACTIVE_MAX_CONFLATE];           /* by signal */
+    MsgQueue *levels[ACTIVE_MAX_LEVELS];       /* rings of levels above 0 */
+    unsigned char levelOf[ACTIVE_MAX_PRIO];                  /* by signal */
+    alignas(HSM_CACHE_LINE)
+    std::atomic<unsigned> owed;     /* tokens that found the queue full */
+    std::atomic<unsigned> ready;         /* bit l: levels[l] not empty */
+    MsgQueue queue;                          /* incoming events, level 0 */
+
+    bool postConflated_(Conflation *c, Msg const *msg);
+    Msg const *resolve_(Conflation *c);
+    bool postLevel_(unsigned char level, Msg const *msg);
+    Msg const *getLevel_(unsigned long long *posted);
+public:
+    Active(Hsm *hsm, QSlot *qSto, unsigned qLen,
+           unsigned long long *qStamps = 0);       /* qLen stamps, or 0 */
+    static std::atomic<ActiveQueueTimer> queueTimer;
+    Hsm *getHsm() const { return hsm; }
+    /* conflate signal sig from now on; set up before events are posted.
+       COUNT_MERGE dispatches a CountMsg with signal mergedSig. */
+    void conflate(Conflation *c, Event sig, ConflatePolicy policy,
+                  Event mergedSig);
+    /* the ring of a level, storage supplied by the caller; then the
+       signals of the level. Both before events are posted. */
+    void addLevel(unsigned char level, MsgQueue *q);
+    void prioritize(Event sig, unsigned char level);
+    bool post(Msg const *msg) {
+        Event e = msg->evt;
+        if ((unsigned)e < ACTIVE_MAX_CONFLATE && conflated[e] != 0) {
+            return postConflated_(conflated[e], msg);
+        }
+        if ((unsigned)e < ACTIVE_MAX_PRIO && levelOf[e] != 0) {
+            return postLevel_(levelOf[e], msg);
+        }
+        return queue.post(msg);
+    }
+    unsigned dispatch(unsigned max);      /* run up to max queued events */
+    bool isIdle() const {
+        return queue.isEmpty() && owed.load(std::memory_order_acquire) == 0
+               && ready.load(std::memory_order_acquire) == 0;
+    }
+};
+
+#endif /* active_h */
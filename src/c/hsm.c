@@ -1,6 +1,10 @@
 /** hsm.c -- Hierarchical State Machine implementation
  */
 #include "hsm.h"
+#include "../probe.h"
+#ifdef HSM_LATENCY
+#include "latency.h"
+#endif
 
 static Msg const startMsg = { START_EVT };
 static Msg const entryMsg = { ENTRY_EVT };
@@ -8,22 +12,23 @@ static Msg const exitMsg  = { EXIT_EVT };
 #define MAX_STATE_NESTING 8
 
 /* State Ctor...............................................................*/
-void StateCtor(State *me, char const *name, State *super, EvtHndlr hndlr) {
+HSM_API void StateCtor(State *me, char const *name, State *super, EvtHndlr hndlr) {
     me->name  = name;
     me->super = super;
     me->hndlr = hndlr;
 }
 
 /* Hsm Ctor.................................................................*/
-void HsmCtor(Hsm *me, char const *name, EvtHndlr topHndlr) {
+HSM_API void HsmCtor(Hsm *me, char const *name, EvtHndlr topHndlr) {
     StateCtor(&me->top, "top", 0, topHndlr);
     me->name = name;
 }
 
 /* enter and start the top state............................................*/
-void HsmOnStart(Hsm *me) {
+HSM_API void HsmOnStart(Hsm *me) {
     me->curr = &me->top;
     me->next = 0;
+    HSM_PROBE2(entry, me->name, me->curr->name);
     StateOnEvent(me->curr, me, &entryMsg);
     while (StateOnEvent(me->curr, me, &startMsg), me->next) {
         State *entryPath[MAX_STATE_NESTING];
@@ -34,6 +39,7 @@ void HsmOnStart(Hsm *me) {
             *(++trace) = s;                         /* trace path to target */
         }
         while (s = *trace--) {                 /* retrace entry from source */
+            HSM_PROBE2(entry, me->name, s->name);
             StateOnEvent(s, me, &entryMsg);
         }
         me->curr = me->next;
@@ -42,21 +48,28 @@ void HsmOnStart(Hsm *me) {
 }
 
 /* state machine "engine"...................................................*/
-void HsmOnEvent(Hsm *me, Msg const *msg) {
+HSM_API void HsmOnEvent(Hsm *me, Msg const *msg) {
     State *entryPath[MAX_STATE_NESTING];
     register State **trace;
     register State *s;
+#ifdef HSM_LATENCY
+    Event const evt = msg->evt;
+    unsigned long long const t0 = hdrTicks();
+#endif
+    HSM_PROBE3I(dispatch, me->name, me->curr->name, msg->evt);
     for (s = me->curr; s; s = s->super) {
         me->source = s;                 /* level of outermost event handler */
         msg = StateOnEvent(s, me, msg);
         if (msg == 0) {
             if (me->next) {                      /* state transition taken? */
+                HSM_PROBE3(tran, me->name, me->source->name, me->next->name);
                 trace = entryPath;
                 *trace = 0;
                 for (s = me->next; s != me->curr; s = s->super) {
                     *(++trace) = s;                 /* trace path to target */
                 }
                 while (s = *trace--) {            /* retrace entry from LCA */
+                    HSM_PROBE2(entry, me->name, s->name);
                     StateOnEvent(s, me, &entryMsg);
                 }
                 me->curr = me->next;
@@ -68,6 +81,7 @@ void HsmOnEvent(Hsm *me, Msg const *msg) {
                         *(++trace) = s;            /* record path to target */
                     }
                     while (s = *trace--) {             /* retrace the entry */
+                        HSM_PROBE2(entry, me->name, s->name);
                         StateOnEvent(s, me, &entryMsg);
                     }
                     me->curr = me->next;
@@ -77,16 +91,22 @@ void HsmOnEvent(Hsm *me, Msg const *msg) {
             break;                                       /* event processed */
         }
     }
+#ifdef HSM_LATENCY                      /* source: the handler, or top */
+    LatencyRecord(me->name, me->source->name, evt, hdrTicks() - t0);
+#endif
+    HSM_PROBE3I(done, me->name, me->curr->name, msg == 0);
 }
 
 /* exit current states and all superstates up to LCA .......................*/
-void HsmExit_(Hsm *me, unsigned char toLca) {
+HSM_API void HsmExit_(Hsm *me, unsigned char toLca) {
     register State *s = me->curr;
     while (s != me->source) {
+        HSM_PROBE2(exit, me->name, s->name);
         StateOnEvent(s, me, &exitMsg);
         s = s->super;   
     }
     while (toLca--) {
+        HSM_PROBE2(exit, me->name, s->name);
         StateOnEvent(s, me, &exitMsg);
         s = s->super;
     }
@@ -94,7 +114,7 @@ void HsmExit_(Hsm *me, unsigned char toLca) {
 }
 
 /* find # of levels to Least Common Ancestor................................*/
-unsigned char HsmToLCA_(Hsm *me, State *target) {
+HSM_API unsigned char HsmToLCA_(Hsm *me, State *target) {
     State *s, *t;
     unsigned char toLca = 0;
     if (me->source == target) {
@@ -1,8 +1,21 @@
 /** hsm.h -- Hierarchical State Machine interface
+ *
+ * Build options:
+ * HSM_HEADER_ONLY    -- the engine (hsm.c) is pulled into every includer
+ *                       as static inline functions, don't link hsm.c;
+ *                       the port ships as headers, at the speed of hsm.c
+ * HSM_LATENCY        -- HsmOnEvent() records dispatch latency histograms,
+ *                       see latency.h; link latency.c
  */
 #ifndef hsm_h
 #define hsm_h
 
+#ifdef HSM_HEADER_ONLY
+#define HSM_API static inline
+#else
+#define HSM_API
+#endif
+
 typedef int Event;
 typedef struct {
     Event evt;
@@ -18,7 +31,8 @@ struct State {
     char const *name;
 };
 
-void StateCtor(State *me, char const *name, State *super, EvtHndlr hndlr);
+HSM_API void StateCtor(State *me, char const *name, State *super,
+                       EvtHndlr hndlr);
 #define StateOnEvent(me_, ctx_, msg_) \
     (*(me_)->hndlr)((ctx_), (msg_))
 
@@ -30,13 +44,13 @@ struct Hsm {                       /* Hierarchical State Machine base class */
     State top;                                     /* top-most state object */
 };
 
-void HsmCtor(Hsm *me, char const *name, EvtHndlr topHndlr);
-void HsmOnStart(Hsm *me);                  /* enter and start the top state */
-void HsmOnEvent(Hsm *me, Msg const *msg);                   /* "HSM engine" */
+HSM_API void HsmCtor(Hsm *me, char const *name, EvtHndlr topHndlr);
+HSM_API void HsmOnStart(Hsm *me);          /* enter and start the top state */
+HSM_API void HsmOnEvent(Hsm *me, Msg const *msg);           /* "HSM engine" */
 
 /* protected: */
-unsigned char HsmToLCA_(Hsm *me, State *target);
-void HsmExit_(Hsm *me, unsigned char toLca);
+HSM_API unsigned char HsmToLCA_(Hsm *me, State *target);
+HSM_API void HsmExit_(Hsm *me, unsigned char toLca);
                                                        /* get current state */
 #define STATE_CURR(me_) (((Hsm *)me_)->curr)
                      /* take start transition (no states need to be exited) */
@@ -55,4 +69,8 @@ void HsmExit_(Hsm *me, unsigned char toLca);
 #define ENTRY_EVT ((Event)(-2))
 #define EXIT_EVT  ((Event)(-3))
 
+#ifdef HSM_HEADER_ONLY
+#include "hsm.c"                     /* the engine itself, static inline */
+#endif
+
 #endif /* hsm_h */
@@ -0,0 +1,217 @@
+/** latency.c -- dispatch latency histograms for the C engine
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#undef HSM_HEADER_ONLY                   /* the types, not the engine */
+#include "hsm.h"
+#include "latency.h"
+
+typedef struct {               /* one series of one thread, that thread's */
+    unsigned long long n[HDR_BUCKETS];
+    unsigned long long sum;
+} LatHist;
+
+typedef struct {                             /* a slot of the series table */
+    int kind;                      /* LatencyKind + 1 once claimed, 0 free */
+    char const *machine;
+    size_t what;                            /* signal, or the state name */
+    LatHist *hist;
+} LatKey;
+
+typedef struct {        /* (machine, state, signal) to its two series */
+    char const *machine, *state;
+    Event evt;
+    LatHist *sig, *st;
+} LatRoute;
+
+#define LAT_ROUTES 64                   /* direct mapped, power of 2 */
+
+typedef struct LatBuf LatBuf;
+struct LatBuf {                           /* series table of one thread */
+    LatBuf *next;                                     /* all tables, ever */
+    LatKey key[LATENCY_MAX_KEYS];
+    LatRoute route[LAT_ROUTES];      /* spares LatencyRecord() a lookup */
+};
+
+static LatBuf *bufs;
+static _Thread_local LatBuf *myBuf;
+static unsigned long nDropped;
+static double nsPerTick;                /* set by the first snapshot */
+
+static LatBuf *threadBuf(void) {
+    LatBuf *b = calloc(1, sizeof(LatBuf));
+    assert(b != 0);
+    b->next = __atomic_load_n(&bufs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&bufs, &b->next, b, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    return b;
+}
+
+/* series (kind, machine, what) of this thread, claimed on first use.......*/
+static LatHist *find(LatBuf *b, int kind, char const *machine, size_t what) {
+    size_t x = ((size_t)machine ^ (what << 2 | (size_t)kind))
+               * 0x9E3779B97F4A7C15ULL;
+    unsigned i = (unsigned)(x >> 32), probe;
+    for (probe = 0; probe < LATENCY_MAX_KEYS; ++probe, ++i) {
+        LatKey *k = &b->key[i & (LATENCY_MAX_KEYS - 1)];
+        int t = k->kind;                                      /* ours alone */
+        if (t == kind + 1 && k->machine == machine && k->what == what) {
+            return k->hist;
+        }
+        if (t == 0) {
+            k->machine = machine;
+            k->what = what;
+            k->hist = calloc(1, sizeof(LatHist));
+            assert(k->hist != 0);
+            __atomic_store_n(&k->kind, kind + 1, __ATOMIC_RELEASE);
+            return k->hist;
+        }
+    }
+    __atomic_fetch_add(&nDropped, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void add(LatHist *h, unsigned i, unsigned long long ticks) {
+    if (h) {                      /* a single writer: no read-modify-write */
+        __atomic_store_n(&h->n[i], h->n[i] + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->sum, h->sum + ticks, __ATOMIC_RELAXED);
+    }
+}
+
+/* hot path: one route lookup and two bucket increments...................*/
+void LatencyRecord(char const *machine, char const *state, Event evt,
+                   unsigned long long ticks)
+{
+    LatBuf *b = myBuf;
+    LatRoute *r;
+    unsigned i = hdrIndex(ticks);
+    if (b == 0) {
+        b = myBuf = threadBuf();
+    }
+    r = &b->route[((size_t)state >> 3 ^ (size_t)(unsigned)evt)
+                  & (LAT_ROUTES - 1)];
+    if (r->state != state || r->evt != evt || r->machine != machine) {
+        r->sig = find(b, LATENCY_SIGNAL, machine, (size_t)(unsigned)evt);
+        r->st = find(b, LATENCY_STATE, machine, (size_t)state);
+        r->machine = machine;             /* a full table is retried next */
+        r->state = r->sig && r->st ? state : 0;
+        r->evt = evt;
+    }
+    add(r->sig, i, ticks);
+    add(r->st, i, ticks);
+}
+
+static int cmpSeries(void const *pa, void const *pb) {
+    LatencySeries const *a = pa, *b = pb;
+    int c;
+    if (a->kind != b->kind) {
+        return a->kind - b->kind;
+    }
+    if ((c = strcmp(a->machine, b->machine)) != 0) {
+        return c;
+    }
+    return a->kind == LATENCY_STATE ? strcmp(a->state, b->state)
+                                    : (a->evt > b->evt) - (a->evt < b->evt);
+}
+
+/* merge the series of all threads, ordered by kind, machine and key.......*/
+unsigned LatencySnapshot(LatencySeries *out, unsigned max) {
+    unsigned n = 0, i, j, m;
+    LatBuf *b;
+    if (nsPerTick == 0.0) {
+        nsPerTick = hdrNsPerTick(10);
+    }
+    for (b = __atomic_load_n(&bufs, __ATOMIC_ACQUIRE); b; b = b->next) {
+        for (i = 0; i < LATENCY_MAX_KEYS; ++i) {
+            LatKey const *k = &b->key[i];
+            int t = __atomic_load_n(&k->kind, __ATOMIC_ACQUIRE);
+            LatencySeries *s;
+            if (t == 0) {
+                continue;
+            }
+            for (j = 0; j < n; ++j) {
+                s = &out[j];
+                if (s->kind == t - 1 && s->machine == k->machine
+                    && (t - 1 == LATENCY_STATE
+                        ? (size_t)s->state == k->what
+                        : (size_t)(unsigned)s->evt == k->what))
+                {
+                    break;
+                }
+            }
+            if (j == n) {                                 /* a new series */
+                if (n == max) {
+                    continue;
+                }
+                s = &out[n++];
+                memset(s, 0, sizeof(*s));
+                s->kind = t - 1;
+                s->machine = k->machine;
+                if (s->kind == LATENCY_STATE) {
+                    s->state = (char const *)k->what;
+                }
+                else {
+                    s->evt = (Event)(unsigned)k->what;
+                }
+            }
+            s = &out[j];
+            for (m = 0; m < HDR_BUCKETS; ++m) {
+                unsigned long long c =
+                    __atomic_load_n(&k->hist->n[m], __ATOMIC_RELAXED);
+                s->bucket[m] += c;
+                s->count += c;
+            }
+            s->sum += __atomic_load_n(&k->hist->sum, __ATOMIC_RELAXED);
+        }
+    }
+    qsort(out, n, sizeof(out[0]), &cmpSeries);
+    return n;
+}
+
+double LatencyPercentile(LatencySeries const *s, double q) {
+    return (double)hdrPercentile(s->bucket, s->count, q) * nsPerTick;
+}
+
+unsigned long LatencyDropped(void) {
+    return __atomic_load_n(&nDropped, __ATOMIC_RELAXED);
+}
+
+void LatencyDump(FILE *out, int csv) {
+    static char const *const kinds[] = { "signal", "state" };
+    static double const qs[] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+    enum { MAX_SERIES = 2 * LATENCY_MAX_KEYS };
+    LatencySeries *all = malloc(MAX_SERIES * sizeof(LatencySeries));
+    unsigned n, i, j;
+    assert(all != 0);
+    n = LatencySnapshot(all, MAX_SERIES);
+    if (csv) {
+        fprintf(out, "kind,machine,key,count,mean_ns,p50_ns,p90_ns,p99_ns,"
+                     "p99.9_ns,max_ns\n");
+    }
+    else {
+        fprintf(out, "%-6s %-12s %-14s %10s %9s %9s %9s %9s %9s %9s\n",
+                "kind", "machine", "key", "count", "mean", "p50", "p90",
+                "p99", "p99.9", "max ns");
+    }
+    for (i = 0; i < n; ++i) {
+        LatencySeries const *s = &all[i];
+        char num[16];
+        char const *key = s->state;
+        double mean = s->count ? (double)s->sum / s->count * nsPerTick : 0;
+        if (s->kind == LATENCY_SIGNAL) {
+            snprintf(num, sizeof(num), "%d", s->evt);
+            key = num;
+        }
+        fprintf(out, csv ? "%s,%s,%s,%llu,%.1f"
+                         : "%-6s %-12s %-14s %10llu %9.1f",
+                kinds[s->kind], s->machine, key, s->count, mean);
+        for (j = 0; j < sizeof(qs) / sizeof(qs[0]); ++j) {
+            fprintf(out, csv ? ",%.0f" : " %9.0f",
+                    LatencyPercentile(s, qs[j]));
+        }
+        fputc('\n', out);
+    }
+    free(all);
+}
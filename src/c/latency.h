@@ -0,0 +1,38 @@
+/** latency.h -- dispatch latency histograms for the C engine
+ *
+ * Built with HSM_LATENCY, HsmOnEvent() times every dispatch with
+ * hdrTicks() and records it under its signal and under the state whose
+ * handler took it (top for unhandled events), keyed by machine name. Each
+ * thread records into HDR histograms of its own (see ../hdr.h) without
+ * locks; LatencySnapshot() merges all threads, LatencyDump() prints a
+ * table or CSV. Tables of exited threads are kept and still merged.
+ * Link latency.c when HSM_LATENCY is defined. Include hsm.h first: with
+ * HSM_HEADER_ONLY the engine pulls this header in from inside hsm.h.
+ */
+#ifndef latency_h
+#define latency_h
+
+#include <stdio.h>
+#include "../hdr.h"
+
+#define LATENCY_MAX_KEYS 256           /* series per thread, power of 2 */
+
+enum LatencyKind { LATENCY_SIGNAL, LATENCY_STATE };
+
+typedef struct {                                /* one merged histogram */
+    int kind;
+    char const *machine;
+    char const *state;                               /* LATENCY_STATE only */
+    Event evt;                                     /* LATENCY_SIGNAL only */
+    unsigned long long count, sum;                       /* sum in ticks */
+    unsigned long long bucket[HDR_BUCKETS];
+} LatencySeries;
+
+void LatencyRecord(char const *machine, char const *state, Event evt,
+                   unsigned long long ticks);
+unsigned LatencySnapshot(LatencySeries *out, unsigned max); /* # series */
+double LatencyPercentile(LatencySeries const *s, double q);          /* ns */
+void LatencyDump(FILE *out, int csv);
+unsigned long LatencyDropped(void);      /* records with no free series */
+
+#endif /* latency_h */
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include "hsm.h"
+#include "log.h"
 
 class HsmTest : public Hsm {
     int myFoo;
@@ -36,17 +37,17 @@ enum HsmTestEvents {
 Msg const *HsmTest::topHndlr(Msg const *msg) {
     switch (msg->evt) {
     case START_EVT:
-        printf("top-INIT;");
+        LOG("top-INIT;");
         STATE_START(&s1);
         return 0;
     case ENTRY_EVT:
-        printf("top-ENTRY;");
+        LOG("top-ENTRY;");
         return 0;
     case EXIT_EVT:
-        printf("top-EXIT;");
+        LOG("top-EXIT;");
         return 0;
     case E_SIG:
-        printf("top-E;");
+        LOG("top-E;");
         STATE_TRAN(&s211);
         return 0;
     } 
@@ -56,33 +57,33 @@ Msg const *HsmTest::topHndlr(Msg const *msg) {
 Msg const *HsmTest::s1Hndlr(Msg const *msg) {
     switch (msg->evt) {
     case START_EVT:
-        printf("s1-INIT;");
+        LOG("s1-INIT;");
         STATE_START(&s11);
         return 0;
     case ENTRY_EVT:
-        printf("s1-ENTRY;");
+        LOG("s1-ENTRY;");
         return 0;
     case EXIT_EVT:
-        printf("s1-EXIT;");
+        LOG("s1-EXIT;");
         return 0;
     case A_SIG:
-        printf("s1-A;");
+        LOG("s1-A;");
         STATE_TRAN(&s1);
         return 0;
     case B_SIG:
-        printf("s1-B;");
+        LOG("s1-B;");
         STATE_TRAN(&s11);
         return 0;
     case C_SIG:
-        printf("s1-C;");
+        LOG("s1-C;");
         STATE_TRAN(&s2);
         return 0;
     case D_SIG:
-        printf("s1-D;");
+        LOG("s1-D;");
         STATE_TRAN(&top);
         return 0;
     case F_SIG:
-        printf("s1-F;");
+        LOG("s1-F;");
         STATE_TRAN(&s211);
         return 0;
     } 
@@ -92,18 +93,18 @@ Msg const *HsmTest::s1Hndlr(Msg const *msg) {
 Msg const *HsmTest::s11Hndlr(Msg const *msg) {
     switch (msg->evt) {
     case ENTRY_EVT:
-        printf("s11-ENTRY;");
+        LOG("s11-ENTRY;");
         return 0;
     case EXIT_EVT:
-        printf("s11-EXIT;");
+        LOG("s11-EXIT;");
         return 0;
     case G_SIG:
-        printf("s11-G;");
+        LOG("s11-G;");
         STATE_TRAN(&s211);
         return 0;
     case H_SIG:
         if (myFoo) {
-            printf("s11-H;");
+            LOG("s11-H;");
             myFoo = 0;
             return 0;
         }
@@ -115,21 +116,21 @@ Msg const *HsmTest::s11Hndlr(Msg const *msg) {
 Msg const *HsmTest::s2Hndlr(Msg const *msg) {
     switch (msg->evt) {
     case START_EVT:
-        printf("s2-INIT;");
+        LOG("s2-INIT;");
         STATE_START(&s21);
         return 0;
     case ENTRY_EVT:
-        printf("s2-ENTRY;");
+        LOG("s2-ENTRY;");
         return 0;
     case EXIT_EVT:
-        printf("s2-EXIT;");
+        LOG("s2-EXIT;");
         return 0;
     case C_SIG:
-        printf("s2-C;");
+        LOG("s2-C;");
         STATE_TRAN(&s1);
         return 0;
     case F_SIG:
-        printf("s2-F;");
+        LOG("s2-F;");
         STATE_TRAN(&s11);
         return 0;
     } 
@@ -139,22 +140,22 @@ Msg const *HsmTest::s2Hndlr(Msg const *msg) {
 Msg const *HsmTest::s21Hndlr(Msg const *msg) {
     switch (msg->evt) {
     case START_EVT:
-        printf("s21-INIT;");
+        LOG("s21-INIT;");
         STATE_START(&s211);
         return 0;
     case ENTRY_EVT:
-        printf("s21-ENTRY;");
+        LOG("s21-ENTRY;");
         return 0;
     case EXIT_EVT:
-        printf("s21-EXIT;");
+        LOG("s21-EXIT;");
         return 0;
     case B_SIG:
-        printf("s21-B;");
+        LOG("s21-B;");
         STATE_TRAN(&s211);
         return 0;
     case H_SIG:
         if (!myFoo) {
-            printf("s21-H;");
+            LOG("s21-H;");
             myFoo = 1;
             STATE_TRAN(&s21);
             return 0;
@@ -167,17 +168,17 @@ Msg const *HsmTest::s21Hndlr(Msg const *msg) {
 Msg const *HsmTest::s211Hndlr(Msg const *msg) {
     switch (msg->evt) {
     case ENTRY_EVT:
-        printf("s211-ENTRY;");
+        LOG("s211-ENTRY;");
         return 0;
     case EXIT_EVT:
-        printf("s211-EXIT;");
+        LOG("s211-EXIT;");
         return 0;
     case D_SIG:
-        printf("s211-D;");
+        LOG("s211-D;");
         STATE_TRAN(&s21);
         return 0;
     case G_SIG:
-        printf("s211-G;");
+        LOG("s211-G;");
         STATE_TRAN(&top);
         return 0;
     } 
@@ -185,7 +186,7 @@ Msg const *HsmTest::s211Hndlr(Msg const *msg) {
 }
 
 HsmTest::HsmTest()
-: Hsm("HsmTest", (EvtHndlr)topHndlr),
+: Hsm("HsmTest", (EvtHndlr)&HsmTest::topHndlr),
     s1("s1", &top, (EvtHndlr)&HsmTest::s1Hndlr),
     s11("s11", &s1, (EvtHndlr)&HsmTest::s11Hndlr),
     s2("s2", &top, (EvtHndlr)&HsmTest::s2Hndlr),
@@ -206,11 +207,14 @@ const Msg HsmTestMsg[] = {
 
 int main() {
     HsmTest hsmTest;
+    Log::start(stdout);
     hsmTest.onStart();
+    Log::flush();
 
     printf("\n\nEvent IDs are: ascii code, except of a or h\n");
     for (;;) {
         char c;
+        Log::flush();
         printf("\nEvent<-");
         c = getc(stdin);
         getc(stdin);
@@ -220,5 +224,6 @@ int main() {
         }
         hsmTest.onEvent(&HsmTestMsg[c - 'a']);
     }
+    Log::stop();
     return 0;
 }
@@ -0,0 +1,136 @@
+/** epoch.cpp -- epoch-based reclamation implementation
+ */
+#include <assert.h>
+#include <sched.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "epoch.h"
+
+struct EpochRec {                          /* what one thread is reading */
+    std::atomic<bool> owned;                  /* a live thread uses this */
+    EpochRec *next;                                  /* all records, ever */
+    std::atomic<unsigned long> at;     /* epoch entered, 0: outside guards */
+    unsigned depth;                                /* nested guards, ours */
+};
+
+struct EpochOwner {     /* hands the record back when its thread exits */
+    EpochRec *rec;
+    ~EpochOwner() {
+        if (rec) {
+            rec->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+struct Retired {
+    void *p;
+    EpochFree fn;
+    void *ctx;
+};
+
+static std::atomic<EpochRec *> recs(0);
+static thread_local EpochOwner mine;
+static std::atomic<unsigned long> global(1);
+static std::mutex limboLock;        /* retirements and advances, both rare */
+static std::vector<Retired> limbo[3];          /* by epoch of retirement */
+static unsigned long nPending, sinceAdvance;
+
+/* record of the calling thread, recycled from exited threads if possible..*/
+static EpochRec *threadRec() {
+    for (EpochRec *r = recs.load(std::memory_order_acquire); r; r = r->next) {
+        bool free = false;
+        if (r->owned.compare_exchange_strong(free, true,
+                                             std::memory_order_acquire)) {
+            return r;                          /* left every guard: at 0 */
+        }
+    }
+    EpochRec *r = new EpochRec();
+    r->owned.store(true, std::memory_order_relaxed);
+    r->at.store(0, std::memory_order_relaxed);
+    r->depth = 0;
+    r->next = recs.load(std::memory_order_relaxed);
+    while (!recs.compare_exchange_weak(r->next, r,
+                                       std::memory_order_release)) {
+    }
+    return r;
+}
+
+void Epoch::enter() {
+    EpochRec *r = mine.rec;
+    if (r == 0) {
+        r = mine.rec = threadRec();
+    }
+    if (r->depth++ == 0) {           /* seq_cst: published before we read */
+        r->at.store(global.load(std::memory_order_relaxed));
+    }
+}
+
+void Epoch::leave() {
+    EpochRec *r = mine.rec;
+    assert(r != 0 && r->depth != 0);
+    if (--r->depth == 0) {
+        r->at.store(0, std::memory_order_release);
+    }
+}
+
+/* with limboLock held: hands out what was retired two epochs back.......*/
+static bool advanceLocked(std::vector<Retired> *free) {
+    unsigned long e = global.load();
+    for (EpochRec *r = recs.load(std::memory_order_acquire); r; r = r->next) {
+        unsigned long at = r->at.load();
+        if (at != 0 && at != e) {
+            return false;                       /* still in an older epoch */
+        }
+    }
+    free->swap(limbo[(e + 2) % 3]);                     /* retired in e - 1 */
+    nPending -= free->size();
+    global.store(e + 1);
+    sinceAdvance = 0;
+    return true;
+}
+
+static void release(std::vector<Retired> const &free) {  /* lock not held */
+    for (Retired const &x : free) {
+        (*x.fn)(x.p, x.ctx);
+    }
+}
+
+void Epoch::retire(void *p, EpochFree fn, void *ctx) {
+    std::vector<Retired> free;
+    {
+        std::lock_guard<std::mutex> lock(limboLock);
+        limbo[global.load() % 3].push_back(Retired{ p, fn, ctx });
+        ++nPending;
+        if (++sinceAdvance >= EPOCH_BATCH) {
+            advanceLocked(&free);
+        }
+    }
+    release(free);
+}
+
+bool Epoch::advance() {
+    std::vector<Retired> free;
+    bool moved;
+    {
+        std::lock_guard<std::mutex> lock(limboLock);
+        moved = advanceLocked(&free);
+    }
+    release(free);
+    return moved;
+}
+
+void Epoch::barrier() {
+    assert(mine.rec == 0 || mine.rec->depth == 0);
+    unsigned long until = global.load() + 2;
+    while (global.load() < until) {
+        if (!advance()) {
+            sched_yield();
+        }
+    }
+}
+
+unsigned long Epoch::pending() {
+    std::lock_guard<std::mutex> lock(limboLock);
+    return nPending;
+}
@@ -0,0 +1,39 @@
+/** epoch.h -- epoch-based reclamation for lock-free readers
+ *
+ * Readers bracket every access to shared data they read without a lock
+ * with an EpochGuard. Writers unlink an object, then hand it to retire()
+ * instead of freeing it; it is freed once every thread that was inside a
+ * guard at that time has left it, two epoch advances later. Entering and
+ * leaving a guard only writes a record owned by the calling thread, so
+ * readers never contend with each other. Guards nest.
+ *
+ * The epoch advances from retire() every EPOCH_BATCH retirements and from
+ * advance(); a thread that stays inside a guard holds it back, so guards
+ * should be short. Records of exited threads are reused, as in log.cpp.
+ */
+#ifndef epoch_h
+#define epoch_h
+
+#define EPOCH_BATCH 64        /* retirements between attempts to advance */
+
+typedef void (*EpochFree)(void *p, void *ctx);
+
+class Epoch {
+public:
+    static void enter();
+    static void leave();
+    static void retire(void *p, EpochFree fn, void *ctx);  /* any thread */
+    static bool advance();         /* move on if possible, free what's safe */
+    static void barrier();  /* free all retired so far, not inside a guard */
+    static unsigned long pending();             /* retired, not yet freed */
+};
+
+class EpochGuard {                  /* the scope reads shared structures */
+public:
+    EpochGuard() { Epoch::enter(); }
+    ~EpochGuard() { Epoch::leave(); }
+    EpochGuard(EpochGuard const &) = delete;
+    EpochGuard &operator=(EpochGuard const &) = delete;
+};
+
+#endif /* epoch_h */
@@ -0,0 +1,353 @@
+/** explore.cpp -- exhaustive state-space explorer implementation
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include "explore.h"
+
+#define CHUNK      256                   /* snapshots claimed at a time */
+#define DFS_LOCAL  4096         /* depth-first stack kept by each worker */
+
+struct Explorer::Stats {
+    unsigned long handled[EXPLORE_MAX_STATES][EXPLORE_MAX_EVENTS];
+    unsigned long unhandled[EXPLORE_MAX_STATES][EXPLORE_MAX_EVENTS];
+    unsigned long current[EXPLORE_MAX_STATES];
+};
+
+struct Explorer::Level {                  /* one BFS level being expanded */
+    unsigned char const *keys;
+    unsigned long n;
+    std::atomic<unsigned long> cursor;
+    bool depthFirst;
+};
+
+/* the full 64-bit finalizer of MurmurHash3: every bit of x moves every
+   bit of the result, one multiply and shift alone leave the low bits of
+   a word to the low bits of the hash */
+static unsigned long long mix(unsigned long long x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static unsigned long long hashKey(unsigned char const *k, unsigned n) {
+    unsigned long long h = 0x9E3779B97F4A7C15ull ^ n;
+    unsigned long long v;
+    unsigned i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&v, k + i, 8);
+        h = mix(h ^ v);
+    }
+    for (v = 0; i < n; ++i) {
+        v = (v << 8) | k[i];
+    }
+    h = mix(h ^ v);
+    return h ? h : 1;                             /* 0 marks a free slot */
+}
+
+static double seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Explorer Ctor............................................................*/
+Explorer::Explorer(Factory m, Destroyer d, Msg const *const *evts,
+                   unsigned n)
+        : make(m), destroy(d), proto(m()), snap(proto), nEvents(n),
+          nExpects(0),
+          visited(0), mask(0), nStates(0), nDispatch(0), full(false),
+          nStateIdx(0), stats(0), depth(0), elapsed(0)
+{
+    assert(n <= EXPLORE_MAX_EVENTS);
+    for (unsigned i = 0; i < n; ++i) {
+        events[i] = evts[i];
+    }
+    for (unsigned i = 0; i < EXPLORE_MAX_OFFSET + EXPLORE_MAX_STATES; ++i) {
+        stateOf[i].store(-1, std::memory_order_relaxed);
+    }
+    proto->onStart();                      /* initial configuration */
+}
+
+Explorer::~Explorer() {
+    free(visited);
+    delete stats;
+    destroy(proto);
+}
+
+/* register extended state the machine's behavior depends on................*/
+void Explorer::reg(void const *field, unsigned size) {
+    snap.reg(field, size);
+    assert(snap.size() <= EXPLORE_MAX_KEY);
+}
+
+void Explorer::regState(State const *const *slot) {
+    snap.regState(slot);
+    assert(snap.size() <= EXPLORE_MAX_KEY);
+}
+
+void Explorer::regPeriodic(unsigned const *field, unsigned base,
+                           unsigned period)
+{
+    snap.regPeriodic(field, base, period);
+    assert(snap.size() <= EXPLORE_MAX_KEY);
+}
+
+void Explorer::expect(State const *from, Event evt, State const *to) {
+    assert(nExpects < EXPLORE_MAX_EXPECT);
+    expects[nExpects].from = from;
+    expects[nExpects].evt = evt;
+    expects[nExpects].to = to;
+    expects[nExpects].taken.store(false);
+    ++nExpects;
+}
+
+/* dense index of a State, assigned on first sight..........................*/
+int Explorer::stateIdx_(unsigned short off) {
+    unsigned at = off < SNAP_MAX_OFFSET ? off       /* constant ones last */
+                  : EXPLORE_MAX_OFFSET + (off - SNAP_MAX_OFFSET);
+    assert(off < SNAP_MAX_OFFSET ? off < EXPLORE_MAX_OFFSET
+           : at < EXPLORE_MAX_OFFSET + EXPLORE_MAX_STATES);
+    int idx = stateOf[at].load(std::memory_order_acquire);
+    if (idx < 0) {
+        std::lock_guard<std::mutex> lock(stateLock);
+        idx = stateOf[at].load(std::memory_order_relaxed);
+        if (idx < 0) {
+            idx = (int)nStateIdx.load();
+            assert(idx < EXPLORE_MAX_STATES);
+            stateOff[idx] = off;
+            nStateIdx.store(idx + 1);
+            stateOf[at].store(idx, std::memory_order_release);
+        }
+    }
+    return idx;
+}
+
+/* add a snapshot to the visited set, true if it was not there yet..........*/
+bool Explorer::insert_(unsigned char const *key) {
+    unsigned long long h = hashKey(key, snap.size());
+    unsigned long long i = h & mask;
+    for (;;) {
+        unsigned long long v = visited[i].load(std::memory_order_relaxed);
+        if (v == h) {
+            return false;
+        }
+        if (v == 0) {
+            if (visited[i].compare_exchange_strong(v, h,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+            if (v == h) {
+                return false;
+            }
+            continue;                         /* lost the slot, look again */
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/* is the State at offset `off` of m nested in (or equal to) s of proto?....*/
+bool Explorer::within_(Hsm *m, State const *s, unsigned short off) const {
+    unsigned short target = snap.offsetOf(proto, s);
+    for (State const *t = snap.stateAt(m, off); t; t = t->getSuper()) {
+        if (snap.offsetOf(m, t) == target) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* dispatch every event to one snapshot, collect unseen successors..........*/
+void Explorer::expand_(Hsm *m, unsigned char const *key, Stats *st,
+                       unsigned char *out, unsigned *nOut)
+{
+    unsigned short currOff;
+    memcpy(&currOff, key, 2);
+    int currIdx = stateIdx_(currOff);
+    *nOut = 0;
+    for (unsigned e = 0; e < nEvents; ++e) {
+        snap.decode(m, key);
+        if (m->onEvent(events[e]) != 0) {
+            ++st->unhandled[currIdx][e];
+        }
+        else {
+            unsigned short srcOff = snap.offsetOf(m, m->source);
+            int srcIdx = stateIdx_(srcOff);
+            ++st->handled[srcIdx][e];
+            for (unsigned x = 0; x < nExpects; ++x) {
+                Expect *ex = &expects[x];
+                if (ex->evt == events[e]->evt
+                    && snap.offsetOf(proto, ex->from) == srcOff
+                    && !ex->taken.load(std::memory_order_relaxed)
+                    && within_(m, ex->to, snap.offsetOf(m, m->curr)))
+                {
+                    ex->taken.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+        unsigned char *k = out + *nOut * snap.size();
+        snap.encode(m, k);
+        if (full.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        if (insert_(k)) {
+            unsigned short off;
+            memcpy(&off, k, 2);
+            ++st->current[stateIdx_(off)];
+            if (nStates.fetch_add(1, std::memory_order_relaxed) + 1
+                >= (mask + 1) / 2)
+            {
+                full.store(true);              /* keep the table half empty */
+            }
+            ++*nOut;
+        }
+    }
+    nDispatch.fetch_add(nEvents, std::memory_order_relaxed);
+}
+
+void Explorer::worker_(Level *lv, Stats *st,
+                       std::vector<unsigned char> *next)
+{
+    Hsm *m = make();
+    unsigned const keyLen = snap.size();
+    std::vector<unsigned char> stack;
+    unsigned char succ[EXPLORE_MAX_EVENTS * EXPLORE_MAX_KEY];
+    unsigned char key[EXPLORE_MAX_KEY];
+    unsigned long from = 0, to = 0;                /* claimed chunk */
+    for (;;) {
+        if (lv->depthFirst && !stack.empty()) {
+            memcpy(key, &stack[stack.size() - keyLen], keyLen);
+            stack.resize(stack.size() - keyLen);
+        }
+        else {
+            if (from == to) {
+                from = lv->cursor.fetch_add(CHUNK);
+                if (from >= lv->n) {
+                    break;
+                }
+                to = from + CHUNK < lv->n ? from + CHUNK : lv->n;
+            }
+            memcpy(key, lv->keys + from * keyLen, keyLen);
+            ++from;
+        }
+        unsigned n;
+        expand_(m, key, st, succ, &n);
+        for (unsigned i = 0; i < n; ++i) {
+            unsigned char const *k = succ + i * keyLen;
+            if (lv->depthFirst && stack.size() < DFS_LOCAL * keyLen) {
+                stack.insert(stack.end(), k, k + keyLen);
+            }
+            else {
+                next->insert(next->end(), k, k + keyLen);
+            }
+        }
+    }
+    destroy(m);
+}
+
+/* explore everything reachable from the started prototype..................*/
+bool Explorer::run(unsigned nWorkers, unsigned long maxStates,
+                   bool depthFirst)
+{
+    assert(nWorkers > 0);
+    unsigned long long size = 1024;
+    while (size < 2 * (unsigned long long)maxStates) {
+        size <<= 1;
+    }
+    free(visited);                       /* calloc: lazily zeroed pages */
+    visited = (std::atomic<unsigned long long> *)calloc(size,
+                                                        sizeof(*visited));
+    if (visited == 0) {
+        return false;
+    }
+    mask = size - 1;
+    nStates.store(0);
+    nDispatch.store(0);
+    full.store(false);
+    delete stats;
+    stats = new Stats();
+    Stats *local = new Stats[nWorkers]();
+    std::vector<unsigned char> *next = new std::vector<unsigned char>[nWorkers];
+
+    double t0 = seconds();
+    std::vector<unsigned char> frontier(snap.size());
+    snap.encode(proto, &frontier[0]);
+    insert_(&frontier[0]);
+    nStates.store(1);
+    unsigned short off;
+    memcpy(&off, &frontier[0], 2);
+    ++local[0].current[stateIdx_(off)];
+
+    for (depth = 0; !frontier.empty(); ++depth) {
+        Level lv;
+        lv.keys = &frontier[0];
+        lv.n = frontier.size() / snap.size();
+        lv.cursor.store(0);
+        lv.depthFirst = depthFirst;
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < nWorkers; ++w) {
+            next[w].clear();
+            threads.push_back(std::thread(&Explorer::worker_, this, &lv,
+                                          &local[w], &next[w]));
+        }
+        for (unsigned w = 0; w < nWorkers; ++w) {
+            threads[w].join();
+        }
+        frontier.clear();
+        for (unsigned w = 0; w < nWorkers; ++w) {
+            frontier.insert(frontier.end(), next[w].begin(), next[w].end());
+        }
+    }
+    elapsed = seconds() - t0;
+
+    for (unsigned w = 0; w < nWorkers; ++w) {       /* merge statistics */
+        for (unsigned s = 0; s < EXPLORE_MAX_STATES; ++s) {
+            stats->current[s] += local[w].current[s];
+            for (unsigned e = 0; e < EXPLORE_MAX_EVENTS; ++e) {
+                stats->handled[s][e] += local[w].handled[s][e];
+                stats->unhandled[s][e] += local[w].unhandled[s][e];
+            }
+        }
+    }
+    delete[] local;
+    delete[] next;
+    return !full.load();
+}
+
+/* reachable states, handled/unhandled events, transitions never taken......*/
+void Explorer::report(FILE *out) {
+    fprintf(out, "%s: %lu snapshots%s, %lu dispatches, depth %u, %.2fs\n",
+            proto->name, nStates.load(),
+            full.load() ? " (table full, truncated)" : "",
+            nDispatch.load(), depth, elapsed);
+    fprintf(out, "%-12s %12s  %-24s %s\n", "state", "current",
+            "handles", "unhandled while current");
+    for (unsigned s = 0; s < nStateIdx.load(); ++s) {
+        State const *st = snap.stateAt(proto, stateOff[s]);
+        char handles[128] = "", unhandled[128] = "";
+        for (unsigned e = 0; e < nEvents; ++e) {
+            char num[16];
+            snprintf(num, sizeof(num), "%d ", events[e]->evt);
+            if (stats->handled[s][e]) {
+                strncat(handles, num, sizeof(handles) - strlen(handles) - 1);
+            }
+            if (stats->unhandled[s][e]) {
+                strncat(unhandled, num,
+                        sizeof(unhandled) - strlen(unhandled) - 1);
+            }
+        }
+        fprintf(out, "%-12s %12lu  %-24s %s\n", proto->getStateName(st),
+                stats->current[s], handles, unhandled);
+    }
+    for (unsigned x = 0; x < nExpects; ++x) {
+        if (!expects[x].taken.load()) {
+            fprintf(out, "never taken: %s --%d--> %s\n",
+                    proto->getStateName(expects[x].from), expects[x].evt,
+                    proto->getStateName(expects[x].to));
+        }
+    }
+}
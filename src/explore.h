@@ -0,0 +1,99 @@
+/** explore.h -- exhaustive state-space explorer for Hsm machines
+ *
+ * The explorer snapshots a machine as its current state plus whatever
+ * extended state was registered with reg()/regState() (see snapshot.h),
+ * and then visits every (snapshot, event) pair reachable from the initial
+ * configuration.
+ * Each worker thread owns a private machine instance built by the
+ * factory; a snapshot is restored into it, one event is dispatched and
+ * the resulting snapshot is looked up in a shared lock-free visited set.
+ *
+ * The visited set keeps 64-bit fingerprints of the snapshots (hash
+ * compaction), so memory per state is 8 bytes regardless of the size of
+ * the extended state. Two distinct snapshots sharing a fingerprint would
+ * hide one of them; with n states the chance of that is about n^2/2^65.
+ *
+ * Every registered field must range over a finite set, or the search
+ * never ends. A counter that only matters modulo some period, such as a
+ * calendar year, is registered with regPeriodic(): the snapshot keeps it
+ * modulo the period and restores it into the first period from a base.
+ *
+ * Transitions are code in this design, not data, so the explorer cannot
+ * list them by itself. expect() declares the transitions of the
+ * statechart, and the report names those that were never taken.
+ */
+#ifndef explore_h
+#define explore_h
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "hsm.h"
+#include "snapshot.h"
+
+#define EXPLORE_MAX_STATES  64                  /* distinct State objects */
+#define EXPLORE_MAX_EVENTS  32
+#define EXPLORE_MAX_KEY     64                 /* bytes of one snapshot */
+#define EXPLORE_MAX_OFFSET  4096   /* sizeof the machine explored, at most */
+#define EXPLORE_MAX_EXPECT  64
+
+class Explorer {
+public:
+    typedef Hsm *(*Factory)();               /* new machine, not started */
+    typedef void (*Destroyer)(Hsm *);            /* delete it as its class */
+private:
+    struct Expect {
+        State const *from, *to;
+        Event evt;
+        std::atomic<bool> taken;
+    };
+    struct Stats;                                    /* see explore.cpp */
+    struct Level;
+
+    Factory make;
+    Destroyer destroy;
+    Hsm *proto;                             /* started, used for reg() */
+    Snapshot snap;                             /* the key of a snapshot */
+    Msg const *events[EXPLORE_MAX_EVENTS];
+    unsigned nEvents;
+    Expect expects[EXPLORE_MAX_EXPECT];
+    unsigned nExpects;
+
+    std::atomic<unsigned long long> *visited;        /* fingerprint table */
+    unsigned long long mask;
+    std::atomic<unsigned long> nStates, nDispatch;
+    std::atomic<bool> full;
+
+    std::mutex stateLock;                       /* guards state discovery */
+    std::atomic<int> stateOf[EXPLORE_MAX_OFFSET + EXPLORE_MAX_STATES];
+    unsigned short stateOff[EXPLORE_MAX_STATES];
+    std::atomic<unsigned> nStateIdx;
+    Stats *stats;                                   /* merged by run() */
+    unsigned depth;
+    double elapsed;
+
+    int stateIdx_(unsigned short off);
+    bool insert_(unsigned char const *key);
+    bool within_(Hsm *m, State const *s, unsigned short off) const;
+    void expand_(Hsm *m, unsigned char const *key, Stats *st,
+                 unsigned char *out, unsigned *nOut);
+    void worker_(Level *lv, Stats *st, std::vector<unsigned char> *next);
+public:
+    Explorer(Factory make, Destroyer destroy, Msg const *const *events,
+             unsigned nEvents);
+    ~Explorer();
+    Hsm *getProto() const { return proto; }
+
+    void reg(void const *field, unsigned size);  /* field of getProto() */
+    void regState(State const *const *slot);        /* e.g. a history pointer */
+    void regPeriodic(unsigned const *field, unsigned base, unsigned period);
+    void expect(State const *from, Event evt, State const *to);
+
+    bool run(unsigned nWorkers, unsigned long maxStates, bool depthFirst);
+    unsigned long reachable() const { return nStates.load(); }
+    void report(FILE *out);
+};
+
+#endif /* explore_h */
@@ -0,0 +1,404 @@
+/** fdsrc.cpp -- file-descriptor event source implementation
+ */
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "fdsrc.h"
+
+#define URING_ENTRIES 256
+#define UD_IGNORE (~(unsigned long long)0)   /* cancels, timeouts, ... */
+
+/* user_data of a request: registration slot plus its generation */
+#define UD_MAKE(h_, gen_) (((unsigned long long)(gen_) << 32) | (unsigned)(h_))
+#define UD_HANDLE(ud_)    ((int)((ud_) & 0xFFFFFFFFu))
+#define UD_GEN(ud_)       ((unsigned)((ud_) >> 32))
+
+struct FdUring {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray, sqEntries;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    void *sqPtr, *cqPtr;
+    size_t sqSize, cqSize;
+    unsigned sqLocal;                    /* tail not yet published to kernel */
+    unsigned sqSubmitted;                       /* tail last handed over */
+    __kernel_timespec ts;                   /* timeout of the current poll */
+};
+
+static int uringEnter(FdUring *u, unsigned minComplete) {
+    __atomic_store_n(u->sqTail, u->sqLocal, __ATOMIC_RELEASE);
+    unsigned n = u->sqLocal - u->sqSubmitted;
+    u->sqSubmitted = u->sqLocal;
+    return (int)syscall(__NR_io_uring_enter, u->fd, n, minComplete,
+                        minComplete ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+}
+
+static io_uring_sqe *uringSqe(FdUring *u) {
+    if (u->sqLocal - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE)
+        == u->sqEntries)
+    {
+        uringEnter(u, 0);                     /* ring full, push it out */
+    }
+    unsigned idx = u->sqLocal & *u->sqMask;
+    io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqArray[idx] = idx;
+    ++u->sqLocal;
+    return sqe;
+}
+
+static FdUring *uringOpen() {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) {                         /* old kernel or seccomp filter */
+        return 0;
+    }
+    FdUring *u = new FdUring;
+    memset(u, 0, sizeof(*u));
+    u->fd = fd;
+    u->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cqSize > u->sqSize) {
+            u->sqSize = u->cqSize;
+        }
+        u->cqSize = u->sqSize;
+    }
+    u->sqPtr = mmap(0, u->sqSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    u->cqPtr = (p.features & IORING_FEAT_SINGLE_MMAP) ? u->sqPtr
+             : mmap(0, u->cqSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(0, p.sq_entries * sizeof(io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (u->sqPtr == MAP_FAILED || u->cqPtr == MAP_FAILED
+        || sqes == MAP_FAILED)
+    {
+        close(fd);
+        delete u;
+        return 0;
+    }
+    char *sq = (char *)u->sqPtr;
+    char *cq = (char *)u->cqPtr;
+    u->sqHead    = (unsigned *)(sq + p.sq_off.head);
+    u->sqTail    = (unsigned *)(sq + p.sq_off.tail);
+    u->sqMask    = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sqArray   = (unsigned *)(sq + p.sq_off.array);
+    u->sqEntries = p.sq_entries;
+    u->cqHead    = (unsigned *)(cq + p.cq_off.head);
+    u->cqTail    = (unsigned *)(cq + p.cq_off.tail);
+    u->cqMask    = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes      = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    u->sqes      = (io_uring_sqe *)sqes;
+    u->sqLocal = u->sqSubmitted = *u->sqTail;
+    return u;
+}
+
+static void uringClose(FdUring *u) {
+    munmap(u->sqes, u->sqEntries * sizeof(io_uring_sqe));
+    if (u->cqPtr != u->sqPtr) {
+        munmap(u->cqPtr, u->cqSize);
+    }
+    munmap(u->sqPtr, u->sqSize);
+    close(u->fd);
+    delete u;
+}
+
+static unsigned toPoll(unsigned mask) {
+    return ((mask & FD_READ) ? POLLIN : 0) | ((mask & FD_WRITE) ? POLLOUT : 0);
+}
+
+static unsigned fromPoll(unsigned revents) {
+    return ((revents & POLLIN) ? FD_READ : 0)
+         | ((revents & POLLOUT) ? FD_WRITE : 0)
+         | ((revents & (POLLHUP | POLLERR)) ? FD_HUP : 0);
+}
+
+/* FdSource Ctor............................................................*/
+FdSource::FdSource()
+        : nextReg(0), nParked(0), epfd(-1), ring(0)
+{
+    memset(regs, 0, sizeof(regs));
+}
+
+FdSource::~FdSource() {
+    if (ring) {
+        uringClose(ring);
+    }
+    if (epfd >= 0) {
+        close(epfd);
+    }
+}
+
+/* called from the thread that uses the source, the first caller's.........*/
+bool FdSource::owned_() {
+    if (owner == std::thread::id()) {
+        owner = std::this_thread::get_id();
+    }
+    return owner == std::this_thread::get_id();
+}
+
+/* pick a backend, io_uring first when asked for............................*/
+bool FdSource::open(bool tryUring) {
+    if (tryUring && (ring = uringOpen()) != 0) {
+        return true;
+    }
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    return epfd >= 0;
+}
+
+/* claim a free slot, round-robin so a removed slot is not reused at once...*/
+int FdSource::alloc_(Active *ao, int fd, unsigned char kind, Event sig) {
+    for (unsigned i = 0; i < FDSRC_MAX_FDS; ++i) {
+        unsigned h = (nextReg + i) % FDSRC_MAX_FDS;
+        FdReg *r = &regs[h];
+        if (r->kind == REG_FREE) {
+            nextReg = h + 1;
+            r->ao = ao;
+            r->kind = kind;
+            ++r->gen;
+            r->known = false;
+            r->parked = false;
+            r->queued = false;
+            r->msg.evt = sig;
+            r->msg.handle = (int)h;
+            r->msg.fd = fd;
+            r->msg.ready = 0;
+            r->msg.res = 0;
+            return (int)h;
+        }
+    }
+    return -1;
+}
+
+/* (re)submit the one-shot request of a registration........................*/
+bool FdSource::arm_(FdReg *r) {
+    int h = r->msg.handle;
+    if (ring) {
+        io_uring_sqe *sqe = uringSqe(ring);
+        sqe->fd = r->msg.fd;
+        sqe->user_data = UD_MAKE(h, r->gen);
+        if (r->kind == REG_READY) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = toPoll(r->mask);
+        }
+        else {
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr = (unsigned long long)(size_t)r->buf;
+            sqe->len = r->len;
+            sqe->off = (unsigned long long)-1;        /* current position */
+        }
+        return true;                    /* submitted with the next poll() */
+    }
+    epoll_event ev;
+    ev.events = toPoll(r->kind == REG_READ ? FD_READ : r->mask)
+              | EPOLLONESHOT;
+    ev.data.u64 = UD_MAKE(h, r->gen);
+    if (epoll_ctl(epfd, r->known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                  r->msg.fd, &ev) != 0)
+    {
+        return false;
+    }
+    r->known = true;
+    return true;
+}
+
+/* register for readiness of fd, delivered as FdMsg with evt == sig.........*/
+int FdSource::add(Active *ao, int fd, unsigned mask, Event sig) {
+    assert(owned_());
+    int h = alloc_(ao, fd, REG_READY, sig);
+    if (h >= 0) {
+        regs[h].mask = mask;
+        if (!arm_(&regs[h])) {
+            regs[h].kind = REG_FREE;
+            return -1;
+        }
+    }
+    return h;
+}
+
+/* read up to len bytes into buf, completion delivered as FdMsg.............*/
+int FdSource::read(Active *ao, int fd, void *buf, unsigned len, Event sig) {
+    assert(owned_());
+    int h = alloc_(ao, fd, REG_READ, sig);
+    if (h >= 0) {
+        regs[h].mask = FD_READ;
+        regs[h].buf = buf;
+        regs[h].len = len;
+        if (!arm_(&regs[h])) {
+            regs[h].kind = REG_FREE;
+            return -1;
+        }
+    }
+    return h;
+}
+
+bool FdSource::arm(int handle) {
+    assert(owned_());
+    assert(0 <= handle && handle < FDSRC_MAX_FDS);
+    assert(regs[handle].kind != REG_FREE && regs[handle].kind != REG_STALE);
+    regs[handle].queued = false;          /* its FdMsg has been handled */
+    return arm_(&regs[handle]);
+}
+
+/* drop a registration; completions still in flight are discarded and an
+   FdMsg still queued turns stale, its slot is freed when it is taken.....*/
+void FdSource::remove(int handle) {
+    assert(owned_());
+    if (handle < 0) {
+        return;
+    }
+    assert(handle < FDSRC_MAX_FDS);
+    FdReg *r = &regs[handle];
+    if (r->kind == REG_FREE || r->kind == REG_STALE) {
+        return;
+    }
+    if (ring) {
+        io_uring_sqe *sqe = uringSqe(ring);
+        sqe->opcode = (r->kind == REG_READY) ? IORING_OP_POLL_REMOVE
+                                             : IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = UD_MAKE(handle, r->gen);
+        sqe->user_data = UD_IGNORE;
+        uringEnter(ring, 0);
+    }
+    else if (r->known) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, r->msg.fd, 0);
+    }
+    if (r->parked) {
+        r->parked = false;
+        --nParked;
+    }
+    ++r->gen;
+    r->kind = r->queued ? REG_STALE : REG_FREE;
+}
+
+void FdSource::removeAll(Active *ao) {
+    for (int h = 0; h < FDSRC_MAX_FDS; ++h) {
+        if (regs[h].kind != REG_FREE && regs[h].ao == ao) {
+            remove(h);
+        }
+    }
+}
+
+/* the FdMsg if its registration still stands as delivered, else 0........*/
+FdMsg const *FdSource::take(Msg const *msg) {
+    assert(owned_());
+    FdMsg const *m = (FdMsg const *)msg;
+    assert(0 <= m->handle && m->handle < FDSRC_MAX_FDS);
+    FdReg *r = &regs[m->handle];
+    assert(m == &r->msg);
+    r->queued = false;
+    if (r->kind == REG_STALE) {
+        r->kind = REG_FREE;                      /* nothing refers to it */
+        return 0;
+    }
+    return r->kind != REG_FREE && m->gen == r->gen ? m : 0;
+}
+
+/* post the record of r, parks it when the machine's queue is full..........*/
+unsigned FdSource::deliver_(FdReg *r, unsigned ready, int res) {
+    r->msg.ready = ready;
+    r->msg.res = res;
+    r->msg.gen = r->gen;
+    bool parked = !r->ao->post(&r->msg);
+    nParked += (unsigned)parked - (unsigned)r->parked;
+    r->parked = parked;
+    r->queued = r->queued || !parked;
+    return parked ? 0 : 1;
+}
+
+unsigned FdSource::pollUring_(int timeoutMs) {
+    if (timeoutMs > 0) {
+        io_uring_sqe *sqe = uringSqe(ring);
+        ring->ts.tv_sec = timeoutMs / 1000;
+        ring->ts.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (unsigned long long)(size_t)&ring->ts;
+        sqe->len = 1;
+        sqe->off = 1;              /* ends early on the first completion */
+        sqe->user_data = UD_IGNORE;
+    }
+    if (uringEnter(ring, timeoutMs != 0 ? 1 : 0) < 0 && errno != EINTR
+        && errno != ETIME)
+    {
+        return 0;
+    }
+    unsigned n = 0;
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail && n < FDSRC_BATCH; ++head) {
+        io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+        unsigned long long ud = cqe->user_data;
+        if (ud == UD_IGNORE) {
+            continue;
+        }
+        FdReg *r = &regs[UD_HANDLE(ud)];
+        if (r->kind == REG_FREE || r->gen != UD_GEN(ud)
+            || cqe->res == -ECANCELED)
+        {
+            continue;                             /* removed meanwhile */
+        }
+        if (r->kind == REG_READY) {
+            n += deliver_(r, cqe->res < 0 ? FD_HUP : fromPoll(cqe->res), 0);
+        }
+        else {
+            n += deliver_(r, cqe->res > 0 ? FD_READ : FD_READ | FD_HUP,
+                          cqe->res);
+        }
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+unsigned FdSource::pollEpoll_(int timeoutMs) {
+    epoll_event evs[FDSRC_BATCH];
+    int m = epoll_wait(epfd, evs, FDSRC_BATCH, timeoutMs);
+    unsigned n = 0;
+    for (int i = 0; i < m; ++i) {
+        unsigned long long ud = evs[i].data.u64;
+        FdReg *r = &regs[UD_HANDLE(ud)];
+        if (r->kind == REG_FREE || r->gen != UD_GEN(ud)) {
+            continue;
+        }
+        unsigned ready = fromPoll(evs[i].events);
+        if (r->kind == REG_READY) {
+            n += deliver_(r, ready, 0);
+        }
+        else {                     /* emulate the completion of a read */
+            ssize_t res = ::read(r->msg.fd, r->buf, r->len);
+            if (res < 0 && errno == EAGAIN) {
+                arm_(r);                              /* spurious wakeup */
+                continue;
+            }
+            n += deliver_(r, res > 0 ? FD_READ : FD_READ | FD_HUP,
+                          res < 0 ? -errno : (int)res);
+        }
+    }
+    return n;
+}
+
+/* wait up to timeoutMs (-1 forever, 0 not at all) and post one batch.......*/
+unsigned FdSource::poll(int timeoutMs) {
+    assert(owned_());
+    unsigned n = 0;
+    for (int h = 0; nParked != 0 && h < FDSRC_MAX_FDS; ++h) {  /* retry */
+        FdReg *r = &regs[h];
+        if (r->kind != REG_FREE && r->parked) {
+            n += deliver_(r, r->msg.ready, r->msg.res);
+        }
+    }
+    if (n != 0) {
+        timeoutMs = 0;           /* already have work, do not block */
+    }
+    return n + (ring ? pollUring_(timeoutMs) : pollEpoll_(timeoutMs));
+}
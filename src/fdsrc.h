@@ -0,0 +1,112 @@
+/** fdsrc.h -- file-descriptor event source feeding Active machines
+ *
+ * The event source turns readiness of sockets, pipes and other file
+ * descriptors into events posted to the queue of the Active object that
+ * registered them. It polls with io_uring when the kernel allows it and
+ * falls back to epoll otherwise.
+ *
+ * Every registration is one-shot: after an FdMsg has been delivered the
+ * descriptor stays quiet until the handler calls arm() again. That keeps
+ * the FdMsg record stable while it sits in the queue and lets the handler
+ * decide when it is ready for more. Registrations are meant to follow the
+ * lifetime of a state, so add() them in ENTRY_EVT and remove() them in
+ * EXIT_EVT.
+ *
+ * An FdMsg may still sit in the queue when its registration is removed.
+ * Each FdMsg carries the generation of the registration it was delivered
+ * for, and take() checks it at dispatch: it returns 0 for a stale one,
+ * which the handler drops. A removed registration keeps its slot until
+ * its last FdMsg went through take(), so the record is never reused
+ * under a queued message. Handle the signal where take() is always
+ * reached, the top state at the latest:
+ *
+ *     case ENTRY_EVT:
+ *         rx = fdsrc->add(ao, sock, FD_READ, RX_SIG);
+ *         return 0;
+ *     case RX_SIG:
+ *         if (fdsrc->take(msg) == 0) {
+ *             return 0;                    (removed, or for an old fd)
+ *         }
+ *         ...consume the data...
+ *         fdsrc->arm(rx);
+ *         return 0;
+ *     case EXIT_EVT:
+ *         fdsrc->remove(rx);
+ *         return 0;
+ *
+ * An FdSource is not synchronised. poll() updates the same registration
+ * records that take(), arm() and remove() update from the handlers, so
+ * poll() must run on the thread that dispatches the registered Actives,
+ * between dispatches, as in a loop of poll() and Active::dispatch().
+ * Only the posts to the queues may cross threads. Debug builds assert
+ * that every call comes from the thread that made the first one.
+ */
+#ifndef fdsrc_h
+#define fdsrc_h
+
+#include <thread>
+#include "active.h"
+
+#ifndef FDSRC_MAX_FDS
+#define FDSRC_MAX_FDS 256                 /* registrations per FdSource */
+#endif
+#define FDSRC_BATCH   64                  /* events delivered per poll() */
+
+#define FD_READ  0x01                              /* readable/read done */
+#define FD_WRITE 0x02                                        /* writable */
+#define FD_HUP   0x04                           /* hang-up or error seen */
+
+struct FdUring;                 /* io_uring rings, private to fdsrc.cpp */
+
+struct FdMsg : public Msg {   /* event delivered for a file descriptor */
+    int handle;                               /* registration it came from */
+    int fd;
+    unsigned ready;                      /* FD_READ | FD_WRITE | FD_HUP */
+    int res;            /* bytes read for read(), -errno on failed read */
+    unsigned gen;           /* of the registration when it was delivered */
+};
+
+class FdSource {
+    enum { REG_FREE, REG_READY, REG_READ, REG_STALE };
+    struct FdReg {
+        Active *ao;                               /* machine to deliver to */
+        unsigned char kind;                       /* REG_READY or REG_READ */
+        unsigned mask;                              /* FD_xxx of interest */
+        unsigned gen;                  /* bumped on reuse, drops stale CQEs */
+        void *buf;                                   /* REG_READ only */
+        unsigned len;
+        bool known;                   /* epoll: fd already added to the set */
+        bool parked;                   /* delivery retried, queue was full */
+        bool queued;            /* msg posted, not yet through take() */
+        FdMsg msg;                               /* record that gets posted */
+    };
+    FdReg regs[FDSRC_MAX_FDS];
+    unsigned nextReg;                        /* round-robin slot allocation */
+    unsigned nParked;                      /* registrations waiting to post */
+    int epfd;                                       /* epoll backend or -1 */
+    FdUring *ring;                               /* io_uring backend or 0 */
+    std::thread::id owner;             /* polls and dispatches, see above */
+
+    bool owned_();
+    int alloc_(Active *ao, int fd, unsigned char kind, Event sig);
+    bool arm_(FdReg *r);
+    unsigned deliver_(FdReg *r, unsigned ready, int res);
+    unsigned pollUring_(int timeoutMs);
+    unsigned pollEpoll_(int timeoutMs);
+public:
+    FdSource();
+    ~FdSource();
+    bool open(bool tryUring);               /* false if no backend works */
+    bool usesUring() const { return ring != 0; }
+
+    int add(Active *ao, int fd, unsigned mask, Event sig);   /* readiness */
+    int read(Active *ao, int fd, void *buf, unsigned len, Event sig);
+    bool arm(int handle);                    /* re-enable after delivery */
+    void remove(int handle);
+    void removeAll(Active *ao);
+    FdMsg const *take(Msg const *msg);  /* at dispatch, 0: drop it, stale */
+
+    unsigned poll(int timeoutMs);   /* wait, post a batch, return # posted */
+};
+
+#endif /* fdsrc_h */
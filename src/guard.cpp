@@ -0,0 +1,405 @@
+/** guard.cpp -- allocation and syscall guard implementation
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <cxxabi.h>
+#include "guard.h"
+
+#if defined(HSM_GUARD) && defined(__x86_64__) && defined(__linux__)
+#define GUARD_SUD 1                         /* syscall user dispatch */
+#endif
+
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+#define PR_SET_SYSCALL_USER_DISPATCH 59
+#define PR_SYS_DISPATCH_OFF 0
+#define PR_SYS_DISPATCH_ON 1
+#define SYSCALL_DISPATCH_FILTER_ALLOW 0
+#define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+#ifndef SYS_USER_DISPATCH
+#define SYS_USER_DISPATCH 2                        /* si_code of SIGSYS */
+#endif
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+
+struct GuardStack {                         /* one distinct offending stack */
+    std::atomic<unsigned long> n;                   /* times it was seen */
+    int kind;                                         /* see GuardKind */
+    long what;             /* syscall number, or bytes of the first alloc */
+    int depth;
+    void *frame[GUARD_DEPTH];
+};
+
+struct GuardThread {              /* the calling thread's guard, all zero */
+    unsigned depth;                            /* enter() minus leave() */
+    unsigned dispatches;         /* dispatched() entered, done() not yet */
+    bool busy;                      /* recording: offences not counted */
+    bool dispatchOn;               /* syscall user dispatch set up */
+    volatile char selector;          /* read by the kernel on each syscall */
+};
+
+static std::atomic<bool> on(false);
+static std::atomic<bool> sysCounted(false);
+static thread_local GuardThread my;
+static HsmHook<HsmTracer> tracerHook(&Hsm::tracer, &Guard::dispatched);
+static HsmHook<HsmTimer> timerHook(&Hsm::timer, &Guard::done);
+static std::atomic<unsigned long> inFlight(0);     /* dispatched(), guarded */
+static std::atomic<unsigned long> nKind[GUARD_KINDS];
+static std::atomic<unsigned long> nUnkept;       /* table of stacks full */
+static GuardStack stacks[GUARD_MAX_STACKS];
+static unsigned nStacks;                            /* under stackLock */
+static std::atomic_flag stackLock = ATOMIC_FLAG_INIT;
+
+#ifdef GUARD_SUD
+/* the only code that may enter the kernel while the selector blocks:
+   syscalls performed for the SIGSYS handler, and the way back from it.
+   The restorer must be these exact bytes, unwinders know them. */
+extern "C" long guardSyscall_(long nr, long a1, long a2, long a3, long a4,
+                              long a5, long a6);
+extern "C" void guardRestorer_();
+extern "C" char guardStubs_[], guardStubsEnd_[];
+asm(".text\n"
+    ".globl guardStubs_\n.hidden guardStubs_\n"
+    ".globl guardSyscall_\n.hidden guardSyscall_\n"
+    ".globl guardRestorer_\n.hidden guardRestorer_\n"
+    ".globl guardStubsEnd_\n.hidden guardStubsEnd_\n"
+    "guardStubs_:\n"
+    "guardSyscall_:\n"
+    "    movq %rdi, %rax\n"
+    "    movq %rsi, %rdi\n"
+    "    movq %rdx, %rsi\n"
+    "    movq %rcx, %rdx\n"
+    "    movq %r8, %r10\n"
+    "    movq %r9, %r8\n"
+    "    movq 8(%rsp), %r9\n"
+    "    syscall\n"
+    "    ret\n"
+    "guardRestorer_:\n"
+    "    movq $15, %rax\n"                          /* SYS_rt_sigreturn */
+    "    syscall\n"
+    "    ud2\n"             /* the kernel checks the address after syscall */
+    "guardStubsEnd_:\n");
+
+struct GuardSigaction {                   /* the kernel's struct sigaction */
+    void (*handler)(int, siginfo_t *, void *);
+    unsigned long flags;
+    void (*restorer)();
+    unsigned long mask;
+};
+#endif
+
+/* note one offence of the calling thread, with its stack..................*/
+__attribute__((noinline))
+static void record_(int kind, long what, unsigned skip) {
+    void *f[GUARD_DEPTH + 8];
+    my.busy = true;
+    char const selector = my.selector;
+    my.selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+    nKind[kind].fetch_add(1, std::memory_order_relaxed);
+    int n = backtrace(f, GUARD_DEPTH + 8);
+#ifdef GUARD_SUD
+    if (kind == GUARD_SYSCALL) {         /* start below the signal frame */
+        for (int i = 0; i < n; ++i) {
+            if ((char *)f[i] >= guardStubs_ && (char *)f[i] < guardStubsEnd_) {
+                skip = (unsigned)i + 1;
+                break;
+            }
+        }
+    }
+#endif
+    int depth = n - (int)skip;
+    depth = depth < 0 ? 0 : depth > GUARD_DEPTH ? GUARD_DEPTH : depth;
+    while (stackLock.test_and_set(std::memory_order_acquire)) {
+    }
+    unsigned i = 0;
+    for (; i < nStacks; ++i) {
+        GuardStack *s = &stacks[i];
+        if (s->kind == kind && s->depth == depth
+            && (kind != GUARD_SYSCALL || s->what == what)
+            && memcmp(s->frame, f + skip, depth * sizeof(void *)) == 0)
+        {
+            break;
+        }
+    }
+    if (i == nStacks && nStacks < GUARD_MAX_STACKS) {
+        GuardStack *s = &stacks[nStacks++];
+        s->kind = kind;
+        s->what = what;
+        s->depth = depth;
+        memcpy(s->frame, f + skip, depth * sizeof(void *));
+    }
+    if (i < nStacks) {
+        stacks[i].n.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        nUnkept.fetch_add(1, std::memory_order_relaxed);
+    }
+    stackLock.clear(std::memory_order_release);
+    my.selector = selector;
+    my.busy = false;
+}
+
+__attribute__((always_inline))
+static inline void check_(int kind, long what) {
+    if (my.depth != 0 && !my.busy && on.load(std::memory_order_relaxed)) {
+        record_(kind, what, 1);
+    }
+}
+
+#ifdef GUARD_SUD
+/* a syscall made while guarded: count it, then make it for the caller.....*/
+static void onSigsys_(int, siginfo_t *si, void *uc) {
+    greg_t *r = ((ucontext_t *)uc)->uc_mcontext.gregs;
+    if (si->si_code != SYS_USER_DISPATCH) {
+        return;
+    }
+    my.selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+    long nr = r[REG_RAX];
+    if (!my.busy) {
+        record_(GUARD_SYSCALL, nr, 0);
+    }
+    switch (nr) {
+    case SYS_clone: case SYS_fork: case SYS_vfork: case SYS_execve:
+#ifdef SYS_clone3
+    case SYS_clone3:
+#endif
+        r[REG_RIP] -= 2;            /* not from here: let it run again, */
+        return;           /* unguarded; the next enter() guards again */
+    }
+    r[REG_RAX] = guardSyscall_(nr, r[REG_RDI], r[REG_RSI], r[REG_RDX],
+                               r[REG_R10], r[REG_R8], r[REG_R9]);
+    my.selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+}
+#endif
+
+/* Guard:: start/stop......................................................*/
+bool Guard::start() {
+#ifndef HSM_GUARD
+    return false;
+#else
+    void *f[4];
+    if (on.load()) {
+        return true;
+    }
+    backtrace(f, 4);      /* loads the unwinder now, it allocates doing so */
+    bool sys = false;
+#ifdef GUARD_SUD
+    GuardSigaction sa = { &onSigsys_, SA_SIGINFO | SA_RESTORER,
+                          &guardRestorer_, 0 };
+    sys = syscall(SYS_rt_sigaction, SIGSYS, &sa, 0, sizeof(sa.mask)) == 0;
+#endif
+    sysCounted.store(sys);
+    on.store(true);
+    timerHook.install();    /* a dispatch that sees the tracer sees this */
+    tracerHook.install();
+    return true;
+#endif
+}
+
+/* no dispatch may be left between the two hooks: one that entered with
+   dispatched() either counts in inFlight before on turns false, and then
+   finds the timer still hooked, or sees on false and does not enter.....*/
+void Guard::stop() {
+    if (!on.load()) {
+        return;
+    }
+    on.store(false);
+    tracerHook.remove();
+    while (inFlight.load() != 0) {
+        sched_yield();
+    }
+    timerHook.remove();
+}
+
+/* Guard:: the calling thread's guarded section............................*/
+void Guard::enter() {
+    GuardThread *t = &my;
+    if (!on.load(std::memory_order_relaxed) || t->depth++ != 0) {
+        return;
+    }
+#ifdef GUARD_SUD
+    if (!t->dispatchOn && sysCounted.load(std::memory_order_relaxed)) {
+        t->dispatchOn = true;
+        if (prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+                  guardStubs_, guardStubsEnd_ - guardStubs_,
+                  &t->selector) != 0)
+        {
+            sysCounted.store(false);            /* too old a kernel, say */
+        }
+    }
+    t->selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+#endif
+}
+
+void Guard::leave() {
+    GuardThread *t = &my;
+    if (t->depth == 0 || --t->depth != 0) {  /* 0: entered before start() */
+        return;
+    }
+    t->selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+}
+
+/* Guard:: hooks, around every Hsm::onEvent()..............................*/
+void Guard::dispatched(Hsm const *me, State const *s, int kind, Event evt) {
+    if (kind == HSM_TRACE_DISPATCH) {
+        inFlight.fetch_add(1);
+        if (on.load()) {
+            ++my.dispatches;
+            enter();
+        }
+        else {
+            inFlight.fetch_sub(1);                      /* stop() is on */
+        }
+    }
+    HsmTracer const next = tracerHook.next();
+    if (next) {
+        (*next)(me, s, kind, evt);
+    }
+}
+
+void Guard::done(Hsm const *me, State const *handler, Event evt,
+                 unsigned long long ticks)
+{
+    HsmTimer const next = timerHook.next();
+    if (next) {
+        (*next)(me, handler, evt, ticks);
+    }
+    if (my.dispatches != 0) {        /* 0: dispatched before the tracer */
+        --my.dispatches;
+        leave();
+        inFlight.fetch_sub(1);
+    }
+}
+
+/* Guard:: what was caught.................................................*/
+unsigned long Guard::count(int kind) {
+    assert(0 <= kind && kind < GUARD_KINDS);
+    return nKind[kind].load();
+}
+
+unsigned long Guard::offences() {
+    unsigned long n = 0;
+    for (int k = 0; k < GUARD_KINDS; ++k) {
+        n += nKind[k].load();
+    }
+    return n;
+}
+
+void Guard::reset() {
+    while (stackLock.test_and_set(std::memory_order_acquire)) {
+    }
+    for (unsigned i = 0; i < nStacks; ++i) {
+        stacks[i].n.store(0);
+    }
+    nStacks = 0;
+    for (int k = 0; k < GUARD_KINDS; ++k) {
+        nKind[k].store(0);
+    }
+    nUnkept.store(0);
+    stackLock.clear(std::memory_order_release);
+}
+
+void Guard::report(FILE *out) {
+    static char const *const kindName[GUARD_KINDS] = {
+        "allocation", "free", "syscall"
+    };
+    fprintf(out, "%lu allocations, %lu frees, %lu syscalls while guarded%s\n",
+            count(GUARD_ALLOC), count(GUARD_FREE), count(GUARD_SYSCALL),
+            sysCounted.load() ? "" : " (syscalls not counted)");
+    while (stackLock.test_and_set(std::memory_order_acquire)) {
+    }
+    unsigned n = nStacks;
+    stackLock.clear(std::memory_order_release);
+    for (unsigned i = 0; i < n; ++i) {
+        GuardStack const *s = &stacks[i];
+        if (s->kind == GUARD_SYSCALL) {
+            fprintf(out, "%s %ld, %lu times:\n", kindName[s->kind], s->what,
+                    s->n.load());
+        }
+        else if (s->kind == GUARD_ALLOC) {
+            fprintf(out, "%s of %ld bytes, %lu times:\n", kindName[s->kind],
+                    s->what, s->n.load());
+        }
+        else {
+            fprintf(out, "%s, %lu times:\n", kindName[s->kind], s->n.load());
+        }
+        for (int d = 0; d < s->depth; ++d) {
+            Dl_info di;
+            void *at = (char *)s->frame[d] - 1;      /* in the call, not after */
+            if (dladdr(at, &di) == 0 || di.dli_sname == 0) {
+                fprintf(out, "  #%-2d %p %s\n", d, s->frame[d],
+                        di.dli_fname ? di.dli_fname : "");
+                continue;
+            }
+            int status;
+            char *name = abi::__cxa_demangle(di.dli_sname, 0, 0, &status);
+            fprintf(out, "  #%-2d %s+0x%lx\n", d, name ? name : di.dli_sname,
+                    (unsigned long)((char *)s->frame[d]
+                                    - (char *)di.dli_saddr));
+            free(name);
+        }
+    }
+    if (nUnkept.load() != 0) {
+        fprintf(out, "%lu more, their stacks not kept\n", nUnkept.load());
+    }
+}
+
+#ifdef HSM_GUARD
+/* the malloc family, counted while guarded, then glibc's own..............*/
+extern "C" {
+void *__libc_malloc(size_t n);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t n);
+void *__libc_memalign(size_t align, size_t n);
+void __libc_free(void *p);
+
+void *malloc(size_t n) {
+    check_(GUARD_ALLOC, (long)n);
+    return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) {
+    check_(GUARD_ALLOC, (long)(n * size));
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n) {
+    check_(GUARD_ALLOC, (long)n);
+    return __libc_realloc(p, n);
+}
+
+void *memalign(size_t align, size_t n) {
+    check_(GUARD_ALLOC, (long)n);
+    return __libc_memalign(align, n);
+}
+
+void *aligned_alloc(size_t align, size_t n) {
+    check_(GUARD_ALLOC, (long)n);
+    return __libc_memalign(align, n);
+}
+
+int posix_memalign(void **p, size_t align, size_t n) {
+    check_(GUARD_ALLOC, (long)n);
+    *p = __libc_memalign(align, n);
+    return *p || n == 0 ? 0 : ENOMEM;
+}
+
+void free(void *p) {
+    if (p != 0) {
+        check_(GUARD_FREE, 0);
+    }
+    __libc_free(p);
+}
+}
+#endif
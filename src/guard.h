@@ -0,0 +1,61 @@
+/** guard.h -- catch heap allocation and syscalls on the dispatch path
+ *
+ * Dispatching an event must neither allocate nor enter the kernel. The
+ * guard checks it. Guard::start() hooks Hsm::tracer and Hsm::timer: from
+ * then on every Hsm::onEvent(), in any thread, runs guarded from its
+ * first handler call to its end. Other code, onStart() or the queue and
+ * timer paths around a dispatch, is guarded between enter() and leave(),
+ * or by a GuardScope. The hooks chain to those installed before start(),
+ * and stop() puts them back unless others were installed over the guard.
+ * stop() waits for the dispatches in flight to end, so it must not be
+ * called from a handler.
+ *
+ * While guarded, malloc(), free() and their relatives (so also operator
+ * new and delete) are counted, and so is every syscall. Syscalls are
+ * caught with syscall user dispatch (Linux 5.11, x86-64): the kernel
+ * turns each one into a SIGSYS, the handler counts it and performs it
+ * on the caller's behalf, so the program runs on unchanged. Calls into
+ * the vDSO (clock_gettime()) are not syscalls and pass. Each offence is
+ * recorded with its call stack, the same stack only once, and report()
+ * prints them, symbolized if the program was linked with -rdynamic.
+ *
+ * The malloc family is only replaced when guard.cpp is compiled with
+ * HSM_GUARD, which "make guard" does for its own build of bench/guard.
+ * Without it start() returns false and the rest does nothing. Each
+ * thread pays one prctl() when it is first guarded.
+ */
+#ifndef guard_h
+#define guard_h
+
+#include <assert.h>
+#include <stdio.h>
+#include "hsm.h"
+
+#define GUARD_MAX_STACKS 32               /* distinct offending call stacks */
+#define GUARD_DEPTH      24                  /* frames kept of each stack */
+
+enum GuardKind { GUARD_ALLOC, GUARD_FREE, GUARD_SYSCALL, GUARD_KINDS };
+
+class Guard {
+public:
+    static bool start();                       /* false: not available */
+    static void stop();                   /* unhook, the records stay */
+    static void enter();                /* the calling thread, nestable */
+    static void leave();
+    static unsigned long count(int kind);          /* see GuardKind */
+    static unsigned long offences();               /* all kinds summed */
+    static void report(FILE *out);        /* offending stacks, with counts */
+    static void reset();                          /* forget all records */
+
+    static void dispatched(Hsm const *me, State const *s, int kind,
+                           Event evt);                    /* an HsmTracer */
+    static void done(Hsm const *me, State const *handler, Event evt,
+                     unsigned long long ticks);             /* an HsmTimer */
+};
+
+struct GuardScope {                   /* guards the block it lives in */
+    GuardScope() { Guard::enter(); }
+    ~GuardScope() { Guard::leave(); }
+};
+
+#endif /* guard_h */
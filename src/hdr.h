@@ -0,0 +1,108 @@
+/** hdr.h -- high-dynamic-range histogram buckets and a cheap clock
+ *
+ * Values are bucketed log-linearly: HDR_SUB buckets per power of 2, so
+ * a bucket is never wider than 1/HDR_SUB of the values in it (about 6%)
+ * from 1 up to 2^HDR_MAX_BITS, where everything larger is lumped into
+ * the last bucket. Finding the bucket is a count-leading-zeros and two
+ * shifts. Histograms are plain arrays of HDR_BUCKETS counters; summing
+ * two arrays merges them.
+ *
+ * hdrTicks() is the time stamp counter on x86-64 and CLOCK_MONOTONIC
+ * nanoseconds elsewhere; hdrNsPerTick() converts.
+ * This header is shared by the C and C++ engines.
+ */
+#ifndef hdr_h
+#define hdr_h
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define HDR_SUB_BITS 4
+#define HDR_SUB      (1 << HDR_SUB_BITS)           /* buckets per octave */
+#define HDR_MAX_BITS 40          /* 2^40 ticks: minutes at a few GHz */
+#define HDR_BUCKETS  ((HDR_MAX_BITS - HDR_SUB_BITS + 1) << HDR_SUB_BITS)
+
+static inline unsigned hdrIndex(unsigned long long v) {
+    unsigned e;
+    if (v < HDR_SUB) {
+        return (unsigned)v;                        /* exact below HDR_SUB */
+    }
+    e = 63u - (unsigned)__builtin_clzll(v);          /* top bit, >= SUB_BITS */
+    if (e >= HDR_MAX_BITS) {
+        return HDR_BUCKETS - 1;
+    }
+    return ((e - HDR_SUB_BITS + 1) << HDR_SUB_BITS)
+           | (unsigned)((v >> (e - HDR_SUB_BITS)) & (HDR_SUB - 1));
+}
+
+static inline unsigned long long hdrLow(unsigned i) { /* smallest in i */
+    unsigned e;
+    if (i < HDR_SUB) {
+        return i;
+    }
+    e = (i >> HDR_SUB_BITS) + HDR_SUB_BITS - 1;
+    return (unsigned long long)(HDR_SUB | (i & (HDR_SUB - 1)))
+           << (e - HDR_SUB_BITS);
+}
+
+static inline unsigned long long hdrHigh(unsigned i) { /* largest in i */
+    return i + 1 < HDR_BUCKETS ? hdrLow(i + 1) - 1 : hdrLow(i);
+}
+
+/* value at or below which q percent of the n values in b fall, taken as
+   the top of its bucket so it never under-reports; 0 when n is 0 */
+static inline unsigned long long hdrPercentile(unsigned long long const *b,
+                                               unsigned long long n,
+                                               double q)
+{
+    unsigned long long want = (unsigned long long)(q / 100.0 * n + 0.5);
+    unsigned long long seen = 0;
+    unsigned i;
+    if (n == 0) {
+        return 0;
+    }
+    if (want == 0) {
+        want = 1;
+    }
+    for (i = 0; i < HDR_BUCKETS; ++i) {
+        seen += b[i];
+        if (seen >= want) {
+            break;
+        }
+    }
+    return hdrHigh(i < HDR_BUCKETS ? i : HDR_BUCKETS - 1);
+}
+
+static inline unsigned long long hdrNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL
+           + (unsigned long long)ts.tv_nsec;
+}
+
+static inline unsigned long long hdrTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return hdrNs();
+#endif
+}
+
+/* measured against CLOCK_MONOTONIC over about ms milliseconds */
+static inline double hdrNsPerTick(unsigned ms) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned long long n0 = hdrNs(), t0 = hdrTicks(), n1, t1;
+    do {
+        n1 = hdrNs();
+        t1 = hdrTicks();
+    } while (n1 - n0 < ms * 1000000ULL);
+    return (double)(n1 - n0) / (double)(t1 - t0);
+#else
+    (void)ms;
+    return 1.0;
+#endif
+}
+
+#endif /* hdr_h */
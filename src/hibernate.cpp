@@ -0,0 +1,149 @@
+/** hibernate.cpp -- hibernation of idle machines
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hibernate.h"
+
+/* HibPool..................................................................*/
+HibPool::~HibPool() {
+    for (void *c : chunks) {
+        free(c);
+    }
+}
+
+void HibPool::init(size_t blockSize, size_t align) {
+    block = blockSize < sizeof(void *) ? sizeof(void *) : blockSize;
+    block = (block + align - 1) & ~(align - 1);
+}
+
+void *HibPool::alloc() {
+    if (spare != 0) {
+        void *p = spare;
+        memcpy(&spare, p, sizeof(spare));             /* may be unaligned */
+        return p;
+    }
+    if (left < block) {
+        chunk = (char *)malloc(HIB_CHUNK);
+        assert(chunk != 0);
+        chunks.push_back(chunk);
+        left = HIB_CHUNK;
+    }
+    void *p = chunk;
+    chunk += block;
+    left -= block;
+    return p;
+}
+
+void HibPool::release(void *p) {
+    memcpy(p, &spare, sizeof(spare));
+    spare = p;
+}
+
+/* HsmClass Ctor............................................................*/
+HsmClass::HsmClass(Builder b, Destroyer d, size_t sz)
+        : build(b), destroy(d), size(sz), proto(b(malloc(sz))), snap(proto)
+{
+    assert(size <= SNAP_MAX_OFFSET && size <= HIB_CHUNK);
+    objects.init(size, alignof(max_align_t));
+}
+
+HsmClass::~HsmClass() {
+    destroy(proto);
+    free(proto);
+}
+
+/* Hibernator Ctor..........................................................*/
+Hibernator::Hibernator(unsigned maxMachines)
+        : nSlots(0), maxSlots(maxMachines), nClasses(0), round(0),
+          nAsleep(0)
+{
+    slots = (Slot *)calloc(maxMachines, sizeof(Slot));  /* touched as used */
+    assert(slots != 0);
+}
+
+Hibernator::~Hibernator() {
+    for (unsigned h = 0; h < nSlots; ++h) {
+        if (!slots[h].asleep) {
+            classes[slots[h].cls]->destroy((Hsm *)slots[h].p);
+        }
+    }
+    free(slots);                       /* the pools go with their classes */
+}
+
+unsigned char Hibernator::addClass(HsmClass *c) {
+    assert(nClasses < HIB_MAX_CLASSES);
+    c->records.init(c->snap.size(), 1);           /* all fields known now */
+    classes[nClasses] = c;
+    return (unsigned char)nClasses++;
+}
+
+unsigned Hibernator::spawn(unsigned char cls) {
+    assert(cls < nClasses && nSlots < maxSlots);
+    HsmClass *c = classes[cls];
+    Slot *s = &slots[nSlots];
+    Hsm *m = c->build(c->objects.alloc());
+    m->onStart();
+    s->p = m;
+    s->lastUse = round;
+    s->cls = cls;
+    s->asleep = false;
+    return nSlots++;
+}
+
+/* rebuild the object from its record, no entry actions....................*/
+Hsm *Hibernator::wake_(Slot *s) {
+    HsmClass *c = classes[s->cls];
+    unsigned char *rec = (unsigned char *)s->p;
+    Hsm *m = c->build(c->objects.alloc());
+    c->unpack(m, rec);
+    c->records.release(rec);
+    s->p = m;
+    s->asleep = false;
+    --nAsleep;
+    return m;
+}
+
+void Hibernator::sleep_(Slot *s) {
+    HsmClass *c = classes[s->cls];
+    Hsm *m = (Hsm *)s->p;
+    unsigned char *rec = (unsigned char *)c->records.alloc();
+    c->pack(m, rec);
+    c->destroy(m);
+    c->objects.release(m);
+    s->p = rec;
+    s->asleep = true;
+    ++nAsleep;
+}
+
+Msg const *Hibernator::onEvent(unsigned h, Msg const *msg) {
+    return get(h)->onEvent(msg);
+}
+
+Hsm *Hibernator::get(unsigned h) {
+    assert(h < nSlots);
+    Slot *s = &slots[h];
+    s->lastUse = round;
+    return s->asleep ? wake_(s) : (Hsm *)s->p;
+}
+
+void Hibernator::hibernate(unsigned h) {
+    assert(h < nSlots);
+    if (!slots[h].asleep) {
+        sleep_(&slots[h]);
+    }
+}
+
+/* put to sleep whatever had no event during the last idle sweeps..........*/
+unsigned long Hibernator::sweep(unsigned idle) {
+    unsigned long n = 0;
+    ++round;
+    for (unsigned h = 0; h < nSlots; ++h) {
+        Slot *s = &slots[h];
+        if (!s->asleep && round - s->lastUse >= idle) {
+            sleep_(s);
+            ++n;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,111 @@
+/** hibernate.h -- compacting idle machines, rehydrating them on demand
+ *
+ * Most machines of a large population sit in some leaf state for a long
+ * time. A Hibernator keeps each of its machines either awake, as the full
+ * object in a block of its class's pool, or asleep, as a compact record:
+ * the current state, the registered history slots and the registered
+ * extended state, encoded as a Snapshot (see snapshot.h), as the Explorer
+ * keys its search.
+ * Falling asleep destroys the object and returns its block to the pool;
+ * the next onEvent() for the machine builds a fresh object in a block,
+ * restores the record into it and dispatches. No entry action runs on the
+ * way back, the machine simply is in the state it was in.
+ *
+ * sweep() puts every machine to sleep that received no event during the
+ * last idle sweeps, so calling it periodically makes the idle threshold a
+ * time. Everything a class's behavior depends on besides its current
+ * state must be registered with HsmClass::reg()/regState(); members that
+ * are not registered come back as the constructor leaves them.
+ *
+ * A Hibernator and its machines belong to the one thread that calls it,
+ * like the dispatching thread of an Active. Handles are dense indices.
+ */
+#ifndef hibernate_h
+#define hibernate_h
+
+#include <assert.h>
+#include <stddef.h>
+#include <vector>
+#include "hsm.h"
+#include "snapshot.h"
+
+#define HIB_MAX_CLASSES 256
+#define HIB_CHUNK       (1 << 20)                   /* bytes a pool grows by */
+
+class HibPool {                     /* fixed-size blocks, never shrinks */
+    size_t block;
+    char *chunk;                                   /* being carved up */
+    size_t left;                                  /* bytes of it unused */
+    void *spare;                            /* released blocks, linked */
+    std::vector<void *> chunks;
+public:
+    HibPool() : block(0), chunk(0), left(0), spare(0) {}
+    ~HibPool();
+    void init(size_t blockSize, size_t align);     /* records: packed */
+    void *alloc();
+    void release(void *p);
+    size_t bytes() const { return chunks.size() * (size_t)HIB_CHUNK; }
+};
+
+class HsmClass {     /* how to build, compact and rebuild one machine class */
+public:
+    typedef Hsm *(*Builder)(void *mem);       /* placement new, not started */
+    typedef void (*Destroyer)(Hsm *);              /* run its destructor */
+private:
+    Builder build;
+    Destroyer destroy;
+    size_t size;
+    Hsm *proto;                           /* not started, used for reg() */
+    Snapshot snap;                                   /* what a record is */
+    HibPool objects, records;
+public:
+    HsmClass(Builder build, Destroyer destroy, size_t size);
+    ~HsmClass();
+    Hsm *getProto() const { return proto; }
+    void reg(void const *field, unsigned size) {   /* field of getProto() */
+        snap.reg(field, size);
+    }
+    void regState(State const *const *slot) {  /* e.g. a history pointer */
+        snap.regState(slot);
+    }
+    unsigned getRecordSize() const { return snap.size(); }
+    void pack(Hsm const *m, unsigned char *rec) const {  /* RecordSize bytes */
+        snap.encode(m, rec);
+    }
+    void unpack(Hsm *m, unsigned char const *rec) const {   /* a fresh build */
+        snap.decode(m, rec);
+    }
+    friend class Hibernator;
+};
+
+class Hibernator {
+    struct Slot {
+        void *p;                          /* the object or its record */
+        unsigned lastUse;                        /* sweep of its last event */
+        unsigned char cls;
+        bool asleep;
+    };
+    Slot *slots;
+    unsigned nSlots, maxSlots;
+    HsmClass *classes[HIB_MAX_CLASSES];
+    unsigned nClasses;
+    unsigned round;                                       /* sweeps so far */
+    unsigned long nAsleep;
+
+    Hsm *wake_(Slot *s);
+    void sleep_(Slot *s);
+public:
+    explicit Hibernator(unsigned maxMachines);
+    ~Hibernator();
+    unsigned char addClass(HsmClass *c);                    /* its class ID */
+    unsigned spawn(unsigned char cls);       /* a started machine's handle */
+    Msg const *onEvent(unsigned h, Msg const *msg);   /* wakes it if asleep */
+    Hsm *get(unsigned h);                       /* awake, until next sweep */
+    void hibernate(unsigned h);
+    unsigned long sweep(unsigned idle);       /* # put to sleep, idle sweeps */
+    bool isAsleep(unsigned h) const { return slots[h].asleep; }
+    unsigned long asleep() const { return nAsleep; }
+    unsigned size() const { return nSlots; }
+};
+
+#endif /* hibernate_h */
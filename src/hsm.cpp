@@ -1,7 +1,12 @@
 /** hsm.c -- Hierarchical State Machine implementation
  */
 #include <assert.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
 #include "hsm.h"
+#include "probe.h"
+#include "hdr.h"
 
 /* Entry/exit actions and default tran-
 sitions  are  also  implemented  inside
@@ -14,90 +19,168 @@ patches  these  events  to  appropriate
 handlers  upon  state  transitions. 
 */
 
-static Msg const startMsg = { START_EVT };
-static Msg const entryMsg = { ENTRY_EVT };
-static Msg const exitMsg  = { EXIT_EVT };
-#define MAX_STATE_NESTING 8
+Msg const Hsm::startMsg_ = { START_EVT };
+Msg const Hsm::entryMsg_ = { ENTRY_EVT };
+Msg const Hsm::exitMsg_  = { EXIT_EVT };
+
+#define HNDLR_SLOTS (2 * HSM_MAX_HANDLERS)  /* hash index, half empty */
+
+EvtHndlr State::hndlrs[HSM_MAX_HANDLERS];
+char const *State::names[HSM_MAX_HANDLERS];
+static std::atomic<unsigned short> hndlrSlot[HNDLR_SLOTS];  /* id + 1 */
+static unsigned nHndlrs;
+static std::mutex hndlrLock;
+
+static unsigned hndlrHash(char const *n, EvtHndlr h) {
+    unsigned long long w[(sizeof(h) + 7) / 8 + 1] = { 0 };
+    unsigned long long x = 0;
+    memcpy(w, &h, sizeof(h));                /* code pointer, adjustment */
+    w[sizeof(w) / sizeof(w[0]) - 1] = (unsigned long long)n;
+    for (unsigned i = 0; i < sizeof(w) / sizeof(w[0]); ++i) {
+        x = (x ^ w[i]) * 0x9E3779B97F4A7C15ull;
+    }
+    return (unsigned)(x >> 32) & (HNDLR_SLOTS - 1);
+}
+
+/* the slot of (n, h) in the hash index, or the free one it would take......*/
+unsigned State::find_(char const *n, EvtHndlr h, unsigned short *id) {
+    unsigned i = hndlrHash(n, h);
+    for (;;) {
+        *id = hndlrSlot[i].load(std::memory_order_acquire);
+        if (*id == 0 || (hndlrs[*id - 1] == h && names[*id - 1] == n)) {
+            return i;
+        }
+        i = (i + 1) & (HNDLR_SLOTS - 1);
+    }
+}
+
+/* look up or append a handler entry, shared by all instances..............*/
+unsigned short State::reg_(char const *n, EvtHndlr h) {
+    unsigned short id;
+    find_(n, h, &id);
+    if (id != 0) {
+        return (unsigned short)(id - 1);
+    }
+    std::lock_guard<std::mutex> lock(hndlrLock);
+    unsigned slot = find_(n, h, &id);
+    if (id != 0) {                                       /* raced with us */
+        return (unsigned short)(id - 1);
+    }
+    assert(nHndlrs < HSM_MAX_HANDLERS);
+    hndlrs[nHndlrs] = h;
+    names[nHndlrs] = n;
+    hndlrSlot[slot].store((unsigned short)(++nHndlrs),
+                          std::memory_order_release);
+    return (unsigned short)(nHndlrs - 1);
+}
 
 /* State Ctor...............................................................*/
 State::State(char const *n, State *s, EvtHndlr h)
-        : name(n), super(s), hndlr(h)
-{}
+        : super(0), id(reg_(n, h))
+{
+    if (s) {
+        long d = (char *)s - (char *)this;
+        assert(d != 0 && -32768 <= d && d <= 32767);      /* same machine */
+        super = (short)d;
+    }
+}
+
+HsmTopo const Hsm::dynTopo_ = { 0, State::hndlrs, State::names, 0 };
+std::atomic<HsmTracer> Hsm::tracer(0);
+std::atomic<HsmTimer> Hsm::timer(0);
+
+void Hsm::hookEntry_(State const *s) {
+    HSM_PROBE2(entry, name, getStateName(s));
+    HsmTracer const traced = tracer.load(std::memory_order_acquire);
+    if (traced) {
+        (*traced)(this, s, HSM_TRACE_ENTRY, ENTRY_EVT);
+    }
+}
+
+void Hsm::hookExit_(State const *s) {
+    HSM_PROBE2(exit, name, getStateName(s));
+    HsmTracer const traced = tracer.load(std::memory_order_acquire);
+    if (traced) {
+        (*traced)(this, s, HSM_TRACE_EXIT, EXIT_EVT);
+    }
+}
+
+void Hsm::enter_(State const *s) {
+    hookEntry_(s);
+    call_(s, &entryMsg_);
+}
+
+void Hsm::leave_(State const *s) {
+    hookExit_(s);
+    call_(s, &exitMsg_);
+}
+
+void Hsm::start_() {
+    while (call_(curr, &startMsg_), next) {
+        enterNext_();
+    }
+}
 
 /* Hsm Ctor.................................................................*/
 Hsm::Hsm(char const *n, EvtHndlr topHndlr)
-        : top("top", 0, topHndlr), name(n) 
+        : hndlrs(State::hndlrs), topo(&dynTopo_), name(n),
+          top("top", 0, topHndlr)
+{}
+
+/* nothing to build: states, handlers and names are read-only data.........*/
+Hsm::Hsm(char const *n, HsmTopo const *t)
+        : hndlrs(t->hndlrs), topo(t), name(n), top(0, HSM_NO_SUPER)
 {}
 
 /* enter and start the top state............................................*/
 void Hsm::onStart() {
-    curr = &top;
+    curr = topo->states ? &topo->states[0] : &top;
     next = 0;
-    curr->onEvent(this, &entryMsg);
-    while (curr->onEvent(this, &startMsg), next) {
-        State *entryPath[MAX_STATE_NESTING];
-        register State **trace = entryPath;
-        register State *s;
-        *trace = 0;
-        for (s = next; s != curr; s = s->super) {
-            *(++trace) = s;                         /* trace path to target */
-        }
-        while (s = *trace--) {                 /* retrace entry from source */
-            s->onEvent(this, &entryMsg);
-        }
-        curr = next;
-        next = 0;
-    }
+    enter_(curr);
+    start_();
 }
 
 /* state machine "engine"...................................................*/
-void Hsm::onEvent(Msg const *msg) {
-    State *entryPath[MAX_STATE_NESTING];
-    register State **trace;
-    register State *s;
-    for (s = curr; s; s = s->super) {
+Msg const *Hsm::onEvent(Msg const *msg) {
+    register State const *s;
+    HSM_PROBE3I(dispatch, name, getStateName(curr), msg->evt);
+    HsmTracer const traced = tracer.load(std::memory_order_acquire);
+    if (traced) {
+        (*traced)(this, curr, HSM_TRACE_DISPATCH, msg->evt);
+    }
+    HsmTimer const timed = timer.load(std::memory_order_acquire);
+    Event const evt = msg->evt;
+    unsigned long long const t0 = timed ? hdrTicks() : 0;
+    for (s = curr; s; s = s->getSuper()) {
         source = s;                     /* level of outermost event handler */
-        msg = s->onEvent(this, msg);
+        msg = call_(s, msg);
         if (msg == 0) {                                       /* processed? */
             if (next) {                          /* state transition taken? */
-                trace = entryPath;
-                *trace = 0;
-                for (s = next; s != curr; s = s->super) {
-                    *(++trace) = s;                 /* trace path to target */
-                }
-                while (s = *trace--) {            /* retrace entry from LCA */
-                    s->onEvent(this, &entryMsg);
-                }
-                curr = next;
-                next = 0;
-                while (curr->onEvent(this, &startMsg), next) {
-                    trace = entryPath;
-                    *trace = 0;
-                    for (s = next; s != curr; s = s->super) {
-                        *(++trace) = s; /* record path to target */
-                    }
-                    while (s = *trace--) { /* retrace the entry */
-                        s->onEvent(this, &entryMsg);
-                    }
-                    curr = next;
-                    next = 0;
-                }
+                HSM_PROBE3(tran, name, getStateName(source),
+                           getStateName(next));
+                enterNext_();                   /* exited up to the LCA */
+                start_();
             }
             break; /* event processed */
         }
     }
+    if (timed) {                       /* source: the handler, or top */
+        (*timed)(this, source, evt, hdrTicks() - t0);
+    }
+    HSM_PROBE3I(done, name, getStateName(curr), msg == 0);
+    return msg;                        /* 0 if processed, else unhandled */
 }
 
 /* exit current states and all superstates up to LCA .......................*/
 void Hsm::exit_(unsigned char toLca) {
-    register State *s = curr;
+    register State const *s = curr;
     while (s != source) {
-        s->onEvent(this, &exitMsg);
-        s = s->super;   
+        leave_(s);
+        s = s->getSuper();   
     }
     while (toLca--) {
-        s->onEvent(this, &exitMsg);
-        s = s->super;
+        leave_(s);
+        s = s->getSuper();
     }
     curr = s;
 }
@@ -119,14 +202,14 @@ state machine objects. For this reason
 it  can  be  stored  in  a  static variable
 shared by all instances. 
 */
-unsigned char Hsm::toLCA_(State *target) {
-    State *s, *t;
+unsigned char Hsm::toLCA_(State const *target) {
+    State const *s, *t;
     unsigned char toLca = 0;
     if (source == target) {
         return 1;
     }
-    for (s = source; s; ++toLca, s = s->super) {
-        for (t = target; t; t = t->super) {
+    for (s = source; s; ++toLca, s = s->getSuper()) {
+        for (t = target; t; t = t->getSuper()) {
             if (s == t) {
                 return toLca;
             }
@@ -2,45 +2,132 @@
 #ifndef hsm_h
 #define hsm_h
 
+#include <assert.h>
+#include <atomic>
+
 typedef int Event;
 struct Msg {
     Event evt;
     /* here, additional string messages could be written */
 };
 
+struct CountMsg : public Msg {     /* an event that stands for N of them */
+    unsigned long count;
+};
+
 class Hsm; /* forward declaration */
 typedef Msg const *(Hsm::*EvtHndlr)(Msg const *);
 
+#define HSM_MAX_HANDLERS 1024        /* distinct (handler, name) pairs */
+#define HSM_NO_SUPER     0xFFFF           /* superId of a constant top */
+#define HSM_CACHE_LINE   64          /* bytes, for alignment and padding */
+#define HSM_MAX_NESTING  8            /* states entered by one transition */
+
+/* A State is 4 bytes: the superstate as a 16-bit offset from the State
+ * itself (states are members of one machine object, so the offset holds
+ * after the machine is copied) and a 16-bit index into the handler table.
+ * All instances of a class share the handler entries, which are appended
+ * contiguously when the first instance is built; later instances find
+ * theirs through a hash index. The table is process-wide and holds
+ * HSM_MAX_HANDLERS entries. Names are kept apart in a cold table that
+ * only debugging output reads.
+ *
+ * A class can instead define its topology as constant data, see HsmTopo:
+ * states[i] is then built by the constexpr State(i, superId) and nothing
+ * is constructed or registered per instance.
+ */
 class State {
-    State *super;                                  /* pointer to superstate */
-    EvtHndlr hndlr;                             /* state's handler function */
-    char const *name;
+    short super;             /* offset of superstate from this, 0 for none */
+    unsigned short id;                /* index of handler and name tables */
+
+    static EvtHndlr hndlrs[HSM_MAX_HANDLERS];                      /* hot */
+    static char const *names[HSM_MAX_HANDLERS];                   /* cold */
   public:
     State(char const *name, State *super, EvtHndlr hndlr);
+    constexpr State(unsigned short i, unsigned short superId)
+            : super(superId == HSM_NO_SUPER ? 0
+                    : (short)(((int)superId - (int)i) * (int)sizeof(State))),
+              id(i)
+    {}
   private:
-    Msg const *onEvent(Hsm *ctx, Msg const *msg) {
-        return (ctx->*hndlr)(msg);
+    State const *getSuper() const {
+        return super ? (State const *)((char const *)this + super) : 0;
     }
+    static unsigned short reg_(char const *name, EvtHndlr hndlr);
+    static unsigned find_(char const *name, EvtHndlr hndlr,
+                          unsigned short *id);
     friend class Hsm;
+    friend class Explorer;
+    friend class StatusHsm;
+    friend class SubHsm;
+    friend class Introspect;
+};
+
+enum HsmTraceKind { HSM_TRACE_DISPATCH, HSM_TRACE_ENTRY, HSM_TRACE_EXIT };
+typedef void (*HsmTracer)(Hsm const *me, State const *s, int kind,
+                          Event evt);
+typedef void (*HsmTimer)(Hsm const *me, State const *handler, Event evt,
+                         unsigned long long ticks);          /* hdrTicks() */
+
+struct HsmTopo {        /* read-only topology shared by all instances */
+    State const *states;                       /* states[i] has id i */
+    EvtHndlr const *hndlrs;                              /* hot, by id */
+    char const *const *names;                           /* cold, by id */
+    unsigned short nStates;
 };
 
 class Hsm {                        /* Hierarchical State Machine base class */
+    /* what every dispatch writes comes first, on the instance's first
+       cache line; see HsmAligned for starting that on a line of its own */
+    State const *curr;                                     /* current state */
+protected:
+    State const *next;            /* next state (non 0 if transition taken) */
+    State const *source;             /* source state during last transition */
+private:
+    EvtHndlr const *hndlrs;                 /* handler of each State id */
+    HsmTopo const *topo;
     char const *name;                             /* pointer to static name */
-    State *curr;                                           /* current state */
+    static HsmTopo const dynTopo_;       /* states built per instance */
 protected:
-    State *next;                  /* next state (non 0 if transition taken) */
-    State *source;                   /* source state during last transition */
     State top;                                     /* top-most state object */
+    static Msg const startMsg_, entryMsg_, exitMsg_;     /* engine events */
 public:
     Hsm(char const *name, EvtHndlr topHndlr);                       /* Ctor */
+    Hsm(char const *name, HsmTopo const *topo);    /* constant topology */
     void onStart();                        /* enter and start the top state */
-    void onEvent(Msg const *msg);                 /* "state machine engine" */
+    Msg const *onEvent(Msg const *msg);  /* engine, msg back if unhandled */
+    /* every machine reports to the tracer and times each dispatch with
+       the timer, 0 if none; hooks are swapped atomically while machines
+       run, and each hook call loads the pointer once */
+    static std::atomic<HsmTracer> tracer;
+    static std::atomic<HsmTimer> timer;
+    char const *getName() const { return name; }
+    char const *getStateName(State const *s) const {
+        return topo->names[s->id];
+    }
+    bool isTop(State const *s) const { return s->super == 0; }  /* onStart */
 protected:
-    unsigned char toLCA_(State *target);
+    Msg const *call_(State const *s, Msg const *msg) {
+        return (this->*hndlrs[s->id])(msg);
+    }
+    unsigned char toLCA_(State const *target);
     void exit_(unsigned char toLca);
-    State *STATE_CURR() { return curr; }
+    /* the steps of the engine, for engines of derived classes: hookEntry_()
+       and hookExit_() are the probe and the tracer call of an entry or an
+       exit, enter_() and leave_() add the handler call */
+    void hookEntry_(State const *s);
+    void hookExit_(State const *s);
+    void enter_(State const *s);
+    void leave_(State const *s);
+    template<class Enter>
+    void enterNext_(Enter const &enter);  /* curr down to next, enter(s) */
+    void enterNext_() {
+        enterNext_([this](State const *s) { enter_(s); });
+    }
+    void start_();            /* initial transitions of curr, till none */
+    State const *STATE_CURR() { return curr; }
     /* STATE_START() (inline member function in C++) handles start transitions (transitions originating from a “black dot”     pseudostate). */
-    void STATE_START(State *target) {
+    void STATE_START(State const *target) {
         assert(next == 0);
         next = target;
     }
@@ -61,8 +148,78 @@ protected:
     exit_(toLca_); \
     next = (target_); \
 } else ((void)0)
+
+    friend class Explorer;              /* snapshots curr, see explore.h */
+    friend class Snapshot;              /* encodes curr, see snapshot.h */
+    friend class Sim;                   /* traces curr, see sim.h */
+    friend class StatusHsm;             /* runs the states, threaded.h */
+    friend class SubHsm;                /* enters at a state, submachine.h */
+    friend class Introspect;            /* reads curr, see introspect.h */
 }; 
 
+/* A machine of class M that starts on a cache line and is padded to whole
+ * lines, so that machines dispatched by different threads never share a
+ * line, whatever extended state M appends: HsmAligned<Watch> w[4], or
+ * new HsmAligned<Watch>[n]. Single-threaded fleets are better off packed.
+ */
+template<class M>
+class alignas(HSM_CACHE_LINE) HsmAligned : public M {
+public:
+    using M::M;
+};
+
+/* One hook in the chain on Hsm::tracer or Hsm::timer, for modules that
+ * install fn while machines run: install() puts fn in front of the hook
+ * it finds, which fn passes each call on to through next(). remove()
+ * puts that hook back, unless another one was installed over fn since;
+ * fn then stays in the chain and passes calls on, and a later install()
+ * finds it still there. The chained hook is atomic because a dispatch
+ * that loaded fn before remove() may call it after the next install().
+ * install() and remove() are for one controlling thread at a time.
+ */
+template<class F>
+class HsmHook {
+    std::atomic<F> *slot;                   /* &Hsm::tracer or &Hsm::timer */
+    F fn;
+    std::atomic<F> chained;                        /* hook fn passes on to */
+    bool hooked;                          /* fn is in the chain on slot */
+public:
+    constexpr HsmHook(std::atomic<F> *s, F f)
+            : slot(s), fn(f), chained(0), hooked(false) {}
+    F next() const { return chained.load(std::memory_order_acquire); }
+    void install() {
+        F t = slot->load();
+        while (!hooked) {                     /* chain first, then publish */
+            chained.store(t);
+            hooked = slot->compare_exchange_weak(t, fn);
+        }
+    }
+    void remove() {
+        F t = fn;
+        if (hooked) {                      /* unless hooked over since */
+            hooked = !slot->compare_exchange_strong(t, next());
+        }
+    }
+};
+
+/* enter from curr down to next, which becomes curr.........................*/
+template<class Enter>
+void Hsm::enterNext_(Enter const &enter) {
+    State const *entryPath[HSM_MAX_NESTING + 1];
+    State const **trace = entryPath;
+    State const *s;
+    *trace = 0;
+    for (s = next; s != curr; s = s->getSuper()) {     /* path to target */
+        assert(s != 0 && trace < entryPath + HSM_MAX_NESTING);
+        *(++trace) = s;
+    }
+    while ((s = *trace--) != 0) {            /* retrace entry from source */
+        enter(s);
+    }
+    curr = next;
+    next = 0;
+}
+
 #define START_EVT ((Event)(-1))
 #define ENTRY_EVT ((Event)(-2))
 #define EXIT_EVT  ((Event)(-3))
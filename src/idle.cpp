@@ -0,0 +1,75 @@
+/** idle.cpp -- how a dispatch thread waits when its queues run dry
+ */
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "idle.h"
+
+static double nsPerTick() {            /* calibrated once per process */
+    static double const r = hdrNsPerTick(10);
+    return r;
+}
+
+/* Idle Ctor................................................................*/
+Idle::Idle(IdleStrategy s, unsigned spinNs)
+        : strategy(s), maxSpinNs(spinNs), calibrated(false), maxSpin(0),
+          minSpin(0), avgGap(0), spin(0), nWaits(0), nSpun(0), nYields(0),
+          nParks(0), sleeping(0)
+{}
+
+void Idle::set(IdleStrategy s, unsigned spinNs) {
+    strategy = s;
+    maxSpinNs = spinNs;
+    calibrated = false;
+    avgGap = 0;
+}
+
+IdleStats Idle::stats() const {
+    IdleStats st;
+    st.waits = nWaits.load(std::memory_order_relaxed);
+    st.spun = nSpun.load(std::memory_order_relaxed);
+    st.yields = nYields.load(std::memory_order_relaxed);
+    st.parks = nParks.load(std::memory_order_relaxed);
+    st.spinNs = (unsigned)(spin.load(std::memory_order_relaxed)
+                           * nsPerTick());
+    return st;
+}
+
+void Idle::calibrate() {
+    double r = nsPerTick();
+    unsigned maxNs = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? maxSpinNs : 0;
+    unsigned minNs = maxNs < IDLE_MIN_SPIN_NS ? maxNs : IDLE_MIN_SPIN_NS;
+    maxSpin = (unsigned long long)(maxNs / r);
+    minSpin = (unsigned long long)(minNs / r);
+    spin.store(minSpin, std::memory_order_relaxed);   /* till gaps are seen */
+    calibrated = true;
+}
+
+/* fold a gap into the average, poll twice the average if that pays.......*/
+void Idle::adapt_(unsigned long long gap) {
+    if (gap > 4 * maxSpin) {            /* one long pause must not linger */
+        gap = 4 * maxSpin;
+    }
+    if (avgGap == 0) {
+        avgGap = gap << IDLE_AVG_SHIFT;
+    }
+    else {
+        avgGap += gap - (avgGap >> IDLE_AVG_SHIFT);
+    }
+    unsigned long long avg = avgGap >> IDLE_AVG_SHIFT;
+    unsigned long long s = minSpin;
+    if (avg <= maxSpin) {
+        s = 2 * avg < maxSpin ? 2 * avg : maxSpin;
+        s = s > minSpin ? s : minSpin;
+    }
+    spin.store(s, std::memory_order_relaxed);
+}
+
+void Idle::park_() {
+    nParks.fetch_add(1, std::memory_order_relaxed);
+    syscall(SYS_futex, (unsigned *)&sleeping, FUTEX_WAIT_PRIVATE, 1, 0, 0, 0);
+}
+
+void Idle::unpark_() {
+    syscall(SYS_futex, (unsigned *)&sleeping, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+}
@@ -0,0 +1,119 @@
+/** idle.h -- how a dispatch thread waits when its queues run dry
+ *
+ * A thread that consumes events either burns its core polling for the
+ * next one or sleeps and pays a wake-up on every event. An Idle sits in
+ * between, per consumer thread, with one of three strategies:
+ *
+ *   IDLE_SPIN    poll until work shows up, never leave the CPU
+ *   IDLE_YIELD   poll for a while, then sched_yield() between polls
+ *   IDLE_PARK    poll for a while, then sleep on a futex until woken
+ *
+ * The while adapts. The consumer keeps a moving average of how long it
+ * waited for work, the inter-arrival gap as it sees it. When the average
+ * is below the spin limit it polls for twice the average, which catches
+ * most events of a steady stream without a syscall on either side. When
+ * events come further apart than the limit, polling would only burn the
+ * CPU, so it polls IDLE_MIN_SPIN_NS and gives up. On a single CPU no
+ * producer can run while the consumer polls, so there IDLE_YIELD and
+ * IDLE_PARK do not poll at all.
+ *
+ * The consumer calls wait() with a predicate that is true when there is
+ * work, or when the thread should stop. Producers call wake() after they
+ * made work visible. It costs a load unless the consumer is parked, and
+ * only then a FUTEX_WAKE.
+ */
+#ifndef idle_h
+#define idle_h
+
+#include <assert.h>
+#include <sched.h>
+#include <atomic>
+#include "hdr.h"
+#include "hsm.h"
+
+#define IDLE_SPIN_NS     50000       /* default spin limit, before parking */
+#define IDLE_MIN_SPIN_NS 1000              /* spin when gaps are longer */
+#define IDLE_AVG_SHIFT   3                /* moving average over ~8 waits */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IDLE_PAUSE() _mm_pause()
+#else
+#define IDLE_PAUSE() ((void)0)
+#endif
+
+enum IdleStrategy { IDLE_SPIN, IDLE_YIELD, IDLE_PARK };
+
+struct IdleStats {                          /* counted by the consumer */
+    unsigned long waits;                               /* wait() calls */
+    unsigned long spun;                /* of them, ended while polling */
+    unsigned long yields;                        /* sched_yield() calls */
+    unsigned long parks;                             /* FUTEX_WAIT calls */
+    unsigned spinNs;                         /* the spin limit right now */
+};
+
+class Idle {
+    IdleStrategy strategy;
+    unsigned maxSpinNs;
+    bool calibrated;                        /* tick limits from the ns */
+    unsigned long long maxSpin, minSpin;              /* in hdrTicks() */
+    unsigned long long avgGap;       /* ticks, << IDLE_AVG_SHIFT, 0: none */
+    std::atomic<unsigned long long> spin;      /* poll this long, ticks */
+    std::atomic<unsigned long> nWaits, nSpun, nYields, nParks;
+    alignas(HSM_CACHE_LINE)                 /* producers read and clear */
+    std::atomic<unsigned> sleeping;           /* consumer parked on futex */
+
+    void adapt_(unsigned long long gap);
+    void park_();
+    void unpark_();
+public:
+    explicit Idle(IdleStrategy s = IDLE_PARK,
+                  unsigned spinNs = IDLE_SPIN_NS);
+    void set(IdleStrategy s,
+             unsigned spinNs = IDLE_SPIN_NS);          /* while not waiting */
+    IdleStrategy getStrategy() const { return strategy; }
+    IdleStats stats() const;
+    void calibrate();        /* before the first wait(), else it pays 10ms */
+
+    template<class Ready>
+    void wait(Ready const &ready);                    /* consumer thread */
+    void wake() {                           /* any thread, after posting */
+        if (sleeping.load() != 0 && sleeping.exchange(0) != 0) {
+            unpark_();
+        }
+    }
+};
+
+/* return once ready() holds, polling, yielding or parked till then........*/
+template<class Ready>
+void Idle::wait(Ready const &ready) {
+    if (!calibrated) {
+        calibrate();
+    }
+    unsigned long long t0 = hdrTicks();
+    unsigned long long limit = spin.load(std::memory_order_relaxed);
+    bool polled = true;
+    while (!ready()) {
+        if (strategy == IDLE_SPIN || hdrTicks() - t0 < limit) {
+            IDLE_PAUSE();
+            continue;
+        }
+        polled = false;
+        if (strategy == IDLE_YIELD) {
+            nYields.fetch_add(1, std::memory_order_relaxed);
+            sched_yield();
+            continue;
+        }
+        sleeping.store(1);               /* wake() clears it before waking */
+        if (!ready()) {
+            park_();
+        }
+        sleeping.store(0);
+    }
+    nWaits.fetch_add(1, std::memory_order_relaxed);
+    if (polled) {
+        nSpun.fetch_add(1, std::memory_order_relaxed);
+    }
+    adapt_(hdrTicks() - t0);
+}
+
+#endif /* idle_h */
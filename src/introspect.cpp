@@ -0,0 +1,424 @@
+/** introspect.cpp -- live view of running machines over a Unix socket
+ */
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <vector>
+#include "introspect.h"
+#include "epoch.h"
+
+struct IntroCount {              /* events in one state of one machine */
+    std::atomic<bool> used;
+    char const *machine, *state;
+    std::atomic<unsigned long> n;
+};
+
+struct IntroBuf {                        /* counters of one thread */
+    std::atomic<bool> owned;              /* a live thread counts here */
+    IntroBuf *next;                                   /* all tables, ever */
+    IntroCount count[INTRO_MAX_STATES];
+};
+
+struct IntroOwner {      /* hands the table back when its thread exits */
+    IntroBuf *buf;
+    ~IntroOwner() {
+        if (buf) {
+            buf->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+struct IntroOut {                         /* buffered reply to a client */
+    int fd;
+    size_t n;
+    char buf[4096];
+
+    explicit IntroOut(int f) : fd(f), n(0) {}
+    ~IntroOut() { flush(); }
+    void flush() {
+        if (n != 0) {
+            (void)send(fd, buf, n, MSG_NOSIGNAL);     /* a gone client: drop */
+            n = 0;
+        }
+    }
+    void line(char const *fmt, ...) {
+        va_list ap;
+        if (sizeof(buf) - n < INTRO_LINE * 2) {
+            flush();
+        }
+        va_start(ap, fmt);
+        int k = vsnprintf(buf + n, sizeof(buf) - n, fmt, ap);
+        va_end(ap);
+        n += k < 0 ? 0 : std::min((size_t)k, sizeof(buf) - n - 1);
+    }
+};
+
+std::atomic<Introspect *> Introspect::current(0);
+HsmHook<HsmTracer> Introspect::hook(&Hsm::tracer, &Introspect::record);
+
+static std::atomic<IntroBuf *> bufs(0);
+static thread_local IntroOwner myBuf;
+static std::atomic<unsigned long> nDropped(0);
+
+static unsigned long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* table of the calling thread, recycled from exited threads if possible...*/
+static IntroBuf *threadBuf() {
+    for (IntroBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        bool free = false;
+        if (b->owned.compare_exchange_strong(free, true,
+                                             std::memory_order_acquire)) {
+            return b;
+        }
+    }
+    IntroBuf *b = new IntroBuf();                              /* all zero */
+    b->owned.store(true, std::memory_order_relaxed);
+    b->next = bufs.load(std::memory_order_relaxed);
+    while (!bufs.compare_exchange_weak(b->next, b,
+                                       std::memory_order_release)) {
+    }
+    return b;
+}
+
+/* one more event in (machine, state), claimed on first use................*/
+static void count(char const *machine, char const *state) {
+    IntroBuf *b = myBuf.buf;
+    if (b == 0) {
+        b = myBuf.buf = threadBuf();
+    }
+    size_t x = ((size_t)machine ^ (size_t)state) * 0x9E3779B97F4A7C15ULL;
+    unsigned i = (unsigned)(x >> 32);
+    for (unsigned probe = 0; probe < INTRO_MAX_STATES; ++probe, ++i) {
+        IntroCount *c = &b->count[i & (INTRO_MAX_STATES - 1)];
+        if (!c->used.load(std::memory_order_relaxed)) {       /* ours alone */
+            c->machine = machine;
+            c->state = state;
+            c->used.store(true, std::memory_order_release);
+        }
+        else if (c->machine != machine || c->state != state) {
+            continue;
+        }
+        c->n.store(c->n.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+        return;
+    }
+    nDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Introspect Ctor..........................................................*/
+Introspect::Introspect(unsigned maxMachines)
+        : nSlots(0), maxSlots(maxMachines), head(0), listenFd(-1)
+{
+    unsigned size = 16;
+    while (size < 2 * maxMachines) {
+        size *= 2;
+    }
+    slots = new IntroSlot[maxMachines]();
+    byHsm = new IntroSlot *[size]();
+    mask = size - 1;
+    wakeFd[0] = wakeFd[1] = -1;
+    path[0] = '\0';
+}
+
+Introspect::~Introspect() {
+    stop();
+    delete[] byHsm;
+    delete[] slots;
+}
+
+IntroSlot *Introspect::find_(Hsm const *me) const {
+    size_t x = (size_t)me * 0x9E3779B97F4A7C15ULL;
+    for (unsigned i = (unsigned)(x >> 32) & mask; byHsm[i];
+         i = (i + 1) & mask) {
+        if (byHsm[i]->hsm == me) {
+            return byHsm[i];
+        }
+    }
+    return 0;
+}
+
+/* a started machine, before start()........................................*/
+int Introspect::add(Hsm *hsm) {
+    assert(!server.joinable() && find_(hsm) == 0);
+    if (nSlots == maxSlots) {
+        return -1;
+    }
+    IntroSlot *s = &slots[nSlots];
+    s->hsm = hsm;
+    s->curr.store(hsm->curr, std::memory_order_relaxed);
+    size_t x = (size_t)hsm * 0x9E3779B97F4A7C15ULL;
+    unsigned i = (unsigned)(x >> 32) & mask;
+    while (byHsm[i]) {
+        i = (i + 1) & mask;
+    }
+    byHsm[i] = s;
+    return (int)nSlots++;
+}
+
+void Introspect::history(int idx, State const *const *slot) {
+    assert(!server.joinable() && 0 <= idx && (unsigned)idx < nSlots);
+    IntroSlot *s = &slots[idx];
+    assert(s->nHist < INTRO_MAX_HIST);
+    s->hist[s->nHist].store(*slot, std::memory_order_relaxed);
+    s->histOf[s->nHist++] = slot;
+}
+
+/* hot path, in the dispatching thread: publish under the seqlock..........*/
+void Introspect::record(Hsm const *me, State const *s, int kind, Event evt) {
+    HsmTracer const next = hook.next();
+    if (next) {
+        (*next)(me, s, kind, evt);
+    }
+    EpochGuard guard;                     /* stop() waits for us to leave */
+    Introspect *in = current.load(std::memory_order_acquire);
+    if (in == 0) {
+        return;
+    }
+    IntroSlot *sl = in->find_(me);
+    if (sl == 0) {
+        return;
+    }
+    unsigned q = sl->seq.load(std::memory_order_relaxed);
+    sl->seq.store(q + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sl->curr.store(kind == HSM_TRACE_EXIT ? s->getSuper() : s,
+                   std::memory_order_relaxed);
+    for (unsigned i = 0; i < sl->nHist; ++i) {
+        sl->hist[i].store(*sl->histOf[i], std::memory_order_relaxed);
+    }
+    if (kind == HSM_TRACE_DISPATCH) {
+        sl->events.store(sl->events.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    }
+    sl->seq.store(q + 2, std::memory_order_release);
+    if (kind != HSM_TRACE_DISPATCH) {
+        return;
+    }
+    char const *st = me->getStateName(s);
+    count(me->getName(), st);
+    unsigned left = sl->sample.load(std::memory_order_relaxed);
+    if (left != 0 && sl->sample.compare_exchange_strong(left, left - 1)) {
+        unsigned long h = in->head.load(std::memory_order_relaxed);
+        IntroSample *e = &in->ring[h & (INTRO_SAMPLES - 1)];
+        e->ts = nowNs();
+        e->state = st;
+        e->evt = evt;
+        in->head.store(h + 1, std::memory_order_release);
+    }
+}
+
+void Introspect::read(unsigned idx, State const **curr, State const **hist,
+                      unsigned long *events) const
+{
+    IntroSlot const *s = &slots[idx];
+    unsigned q;
+    do {
+        while ((q = s->seq.load(std::memory_order_acquire)) & 1) {
+        }
+        *curr = s->curr.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < s->nHist; ++i) {
+            hist[i] = s->hist[i].load(std::memory_order_relaxed);
+        }
+        *events = s->events.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (s->seq.load(std::memory_order_relaxed) != q);
+}
+
+bool Introspect::start(char const *socketPath) {
+    sockaddr_un a;
+    Introspect *none = 0;
+    if (strlen(socketPath) >= sizeof(a.sun_path)
+        || !current.compare_exchange_strong(none, this))
+    {
+        return false;
+    }
+    memset(&a, 0, sizeof(a));
+    a.sun_family = AF_UNIX;
+    strcpy(a.sun_path, socketPath);
+    unlink(socketPath);
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, (sockaddr *)&a, sizeof(a)) != 0
+        || listen(listenFd, 4) != 0 || pipe(wakeFd) != 0)
+    {
+        if (listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        current.store(0);
+        Epoch::barrier();                /* a stale hook may have seen us */
+        return false;
+    }
+    strcpy(path, socketPath);
+    hook.install();
+    server = std::thread(&Introspect::serve_, this);
+    return true;
+}
+
+void Introspect::stop() {
+    if (!server.joinable()) {
+        return;
+    }
+    hook.remove();
+    current.store(0);
+    Epoch::barrier();                 /* no record() still reads this */
+    (void)!write(wakeFd[1], "", 1);
+    server.join();
+    close(listenFd);
+    close(wakeFd[0]);
+    close(wakeFd[1]);
+    listenFd = wakeFd[0] = wakeFd[1] = -1;
+    unlink(path);
+}
+
+/* the server thread: one client at a time, until stop()...................*/
+void Introspect::serve_() {
+    for (;;) {
+        pollfd p[2] = { { listenFd, POLLIN, 0 }, { wakeFd[0], POLLIN, 0 } };
+        if (poll(p, 2, -1) < 0) {
+            continue;                                        /* EINTR */
+        }
+        if (p[1].revents) {
+            return;
+        }
+        int fd = accept4(listenFd, 0, 0, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            session_(fd);
+            close(fd);
+        }
+    }
+}
+
+void Introspect::session_(int fd) {
+    char line[INTRO_LINE];
+    size_t n = 0;
+    for (;;) {
+        pollfd p[2] = { { fd, POLLIN, 0 }, { wakeFd[0], POLLIN, 0 } };
+        if (poll(p, 2, -1) < 0) {
+            continue;
+        }
+        if (p[1].revents) {
+            return;                              /* stop(), serve_ sees it */
+        }
+        ssize_t k = recv(fd, line + n, sizeof(line) - 1 - n, 0);
+        if (k <= 0) {
+            return;
+        }
+        n += (size_t)k;
+        char *nl;
+        while ((nl = (char *)memchr(line, '\n', n)) != 0) {
+            *nl = '\0';
+            unsigned idx, cnt, ms = 1000;
+            if (strcmp(line, "list") == 0) {
+                list_(fd);
+            }
+            else if (strcmp(line, "counters") == 0) {
+                counters_(fd);
+            }
+            else if (sscanf(line, "sample %u %u %u", &idx, &cnt, &ms) >= 2) {
+                sample_(fd, idx, cnt, ms);
+            }
+            else {
+                IntroOut o(fd);
+                if (strcmp(line, "help") != 0) {
+                    o.line("error: %s\n", line);
+                }
+                o.line("list\ncounters\nsample idx n [ms]\nhelp\n.\n");
+            }
+            n -= (size_t)(nl + 1 - line);
+            memmove(line, nl + 1, n);
+        }
+        if (n == sizeof(line) - 1) {                     /* no newline */
+            n = 0;
+        }
+    }
+}
+
+void Introspect::list_(int fd) {
+    IntroOut o(fd);
+    for (unsigned i = 0; i < nSlots; ++i) {
+        State const *curr, *hist[INTRO_MAX_HIST];
+        unsigned long events;
+        Hsm const *m = slots[i].hsm;
+        read(i, &curr, hist, &events);
+        o.line("%u %s %s", i, m->getName(),
+               curr ? m->getStateName(curr) : "-");
+        for (unsigned h = 0; h < slots[i].nHist; ++h) {
+            o.line(" %s", hist[h] ? m->getStateName(hist[h]) : "-");
+        }
+        o.line(" %lu\n", events);
+    }
+    o.line(".\n");
+}
+
+void Introspect::counters_(int fd) {
+    std::vector<IntroCount const *> all;
+    for (IntroBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        for (IntroCount const &c : b->count) {
+            if (c.used.load(std::memory_order_acquire)) {
+                all.push_back(&c);
+            }
+        }
+    }
+    std::sort(all.begin(), all.end(),
+              [](IntroCount const *a, IntroCount const *b) {
+                  int c = strcmp(a->machine, b->machine);
+                  return c ? c < 0 : strcmp(a->state, b->state) < 0;
+              });
+    IntroOut o(fd);
+    for (size_t i = 0; i < all.size(); ) {        /* sum over the threads */
+        unsigned long n = 0;
+        size_t j = i;
+        for (; j < all.size() && strcmp(all[j]->machine, all[i]->machine) == 0
+               && strcmp(all[j]->state, all[i]->state) == 0; ++j) {
+            n += all[j]->n.load(std::memory_order_relaxed);
+        }
+        o.line("%s %s %lu\n", all[i]->machine, all[i]->state, n);
+        i = j;
+    }
+    if (nDropped.load() != 0) {
+        o.line("dropped %lu\n", nDropped.load());
+    }
+    o.line(".\n");
+}
+
+/* stream the next n events of one machine, or what came within ms.........*/
+void Introspect::sample_(int fd, unsigned idx, unsigned n, unsigned ms) {
+    IntroOut o(fd);
+    if (idx >= nSlots) {
+        o.line("error: no machine %u\n.\n", idx);
+        return;
+    }
+    n = std::min(n, (unsigned)INTRO_SAMPLES);          /* never lapped */
+    IntroSlot *s = &slots[idx];
+    unsigned long from = head.load(std::memory_order_acquire), got = 0;
+    unsigned long long t0 = 0, end = nowNs() + ms * 1000000ULL;
+    s->sample.store(n, std::memory_order_release);
+    while (got < n && nowNs() < end) {
+        unsigned long h = head.load(std::memory_order_acquire);
+        for (; from + got < h && got < n; ++got) {
+            IntroSample const *e = &ring[(from + got) & (INTRO_SAMPLES - 1)];
+            if (t0 == 0) {
+                t0 = e->ts;
+            }
+            o.line("%llu %d %s\n", e->ts - t0, e->evt, e->state);
+        }
+        o.flush();
+        pollfd p = { wakeFd[0], POLLIN, 0 };
+        if (got < n && poll(&p, 1, 1) > 0) {
+            break;                                             /* stop() */
+        }
+    }
+    s->sample.store(0, std::memory_order_relaxed);
+    o.line(".\n");
+}
@@ -0,0 +1,100 @@
+/** introspect.h -- live view of running machines over a Unix socket
+ *
+ * Introspect::start() hooks Hsm::tracer and serves a text protocol on a
+ * Unix domain stream socket, one client at a time, from a thread of its
+ * own. Each request is one line. Each reply is some lines, then a line
+ * holding only ".":
+ *
+ *   list                 idx machine state [history...] events, per machine
+ *   counters             machine state events, events dispatched per state
+ *   sample idx n [ms]    the next n events of machine idx as they happen:
+ *                        ns-since-first signal state; stops after ms
+ *                        (default 1000)
+ *   help
+ *
+ * Try it with "socat - UNIX-CONNECT:<path>" or bench/introspect.
+ *
+ * Dispatch is never blocked. The hook runs in the dispatching thread.
+ * It publishes the machine's current state, its registered history slots
+ * and its event count into a slot guarded by a seqlock. Readers retry
+ * while the writer is in there. Per-state counters live in tables owned
+ * by each dispatching thread, as in latency.h, and are summed when read.
+ * Sampling is a flag in the slot. While it is set, the dispatching thread
+ * also copies each event into a ring that the server drains. Sample one
+ * machine at a time, from the one thread that dispatches it.
+ *
+ * Machines are added before start(). A machine already started when it
+ * is added shows its state at that moment until its next dispatch. The
+ * hook chains to a tracer that was installed before start(), so Trace
+ * and Introspect can run together. stop() puts that tracer back unless
+ * another one was installed over the hook, which then only passes calls
+ * on. The hook reads the Introspect inside an EpochGuard, and stop()
+ * waits out an Epoch::barrier(), so it must not be called from inside a
+ * guard or a dispatch.
+ */
+#ifndef introspect_h
+#define introspect_h
+
+#include <assert.h>
+#include <atomic>
+#include <thread>
+#include "hsm.h"
+
+#define INTRO_MAX_HIST    2                  /* history slots per machine */
+#define INTRO_MAX_STATES  256     /* counted states per thread, power of 2 */
+#define INTRO_SAMPLES     1024                  /* sample ring, power of 2 */
+#define INTRO_LINE        256                  /* longest request, bytes */
+
+/* what a reader sees of a machine; slots start on cache lines, as the
+   threads dispatching different machines write them */
+struct alignas(HSM_CACHE_LINE) IntroSlot {
+    Hsm const *hsm;
+    std::atomic<unsigned> seq;          /* odd while being written */
+    std::atomic<State const *> curr;
+    std::atomic<State const *> hist[INTRO_MAX_HIST];
+    std::atomic<unsigned long> events;
+    std::atomic<unsigned> sample;            /* events still to sample */
+    State const *const *histOf[INTRO_MAX_HIST];        /* in the machine */
+    unsigned nHist;
+};
+
+struct IntroSample {                          /* one sampled event */
+    unsigned long long ts;                           /* CLOCK_MONOTONIC ns */
+    char const *state;                         /* it was dispatched in */
+    Event evt;
+};
+
+class Introspect {
+    IntroSlot *slots;
+    unsigned nSlots, maxSlots;
+    IntroSlot **byHsm;                 /* open addressing, by machine */
+    unsigned mask;
+    IntroSample ring[INTRO_SAMPLES];
+    std::atomic<unsigned long> head;                  /* samples written */
+    int listenFd, wakeFd[2];
+    char path[108];                           /* sizeof sun_path */
+    std::thread server;
+    static std::atomic<Introspect *> current;        /* the one started */
+    static HsmHook<HsmTracer> hook;            /* record() on Hsm::tracer */
+
+    IntroSlot *find_(Hsm const *me) const;
+    void serve_();
+    void session_(int fd);
+    void list_(int fd);
+    void counters_(int fd);
+    void sample_(int fd, unsigned idx, unsigned n, unsigned ms);
+public:
+    explicit Introspect(unsigned maxMachines);
+    ~Introspect();
+    int add(Hsm *hsm);                         /* its idx, -1 when full */
+    void history(int idx, State const *const *slot);   /* e.g. a history */
+    bool start(char const *socketPath);
+    void stop();
+    /* a consistent view of machine idx, any thread */
+    void read(unsigned idx, State const **curr, State const **hist,
+              unsigned long *events) const;
+    static void record(Hsm const *me, State const *s, int kind,
+                       Event evt);                      /* an HsmTracer */
+};
+
+#endif /* introspect_h */
@@ -0,0 +1,107 @@
+/** kernel.cpp -- priority-based preemptive run-to-completion kernel
+ */
+#include <string.h>
+#include "kernel.h"
+
+#define PRIO_BIT(p_) (1u << ((p_) - 1))
+
+static thread_local Kernel *inKernel;  /* kernel whose step runs here */
+
+static unsigned char highest(unsigned set) {
+    return set ? (unsigned char)(32 - __builtin_clz(set)) : 0;
+}
+
+/* Kernel Ctor..............................................................*/
+Kernel::Kernel()
+        : running(false), started(false), readySet(0), currPrio(0)
+{
+    memset(actives, 0, sizeof(actives));
+}
+
+void Kernel::add(Active *ao, unsigned char prio) {
+    assert(0 < prio && prio <= KERNEL_MAX_PRIO);
+    assert(actives[prio] == 0);                 /* priorities are unique */
+    actives[prio] = ao;
+}
+
+void Kernel::setIdle(IdleStrategy s, unsigned spinNs) {
+    assert(!started);                  /* the kernel thread reads it */
+    idle.set(s, spinNs);
+}
+
+/* post an event, preempt synchronously when called from a lower step......*/
+bool Kernel::post(unsigned char prio, Msg const *msg) {
+    assert(actives[prio] != 0);
+    if (!actives[prio]->post(msg)) {
+        return false;
+    }
+    readySet.fetch_or(PRIO_BIT(prio));
+    if (inKernel == this) {
+        if (prio > currPrio) {             /* nested RTC on the same stack */
+            sched_();
+        }
+    }
+    else {
+        idle.wake();
+    }
+    return true;
+}
+
+/* dispatch one event at a time, always from the highest ready priority.....*/
+void Kernel::sched_() {
+    unsigned char saved = currPrio;
+    unsigned char p;
+    while ((p = highest(readySet.load(std::memory_order_acquire))) > saved) {
+        Active *ao = actives[p];
+        currPrio = p;
+        ao->dispatch(1);                               /* one RTC step */
+        if (ao->isIdle()) {
+            readySet.fetch_and(~PRIO_BIT(p));
+            if (!ao->isIdle()) {              /* posted while clearing */
+                readySet.fetch_or(PRIO_BIT(p));
+            }
+        }
+    }
+    currPrio = saved;
+}
+
+void Kernel::runOnce() {
+    Kernel *outer = inKernel;
+    inKernel = this;
+    sched_();
+    inKernel = outer;
+}
+
+void *Kernel::run_(void *arg) {
+    Kernel *me = (Kernel *)arg;
+    inKernel = me;
+    while (me->running.load(std::memory_order_relaxed)) {
+        me->sched_();
+        me->idle.wait([me] {
+            return me->readySet.load() != 0 || !me->running.load();
+        });
+    }
+    return 0;
+}
+
+/* spawn the kernel thread that owns all registered machines................*/
+bool Kernel::start() {
+    idle.calibrate();
+    running.store(true);
+    if (pthread_create(&thread, 0, &Kernel::run_, this) != 0) {
+        running.store(false);
+        return false;
+    }
+    started = true;
+    return true;
+}
+
+void Kernel::stop() {
+    if (!started) {
+        return;
+    }
+    running.store(false);
+    idle.wake();
+    pthread_join(thread, 0);
+    started = false;
+}
@@ -0,0 +1,53 @@
+/** kernel.h -- priority-based preemptive run-to-completion kernel
+ *
+ * A single-stack kernel in the spirit of Samek's QK: each Active object
+ * gets a unique priority, events are always dispatched run-to-completion
+ * and the ready Active of highest priority runs next.
+ *
+ * Preemption happens at RTC-step boundaries. When a handler posts to a
+ * machine of higher priority than the one running, the kernel dispatches
+ * the target synchronously, nested on the same stack, before the posting
+ * handler continues, just like QK does. When another thread posts, the
+ * kernel thread picks the new highest priority right after the RTC step
+ * it is in, so the worst-case latency for the top priority is one RTC
+ * step of whatever was running.
+ *
+ * With nothing ready the kernel thread waits as its Idle says (idle.h),
+ * by default polling briefly and then parking on a futex.
+ */
+#ifndef kernel_h
+#define kernel_h
+
+#include <pthread.h>
+#include "active.h"
+#include "idle.h"
+
+#define KERNEL_MAX_PRIO 32                   /* priorities 1..32, 32 high */
+
+class Kernel {
+    Active *actives[KERNEL_MAX_PRIO + 1];            /* indexed by priority */
+    std::atomic<bool> running;
+    pthread_t thread;
+    bool started;
+    alignas(HSM_CACHE_LINE)                  /* posters and kernel write */
+    std::atomic<unsigned> readySet;     /* bit prio-1 set: queue non-empty */
+    alignas(HSM_CACHE_LINE)                     /* only the kernel writes */
+    unsigned char currPrio;               /* priority of the running step */
+    Idle idle;                       /* how the kernel thread waits for work */
+
+    void sched_();                   /* run everything above currPrio */
+    static void *run_(void *me);
+public:
+    Kernel();
+    void add(Active *ao, unsigned char prio);
+    bool post(unsigned char prio, Msg const *msg);       /* any thread */
+    void setIdle(IdleStrategy s,
+                 unsigned spinNs = IDLE_SPIN_NS);       /* before start() */
+    IdleStats idleStats() const { return idle.stats(); }
+    bool start();                       /* spawn the kernel pthread */
+    void stop();
+    void runOnce();                  /* drain ready queues in the caller */
+    unsigned char getCurrPrio() const { return currPrio; }
+};
+
+#endif /* kernel_h */
@@ -0,0 +1,258 @@
+/** latency.cpp -- latency histogram implementation
+ */
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include "latency.h"
+#include "active.h"
+
+struct LatHist {               /* one series of one thread, that thread's */
+    std::atomic<unsigned long long> n[HDR_BUCKETS];
+    std::atomic<unsigned long long> sum;
+};
+
+struct LatKey {                              /* a slot of the series table */
+    std::atomic<int> kind;         /* LatencyKind + 1 once claimed, 0 free */
+    char const *machine;
+    size_t what;                            /* signal, or the state name */
+    LatHist *hist;
+};
+
+struct LatRoute {      /* (machine, state, signal) to its two series */
+    char const *machine, *state;
+    Event evt;
+    LatHist *sig, *st;
+};
+
+#define LAT_ROUTES 64                   /* direct mapped, power of 2 */
+
+struct LatBuf {                           /* series table of one thread */
+    std::atomic<bool> owned;              /* a live thread records here */
+    LatBuf *next;                                     /* all tables, ever */
+    LatKey key[LATENCY_MAX_KEYS];
+    LatRoute route[LAT_ROUTES];             /* spares record() a lookup */
+};
+
+struct LatOwner {        /* hands the table back when its thread exits */
+    LatBuf *buf;
+    ~LatOwner() {
+        if (buf) {
+            buf->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+std::atomic<bool> Latency::on(false);
+
+static std::atomic<LatBuf *> bufs(0);
+static thread_local LatOwner myBuf;
+static std::atomic<unsigned long> nDropped(0);
+static double nsPerTick;                    /* set by the first start() */
+static HsmHook<HsmTimer> hook(&Hsm::timer, &Latency::record);
+static HsmHook<ActiveQueueTimer> queueHook(&Active::queueTimer,
+                                           &Latency::recordQueue);
+
+/* table of the calling thread, recycled from exited threads if possible...*/
+static LatBuf *threadBuf() {
+    for (LatBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        bool free = false;
+        if (b->owned.compare_exchange_strong(free, true,
+                                             std::memory_order_acquire)) {
+            return b;                 /* keeps counting into the old series */
+        }
+    }
+    LatBuf *b = new LatBuf();                              /* all zero */
+    b->owned.store(true, std::memory_order_relaxed);
+    b->next = bufs.load(std::memory_order_relaxed);
+    while (!bufs.compare_exchange_weak(b->next, b,
+                                       std::memory_order_release)) {
+    }
+    return b;
+}
+
+/* series (kind, machine, what) of this thread, claimed on first use.......*/
+static LatHist *find(LatBuf *b, int kind, char const *machine, size_t what) {
+    size_t x = ((size_t)machine ^ (what << 2 | (size_t)kind))
+               * 0x9E3779B97F4A7C15ULL;
+    unsigned i = (unsigned)(x >> 32);
+    for (unsigned probe = 0; probe < LATENCY_MAX_KEYS; ++probe, ++i) {
+        LatKey *k = &b->key[i & (LATENCY_MAX_KEYS - 1)];
+        int t = k->kind.load(std::memory_order_relaxed);     /* ours alone */
+        if (t == kind + 1 && k->machine == machine && k->what == what) {
+            return k->hist;
+        }
+        if (t == 0) {
+            k->machine = machine;
+            k->what = what;
+            k->hist = new LatHist();
+            k->kind.store(kind + 1, std::memory_order_release);
+            return k->hist;
+        }
+    }
+    nDropped.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+static inline void add(LatHist *h, unsigned i, unsigned long long ticks) {
+    if (h) {                      /* a single writer: no read-modify-write */
+        h->n[i].store(h->n[i].load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+        h->sum.store(h->sum.load(std::memory_order_relaxed) + ticks,
+                     std::memory_order_relaxed);
+    }
+}
+
+/* hot path: one route lookup and two bucket increments...................*/
+void Latency::record(Hsm const *me, State const *handler, Event evt,
+                     unsigned long long ticks)
+{
+    HsmTimer const next = hook.next();
+    if (next) {
+        (*next)(me, handler, evt, ticks);
+    }
+    if (!on.load(std::memory_order_relaxed)) {
+        return;
+    }
+    LatBuf *b = myBuf.buf;
+    if (b == 0) {
+        b = myBuf.buf = threadBuf();
+    }
+    char const *m = me->getName();
+    char const *st = me->getStateName(handler);
+    LatRoute *r = &b->route[((size_t)st >> 3 ^ (size_t)(unsigned)evt)
+                            & (LAT_ROUTES - 1)];
+    if (r->state != st || r->evt != evt || r->machine != m) {
+        r->sig = find(b, LATENCY_SIGNAL, m, (size_t)(unsigned)evt);
+        r->st = find(b, LATENCY_STATE, m, (size_t)st);
+        r->machine = m;                   /* a full table is retried next */
+        r->state = r->sig && r->st ? st : 0;
+        r->evt = evt;
+    }
+    unsigned i = hdrIndex(ticks);
+    add(r->sig, i, ticks);
+    add(r->st, i, ticks);
+}
+
+void Latency::recordQueue(Hsm const *me, Event evt, unsigned long long ticks)
+{
+    ActiveQueueTimer const next = queueHook.next();
+    if (next) {
+        (*next)(me, evt, ticks);
+    }
+    if (!on.load(std::memory_order_relaxed)) {
+        return;
+    }
+    LatBuf *b = myBuf.buf;
+    if (b == 0) {
+        b = myBuf.buf = threadBuf();
+    }
+    add(find(b, LATENCY_QUEUE, me->getName(), (size_t)(unsigned)evt),
+        hdrIndex(ticks), ticks);
+}
+
+bool Latency::start() {
+    if (on.load()) {
+        return false;
+    }
+    if (nsPerTick == 0.0) {
+        nsPerTick = hdrNsPerTick(10);
+    }
+    on.store(true);
+    hook.install();
+    queueHook.install();
+    return true;
+}
+
+void Latency::stop() {
+    queueHook.remove();
+    hook.remove();
+    on.store(false);
+}
+
+unsigned long Latency::dropped() {
+    return nDropped.load(std::memory_order_relaxed);
+}
+
+/* merge the series of all threads, ordered by kind, machine and key.......*/
+std::vector<LatencySeries> Latency::snapshot() {
+    std::vector<LatencySeries> all;
+    std::map<std::tuple<int, char const *, size_t>, size_t> index;
+    for (LatBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        for (LatKey &k : b->key) {
+            int t = k.kind.load(std::memory_order_acquire);
+            if (t == 0) {
+                continue;
+            }
+            auto it = index.emplace(std::make_tuple(t - 1, k.machine, k.what),
+                                    all.size()).first;
+            if (it->second == all.size()) {              /* a new series */
+                all.emplace_back();                        /* all zero */
+                LatencySeries *s = &all.back();
+                s->kind = t - 1;
+                s->machine = k.machine;
+                if (s->kind == LATENCY_STATE) {
+                    s->state = (char const *)k.what;
+                }
+                else {
+                    s->evt = (Event)(unsigned)k.what;
+                }
+                s->nsPerTick = nsPerTick;
+            }
+            LatencySeries *s = &all[it->second];
+            for (unsigned i = 0; i < HDR_BUCKETS; ++i) {
+                unsigned long long n =
+                    k.hist->n[i].load(std::memory_order_relaxed);
+                s->bucket[i] += n;
+                s->count += n;
+            }
+            s->sum += k.hist->sum.load(std::memory_order_relaxed);
+        }
+    }
+    std::sort(all.begin(), all.end(),
+              [](LatencySeries const &a, LatencySeries const &b) {
+                  if (a.kind != b.kind) {
+                      return a.kind < b.kind;
+                  }
+                  int c = strcmp(a.machine, b.machine);
+                  if (c != 0) {
+                      return c < 0;
+                  }
+                  return a.kind == LATENCY_STATE
+                         ? strcmp(a.state, b.state) < 0 : a.evt < b.evt;
+              });
+    return all;
+}
+
+void Latency::dump(FILE *out, bool csv, LatencySigName sigName) {
+    static char const *const kinds[] = { "signal", "state", "queue" };
+    static double const qs[] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+    std::vector<LatencySeries> all = snapshot();
+    if (csv) {
+        fprintf(out, "kind,machine,key,count,mean_ns,p50_ns,p90_ns,p99_ns,"
+                     "p99.9_ns,max_ns\n");
+    }
+    else {
+        fprintf(out, "%-6s %-12s %-14s %10s %9s %9s %9s %9s %9s %9s\n",
+                "kind", "machine", "key", "count", "mean", "p50", "p90",
+                "p99", "p99.9", "max ns");
+    }
+    for (LatencySeries const &s : all) {
+        char num[16];
+        char const *key = s.state;
+        if (s.kind != LATENCY_STATE) {
+            key = sigName ? (*sigName)(s.evt) : 0;
+            if (key == 0) {
+                snprintf(num, sizeof(num), "%d", s.evt);
+                key = num;
+            }
+        }
+        fprintf(out, csv ? "%s,%s,%s,%llu,%.1f"
+                         : "%-6s %-12s %-14s %10llu %9.1f",
+                kinds[s.kind], s.machine, key, s.count, s.mean());
+        for (double q : qs) {
+            fprintf(out, csv ? ",%.0f" : " %9.0f", s.percentile(q));
+        }
+        fputc('\n', out);
+    }
+}
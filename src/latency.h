@@ -0,0 +1,72 @@
+/** latency.h -- latency histograms per signal, per state and per queue
+ *
+ * Latency::start() hooks Hsm::timer. From then on every dispatch is timed
+ * and recorded twice: under its signal and under the state whose handler
+ * took it (the top state for unhandled events). It also hooks
+ * Active::queueTimer: events that come through an Active queue given
+ * stamps record their queueing delay, post to dispatch, under their
+ * signal. Series are keyed by machine name, so all Watches
+ * share one set, and values go into HDR histograms (see hdr.h) with
+ * about 6% resolution up to minutes.
+ *
+ * Each thread records into histograms of its own without locks or
+ * shared writes. snapshot() merges all threads, including ones that have
+ * exited, into LatencySeries with percentile queries; dump() prints them
+ * as a table or CSV. Time is counted in hdrTicks() and converted to ns
+ * when read. A thread that already has LATENCY_MAX_KEYS series drops
+ * further new ones and counts them.
+ *
+ * The hooks chain to timers installed before start(). stop() restores
+ * them, unless other hooks were installed over these meanwhile; record()
+ * and recordQueue() then only pass the calls on.
+ */
+#ifndef latency_h
+#define latency_h
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include "hsm.h"
+#include "hdr.h"
+
+#define LATENCY_MAX_KEYS 256       /* series per thread, power of 2 */
+
+enum LatencyKind { LATENCY_SIGNAL, LATENCY_STATE, LATENCY_QUEUE };
+
+typedef char const *(*LatencySigName)(Event evt);     /* 0: print number */
+
+struct LatencySeries {                         /* one merged histogram */
+    int kind;                                         /* see LatencyKind */
+    char const *machine;
+    char const *state;                               /* LATENCY_STATE only */
+    Event evt;                                      /* the others by signal */
+    unsigned long long count, sum;                       /* sum in ticks */
+    unsigned long long bucket[HDR_BUCKETS];
+    double nsPerTick;
+
+    double percentile(double q) const {                             /* ns */
+        return (double)hdrPercentile(bucket, count, q) * nsPerTick;
+    }
+    double mean() const {                                           /* ns */
+        return count ? (double)sum / (double)count * nsPerTick : 0.0;
+    }
+};
+
+class Latency {
+public:
+    static bool start();              /* calibrate the clock, hook Hsm */
+    static void stop();                      /* unhook, the data stays */
+    static std::vector<LatencySeries> snapshot();
+    static void dump(FILE *out, bool csv, LatencySigName sigName = 0);
+    static unsigned long dropped();        /* records with no free series */
+
+    static void record(Hsm const *me, State const *handler, Event evt,
+                       unsigned long long ticks);       /* an HsmTimer */
+    static void recordQueue(Hsm const *me, Event evt,
+                            unsigned long long ticks);  /* queues */
+private:
+    static std::atomic<bool> on;
+};
+
+#endif /* latency_h */
@@ -0,0 +1,160 @@
+/** log.cpp -- asynchronous binary logging implementation
+ */
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+#include "log.h"
+
+#define CACHE_LINE 64
+
+struct LogBuf {                 /* single-producer ring of one thread */
+    alignas(CACHE_LINE) std::atomic<unsigned> head;        /* formatter */
+    alignas(CACHE_LINE) std::atomic<unsigned> tail;         /* producer */
+    std::atomic<bool> owned;              /* a live thread produces here */
+    LogBuf *next;                                  /* all rings, ever */
+    LogRec rec[LOG_RING];
+};
+
+struct LogOwner {          /* hands the ring back when its thread exits */
+    LogBuf *buf;
+    ~LogOwner() {
+        if (buf) {
+            buf->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+std::atomic<int> Log::mode(LOG_SYNC);
+FILE *Log::out = 0;
+
+static std::atomic<LogBuf *> bufs(0);
+static thread_local LogOwner myBuf;
+static char const *fmts[LOG_MAX_FMTS];
+static LogFormatter fns[LOG_MAX_FMTS];
+static unsigned nFmts = 1;                          /* ID 0: not yet */
+static std::mutex regLock, drainLock;
+static std::thread formatter;
+static std::atomic<bool> running(false);
+static std::atomic<unsigned long> nDropped(0);
+
+/* ring of the calling thread, recycled from exited threads if possible....*/
+static LogBuf *threadBuf() {
+    for (LogBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        bool free = false;
+        if (b->owned.compare_exchange_strong(free, true,
+                                             std::memory_order_acquire)) {
+            return b;
+        }
+    }
+    LogBuf *b = new LogBuf;
+    b->head.store(0, std::memory_order_relaxed);
+    b->tail.store(0, std::memory_order_relaxed);
+    b->owned.store(true, std::memory_order_relaxed);
+    b->next = bufs.load(std::memory_order_relaxed);
+    while (!bufs.compare_exchange_weak(b->next, b,
+                                       std::memory_order_release)) {
+    }
+    return b;
+}
+
+unsigned short Log::reg(char const *fmt, LogFormatter f) {
+    std::lock_guard<std::mutex> lock(regLock);
+    if (nFmts == LOG_MAX_FMTS) {
+        return 0;                                   /* nothing is logged */
+    }
+    fmts[nFmts] = fmt;
+    fns[nFmts] = f;
+    return (unsigned short)nFmts++;
+}
+
+/* hot path: copy the record into this thread's ring, never block..........*/
+void Log::put(unsigned short id, unsigned long long const *args,
+              unsigned n)
+{
+    LogBuf *b = myBuf.buf;
+    if (b == 0) {
+        b = myBuf.buf = threadBuf();
+    }
+    unsigned t = b->tail.load(std::memory_order_relaxed);
+    if (t - b->head.load(std::memory_order_acquire) == LOG_RING) {
+        nDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    LogRec *r = &b->rec[t & (LOG_RING - 1)];
+    r->id = id;
+    memcpy(r->arg, args, n * sizeof(args[0]));
+    b->tail.store(t + 1, std::memory_order_release);
+}
+
+void Log::format(unsigned short id, unsigned long long const *args) {
+    if (id != 0) {
+        (*fns[id])(out ? out : stdout, fmts[id], args);
+    }
+}
+
+static unsigned drain() {                  /* caller holds drainLock */
+    unsigned n = 0;
+    for (LogBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        unsigned h = b->head.load(std::memory_order_relaxed);
+        unsigned t = b->tail.load(std::memory_order_acquire);
+        for (; h != t; ++h, ++n) {
+            LogRec *r = &b->rec[h & (LOG_RING - 1)];
+            Log::format(r->id, r->arg);
+        }
+        b->head.store(h, std::memory_order_release);
+    }
+    return n;
+}
+
+void Log::flush() {
+    std::lock_guard<std::mutex> lock(drainLock);
+    drain();
+    fflush(out ? out : stdout);
+}
+
+static void formatterMain() {
+    while (running.load(std::memory_order_relaxed)) {
+        unsigned n;
+        {
+            std::lock_guard<std::mutex> lock(drainLock);
+            n = drain();
+        }
+        if (n == 0) {
+            usleep(1000);                              /* nothing to do */
+        }
+    }
+}
+
+bool Log::start(FILE *o) {
+    if (running.load()) {
+        return false;
+    }
+    out = o;
+    running.store(true);
+    formatter = std::thread(&formatterMain);
+    mode.store(LOG_ASYNC);
+    return true;
+}
+
+void Log::stop() {
+    if (!running.load()) {
+        return;
+    }
+    mode.store(LOG_SYNC);
+    running.store(false);
+    formatter.join();
+    flush();
+}
+
+unsigned long Log::dropped() {
+    return nDropped.load(std::memory_order_relaxed);
+}
+
+unsigned long Log::pending() {
+    unsigned long n = 0;
+    for (LogBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        n += b->tail.load(std::memory_order_acquire)
+             - b->head.load(std::memory_order_acquire);
+    }
+    return n;
+}
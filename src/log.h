@@ -0,0 +1,129 @@
+/** log.h -- asynchronous binary logging for state handlers
+ *
+ * LOG(fmt, ...) takes the place of printf() in handlers. In LOG_ASYNC
+ * mode the call only stores a compact record, the format ID plus the raw
+ * argument words, in a lock-free ring owned by the calling thread. A
+ * background thread formats the records later. LOG_SYNC formats on the
+ * spot like printf() and is the default, so programs that never call
+ * Log::start() behave as before. LOG_OFF drops everything.
+ *
+ * Arguments are stored by value: integers, doubles and pointers. A %s
+ * argument must therefore point to a string that outlives the record,
+ * such as a literal or a State name.
+ */
+#ifndef log_h
+#define log_h
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+#define LOG_MAX_ARGS 6
+#ifndef LOG_RING
+#define LOG_RING     1024              /* records per thread, power of 2 */
+#endif
+#define LOG_MAX_FMTS 1024                       /* distinct LOG() sites */
+
+enum LogMode { LOG_OFF, LOG_SYNC, LOG_ASYNC };
+
+typedef void (*LogFormatter)(FILE *out, char const *fmt,
+                             unsigned long long const *args);
+
+struct LogRec {                             /* one record in a thread ring */
+    unsigned short id;                                     /* format ID */
+    unsigned long long arg[LOG_MAX_ARGS];
+};
+
+class Log {
+public:
+    static std::atomic<int> mode;
+    static FILE *out;
+
+    static bool start(FILE *out);        /* spawn formatter, go LOG_ASYNC */
+    static void stop();                      /* drain and back to LOG_SYNC */
+    static void flush();           /* format everything recorded so far */
+    static void setMode(LogMode m) { mode.store(m); }
+    static unsigned long dropped();        /* records lost to full rings */
+    static unsigned long pending();        /* recorded, not yet formatted */
+
+    static unsigned short reg(char const *fmt, LogFormatter f);
+    static void put(unsigned short id, unsigned long long const *args,
+                    unsigned n);
+    static void format(unsigned short id, unsigned long long const *args);
+};
+
+template<typename T>
+inline unsigned long long logPack(T v) {
+    unsigned long long w = 0;
+    if constexpr (std::is_floating_point<T>::value) {
+        double d = v;
+        memcpy(&w, &d, sizeof(d));
+    }
+    else if constexpr (std::is_pointer<T>::value) {
+        w = (unsigned long long)(size_t)v;
+    }
+    else {
+        w = (unsigned long long)v;
+    }
+    return w;
+}
+
+template<typename T>
+inline T logUnpack(unsigned long long w) {
+    if constexpr (std::is_floating_point<T>::value) {
+        double d;
+        memcpy(&d, &w, sizeof(d));
+        return (T)d;
+    }
+    else if constexpr (std::is_pointer<T>::value) {
+        return (T)(size_t)w;
+    }
+    else {
+        return (T)w;
+    }
+}
+
+template<typename... A, size_t... I>
+void logFormatI(FILE *out, char const *fmt, unsigned long long const *args,
+                std::index_sequence<I...>)
+{
+    fprintf(out, fmt, logUnpack<A>(args[I])...);
+}
+
+template<typename... A>
+void logFormat(FILE *out, char const *fmt, unsigned long long const *args) {
+    logFormatI<A...>(out, fmt, args, std::index_sequence_for<A...>());
+}
+
+/* one LOG() call site, registered the first time it is hit */
+template<typename... A>
+inline void logPut(std::atomic<unsigned short> *site, char const *fmt,
+                   A... a)
+{
+    static_assert(sizeof...(A) <= LOG_MAX_ARGS, "too many LOG arguments");
+    int m = Log::mode.load(std::memory_order_relaxed);
+    if (m == LOG_OFF) {
+        return;
+    }
+    unsigned short id = site->load(std::memory_order_acquire);
+    if (id == 0) {
+        id = Log::reg(fmt, &logFormat<typename std::decay<A>::type...>);
+        site->store(id, std::memory_order_release);
+    }
+    unsigned long long args[LOG_MAX_ARGS + 1] = { logPack(a)... };
+    if (m == LOG_SYNC) {
+        Log::format(id, args);
+    }
+    else {
+        Log::put(id, args, sizeof...(A));
+    }
+}
+
+#define LOG(...) do { \
+    static std::atomic<unsigned short> logSite_(0); \
+    logPut(&logSite_, __VA_ARGS__); \
+} while (0)
+
+#endif /* log_h */
@@ -0,0 +1,71 @@
+/**
+ * main.cpp -- interactive driver of the digital watch example
+ * M. Samek, 01/07/00
+ */
+
+#include <stdio.h>
+#include "watch.h"
+#include "log.h"
+
+/* Εvents */
+const Msg watchMsg[] = { 
+  Watch_MODE_EVT, // Button
+  Watch_SET_EVT, // Button
+  Watch_TICK_EVT // trigger of seconds, done manually.
+
+/*  Pressing the “set” button switches
+the watch into setting mode. 
+
+The sequence of adjustments in this
+mode is: hour, minute, day, month.
+
+Adjustments are made by pressing
+the “mode” button, which incre-
+ments the chosen quantity by one.
+
+Pressing the “set” button while
+adjusting month puts the watch
+back into timekeeping mode
+
+• While in setting mode the watch
+ignores tick events
+
+• Upon return to timekeeping mode
+the watch displays the most recently selected information, that is, if
+date was selected prior to leaving
+timekeeping mode, the watch
+resumes displaying the date, other-
+wise it displays the current time */
+
+
+};
+
+/* fast-forward by one day, entered as 3 */
+const AdvanceMsg dayMsg = { { Watch_ADVANCE_EVT }, 24UL * 60 * 60 };
+
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * 
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+int main() {
+  Watch watch;         
+  Log::start(stdout); /* handlers only record, formatting runs in the background */
+  watch.onStart();
+  Log::flush();
+  printf("\nThe sequence of adjustments in this mode is: hour, minute, day, month.\n\n");
+  for (;;)  {
+    int i;
+    Log::flush();
+    printf("\nEvent[0=mode,1=set,2=tick,3=+1 day]->");
+    scanf("%d", &i);
+    if (i == sizeof(watchMsg)/sizeof(Msg)) {
+      watch.onEvent(&dayMsg);
+      continue;
+    }
+    if (i < 0 || sizeof(watchMsg)/sizeof(Msg) <= i) 
+      break;
+    watch.onEvent(&watchMsg[i]); 
+  }
+  Log::stop();
+  return 0;
+}
@@ -0,0 +1,299 @@
+/** numa.cpp -- NUMA-aware placement and pinned dispatch workers
+ */
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "numa.h"
+
+#define MPOL_BIND_       2                            /* from numaif.h */
+#define MPOL_INTERLEAVE_ 3
+
+/* parse a sysfs CPU or node list such as "0-3,8,10-11"....................*/
+static unsigned parseList(char const *s, unsigned short *out, unsigned max) {
+    unsigned n = 0;
+    while (*s >= '0' && *s <= '9') {
+        char *end;
+        unsigned lo = (unsigned)strtoul(s, &end, 10), hi = lo;
+        if (*end == '-') {
+            hi = (unsigned)strtoul(end + 1, &end, 10);
+        }
+        for (unsigned c = lo; c <= hi && n < max; ++c) {
+            out[n++] = (unsigned short)c;
+        }
+        s = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+static bool readLine(char const *path, char *buf, size_t len) {
+    FILE *f = fopen(path, "r");
+    if (f == 0) {
+        return false;
+    }
+    bool ok = fgets(buf, (int)len, f) != 0;
+    fclose(f);
+    return ok;
+}
+
+static unsigned onlineCpus(unsigned short *out, unsigned max) {
+    cpu_set_t set;
+    unsigned n = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        out[0] = 0;
+        return 1;
+    }
+    for (unsigned c = 0; c < CPU_SETSIZE && n < max; ++c) {
+        if (CPU_ISSET(c, &set)) {
+            out[n++] = (unsigned short)c;
+        }
+    }
+    return n;
+}
+
+/* NumaTopo.................................................................*/
+bool NumaTopo::discover() {
+    char line[1024];
+    unsigned short nodes[NUMA_MAX_NODES];
+    nNodes = 0;
+    if (readLine("/sys/devices/system/node/online", line, sizeof(line))) {
+        unsigned n = parseList(line, nodes, NUMA_MAX_NODES);
+        for (unsigned i = 0; i < n; ++i) {
+            char path[64];
+            snprintf(path, sizeof(path),
+                     "/sys/devices/system/node/node%u/cpulist", nodes[i]);
+            if (!readLine(path, line, sizeof(line))) {
+                continue;
+            }
+            nCpus[nNodes] = parseList(line, cpu[nNodes], NUMA_MAX_CPUS);
+            if (nCpus[nNodes] != 0) {          /* memory-only nodes: skip */
+                mem[nNodes] = (unsigned char)nodes[i];
+                ++nNodes;
+            }
+        }
+    }
+    bool found = nNodes != 0;
+    if (!found) {
+        nNodes = 1;
+        nCpus[0] = onlineCpus(cpu[0], NUMA_MAX_CPUS);
+        mem[0] = 0;
+    }
+    nMemNodes = nNodes;
+    return found;
+}
+
+void NumaTopo::fake(unsigned nodes) {
+    unsigned short all[NUMA_MAX_CPUS];
+    unsigned nAll = onlineCpus(all, NUMA_MAX_CPUS);
+    unsigned real = nMemNodes ? nMemNodes : 1;
+    unsigned char realMem[NUMA_MAX_NODES];
+    memcpy(realMem, mem, sizeof(realMem));
+    assert(0 < nodes && nodes <= NUMA_MAX_NODES);
+    nNodes = nodes;
+    for (unsigned n = 0; n < nodes; ++n) {
+        nCpus[n] = 0;
+        mem[n] = realMem[n % real];
+    }
+    for (unsigned c = 0; c < (nAll > nodes ? nAll : nodes); ++c) {
+        unsigned n = (unsigned)((unsigned long)c * nodes
+                                / (nAll > nodes ? nAll : nodes));
+        cpu[n][nCpus[n]++] = all[c % nAll];    /* fewer CPUs: they share */
+    }
+}
+
+/* NumaArena................................................................*/
+bool NumaArena::init(size_t n, unsigned long nodeMask) {
+    void *p = mmap(0, n, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    int mode = (nodeMask & (nodeMask - 1)) ? MPOL_INTERLEAVE_ : MPOL_BIND_;
+    (void)syscall(SYS_mbind, p, n, mode, &nodeMask, sizeof(nodeMask) * 8,
+                  0);          /* fails without kernel NUMA: plain memory */
+    base = (char *)p;
+    size = n;
+    used.store(0);
+    return true;
+}
+
+NumaArena::~NumaArena() {
+    if (base) {
+        munmap(base, size);
+    }
+}
+
+void *NumaArena::alloc(size_t n, size_t align) {
+    size_t u = used.load(std::memory_order_relaxed), at;
+    do {
+        at = (u + align - 1) & ~(align - 1);
+        if (at + n > size) {
+            return 0;
+        }
+    } while (!used.compare_exchange_weak(u, at + n,
+                                         std::memory_order_relaxed));
+    return base + at;
+}
+
+/* NumaWorker Ctor..........................................................*/
+NumaWorker::NumaWorker(NumaTopo const *t, unsigned n)
+        : nPlaced(0), running(false), topo(t), node(n), started(false),
+          nDispatched(0)
+{
+    for (std::atomic<unsigned long> &w : ready) {
+        w.store(0, std::memory_order_relaxed);
+    }
+}
+
+/* dispatch a batch from every machine that has work, 0 if none had any...*/
+unsigned NumaWorker::sweep_() {
+    unsigned total = 0;
+    for (unsigned w = 0; w < (nPlaced + 63) / 64; ++w) {
+        unsigned long bits = ready[w].exchange(0, std::memory_order_acquire);
+        while (bits) {
+            unsigned i = w * 64 + (unsigned)__builtin_ctzl(bits);
+            bits &= bits - 1;
+            Active *ao = &placed[i]->ao;
+            total += ao->dispatch(NUMA_BATCH);
+            if (!ao->isIdle()) {                   /* more next sweep */
+                ready[w].fetch_or(1UL << (i & 63));
+            }
+        }
+    }
+    nDispatched.fetch_add(total, std::memory_order_relaxed);
+    return total;
+}
+
+void *NumaWorker::run_(void *arg) {
+    NumaWorker *me = (NumaWorker *)arg;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned c = 0; c < me->topo->nCpus[me->node]; ++c) {
+        CPU_SET(me->topo->cpu[me->node][c], &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);      /* best effort, as mbind */
+    for (unsigned i = 0; i < me->nPlaced; ++i) {
+        me->placed[i]->getHsm()->onStart();        /* on its own node */
+    }
+    while (me->running.load(std::memory_order_relaxed)) {
+        if (me->sweep_() != 0) {
+            continue;
+        }
+        me->idle.wait([me] {
+            for (unsigned w = 0; w < (me->nPlaced + 63) / 64; ++w) {
+                if (me->ready[w].load() != 0) {
+                    return true;
+                }
+            }
+            return !me->running.load();
+        });
+    }
+    return 0;
+}
+
+/* Numa Ctor................................................................*/
+Numa::Numa(NumaTopo const *t, unsigned workersPerNode, size_t arenaSize,
+           NumaPlacement placement)
+        : topo(t), nWorkers(0), perNode(workersPerNode)
+{
+    unsigned long all = 0;
+    for (unsigned n = 0; n < topo->nNodes; ++n) {
+        all |= 1UL << topo->mem[n];
+    }
+    for (unsigned n = 0; n < topo->nNodes; ++n) {
+        bool ok = arena[n].init(arenaSize, placement == NUMA_LOCAL
+                                           ? 1UL << topo->mem[n] : all);
+        assert(ok);
+        (void)ok;
+        next[n].store(0);
+        for (unsigned w = 0; w < perNode; ++w) {
+            assert(nWorkers < NUMA_MAX_WORKERS);
+            void *p = alloc(n, sizeof(NumaWorker), 64);
+            assert(p != 0);
+            workers[nWorkers++] = new (p) NumaWorker(topo, n);
+        }
+    }
+}
+
+Numa::~Numa() {
+    stop();                          /* the arenas unmap everything else */
+}
+
+/* wrap a machine made on node in an Active, owned by a worker there.......*/
+Placed *Numa::adopt(Hsm *hsm, unsigned node, unsigned qLen) {
+    assert(node < topo->nNodes);
+    NumaWorker *w = workers[node * perNode
+                            + next[node].fetch_add(1) % perNode];
+    assert(!w->started && w->nPlaced < NUMA_MAX_ACTIVES);
+    QSlot *sto = (QSlot *)alloc(node, qLen * sizeof(QSlot), 64);
+    void *p = alloc(node, sizeof(Placed), 64);
+    if (sto == 0 || p == 0) {
+        return 0;
+    }
+    Placed *pl = new (p) Placed(hsm, sto, qLen, w, w->nPlaced);
+    w->placed[w->nPlaced++] = pl;
+    return pl;
+}
+
+void Numa::wake_(Placed *p) {
+    NumaWorker *w = p->worker;
+    w->ready[p->idx / 64].fetch_or(1UL << (p->idx & 63));
+    w->idle.wake();
+}
+
+void Numa::setIdle(IdleStrategy s, unsigned spinNs) {
+    for (unsigned i = 0; i < nWorkers; ++i) {
+        assert(!workers[i]->started);
+        workers[i]->idle.set(s, spinNs);
+    }
+}
+
+bool Numa::start() {
+    for (unsigned i = 0; i < nWorkers; ++i) {
+        NumaWorker *w = workers[i];
+        w->idle.calibrate();
+        w->running.store(true);
+        if (pthread_create(&w->thread, 0, &NumaWorker::run_, w) != 0) {
+            w->running.store(false);
+            stop();
+            return false;
+        }
+        w->started = true;
+    }
+    return true;
+}
+
+void Numa::stop() {
+    for (unsigned i = 0; i < nWorkers; ++i) {
+        NumaWorker *w = workers[i];
+        if (!w->started) {
+            continue;
+        }
+        w->running.store(false);
+        w->idle.wake();
+        pthread_join(w->thread, 0);
+        w->started = false;
+    }
+}
+
+bool Numa::isIdle() const {
+    for (unsigned i = 0; i < nWorkers; ++i) {
+        for (unsigned j = 0; j < workers[i]->nPlaced; ++j) {
+            if (!workers[i]->placed[j]->ao.isIdle()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+unsigned long Numa::dispatched() const {
+    unsigned long n = 0;
+    for (unsigned i = 0; i < nWorkers; ++i) {
+        n += workers[i]->dispatched();
+    }
+    return n;
+}
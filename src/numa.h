@@ -0,0 +1,136 @@
+/** numa.h -- NUMA-aware placement of machines and pinned dispatch workers
+ *
+ * A Numa host runs dispatch workers pinned to the CPUs of each node and
+ * keeps one memory arena per node. make() constructs a machine in the
+ * arena of a node, adopt() wraps it in an Active whose queue lives in the
+ * same arena and hands it to a worker of that node, and post() routes an
+ * event to the worker owning the machine. The machine's states, extended
+ * state and queue are then touched by that node's CPUs only.
+ *
+ * With NUMA_INTERLEAVE all arenas spread their pages over every node
+ * instead, the default policy of a NUMA-unaware process and what the
+ * benchmark compares against.
+ *
+ * Memory policy and pinning use the mbind() and sched_setaffinity()
+ * system calls directly and the topology comes from sysfs, so nothing
+ * extra is linked. NumaTopo::fake() splits the CPUs of a single-node
+ * host into several nodes for testing; their memory all comes from the
+ * real node(s). Machines made by make() are never destroyed, their
+ * memory goes away with the Numa host.
+ */
+#ifndef numa_h
+#define numa_h
+
+#include <pthread.h>
+#include <new>
+#include <utility>
+#include "active.h"
+#include "idle.h"
+
+#define NUMA_MAX_NODES   8
+#define NUMA_MAX_CPUS    256                                /* per node */
+#define NUMA_MAX_WORKERS 32
+#define NUMA_MAX_ACTIVES 1024                             /* per worker */
+#define NUMA_BATCH       16            /* events per machine per sweep */
+
+enum NumaPlacement { NUMA_LOCAL, NUMA_INTERLEAVE };
+
+struct NumaTopo {                            /* nodes and their CPUs */
+    unsigned nNodes;
+    unsigned nCpus[NUMA_MAX_NODES];
+    unsigned short cpu[NUMA_MAX_NODES][NUMA_MAX_CPUS];
+    unsigned char mem[NUMA_MAX_NODES];      /* kernel node of the memory */
+    unsigned nMemNodes;                            /* kernel nodes, real */
+
+    bool discover();           /* from sysfs, else one node with all CPUs */
+    void fake(unsigned nodes);      /* split the CPUs, keep real memory */
+};
+
+class NumaArena {           /* bump allocator over memory of one node */
+    char *base;
+    size_t size;
+    std::atomic<size_t> used;
+public:
+    NumaArena() : base(0), size(0), used(0) {}
+    ~NumaArena();
+    bool init(size_t size, unsigned long nodeMask);     /* kernel nodes */
+    void *alloc(size_t n, size_t align);      /* 0 when the arena is full */
+};
+
+class NumaWorker;
+
+class Placed {                 /* a machine adopted by a pinned worker */
+    Active ao;
+    NumaWorker *worker;
+    unsigned idx;                          /* bit in the worker's ready set */
+public:
+    Placed(Hsm *hsm, QSlot *qSto, unsigned qLen, NumaWorker *w, unsigned i)
+            : ao(hsm, qSto, qLen), worker(w), idx(i) {}
+    Active *getActive() { return &ao; }
+    Hsm *getHsm() const { return ao.getHsm(); }
+    friend class Numa;
+    friend class NumaWorker;
+};
+
+class NumaWorker {      /* a thread on one node dispatching its machines */
+    Placed *placed[NUMA_MAX_ACTIVES];
+    unsigned nPlaced;
+    std::atomic<bool> running;
+    NumaTopo const *topo;
+    unsigned node;
+    pthread_t thread;
+    bool started;
+    alignas(HSM_CACHE_LINE)                  /* posters and worker write */
+    std::atomic<unsigned long> ready[NUMA_MAX_ACTIVES / 64];
+    alignas(HSM_CACHE_LINE)                     /* only the worker writes */
+    std::atomic<unsigned long> nDispatched;
+    Idle idle;                         /* how the worker waits for work */
+
+    unsigned sweep_();
+    static void *run_(void *me);
+public:
+    NumaWorker(NumaTopo const *topo, unsigned node);
+    unsigned getNode() const { return node; }
+    unsigned long dispatched() const { return nDispatched.load(); }
+    IdleStats idleStats() const { return idle.stats(); }
+    friend class Numa;
+};
+
+class Numa {
+    NumaTopo const *topo;
+    NumaArena arena[NUMA_MAX_NODES];
+    NumaWorker *workers[NUMA_MAX_WORKERS];
+    unsigned nWorkers, perNode;
+    std::atomic<unsigned> next[NUMA_MAX_NODES];  /* round robin per node */
+public:
+    Numa(NumaTopo const *topo, unsigned workersPerNode, size_t arenaSize,
+         NumaPlacement placement);
+    ~Numa();
+    void *alloc(unsigned node, size_t n, size_t align) {
+        return arena[node].alloc(n, align);
+    }
+    template<typename M, typename... A>
+    M *make(unsigned node, A&&... args) {       /* a machine on the node */
+        void *p = alloc(node, sizeof(M), alignof(M));
+        return p ? new (p) M(std::forward<A>(args)...) : 0;
+    }
+    /* before start(), hsm not started: its worker starts it */
+    Placed *adopt(Hsm *hsm, unsigned node, unsigned qLen);
+    bool post(Placed *p, Msg const *msg) {           /* any thread */
+        if (!p->ao.post(msg)) {
+            return false;
+        }
+        wake_(p);
+        return true;
+    }
+    void setIdle(IdleStrategy s,
+                 unsigned spinNs = IDLE_SPIN_NS);   /* before start() */
+    bool start();                            /* spawn the pinned workers */
+    void stop();
+    bool isIdle() const;                  /* every queue empty, for now */
+    unsigned long dispatched() const;
+private:
+    void wake_(Placed *p);
+};
+
+#endif /* numa_h */
@@ -0,0 +1,80 @@
+/** probe.h -- optional USDT (SDT) probes for perf, bpftrace and systemtap
+ *
+ * With HSM_USDT defined the engines mark dispatch, entry, exit and
+ * transition points with user-space statically defined tracepoints of
+ * provider "hsm". A probe is a single nop plus an ELF note
+ * (.note.stapsdt) describing where its arguments live, so it costs next
+ * to nothing until a tracer attaches. Without HSM_USDT, or on targets
+ * the fallback below does not cover, the macros expand to nothing.
+ *
+ *   hsm:dispatch (char const *machine, char const *state, int signal)
+ *   hsm:done     (char const *machine, char const *state, int handled)
+ *   hsm:entry    (char const *machine, char const *state)
+ *   hsm:exit     (char const *machine, char const *state)
+ *   hsm:tran     (char const *machine, char const *source,
+ *                 char const *target)
+ *
+ * <sys/sdt.h> is used when installed. Otherwise, on x86-64, the note is
+ * emitted here in the same format, which perf and bpftrace read alike.
+ * This header is shared by the C and C++ engines.
+ */
+#ifndef probe_h
+#define probe_h
+
+#ifdef HSM_USDT
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HSM_PROBE2(name_, a1_, a2_) DTRACE_PROBE2(hsm, name_, a1_, a2_)
+#define HSM_PROBE3(name_, a1_, a2_, a3_) \
+    DTRACE_PROBE3(hsm, name_, a1_, a2_, a3_)
+#define HSM_PROBE3I(name_, a1_, a2_, a3_) \
+    DTRACE_PROBE3(hsm, name_, a1_, a2_, a3_)
+#endif
+#endif
+
+#if !defined(HSM_PROBE3) && defined(__x86_64__)
+#define HSM_SDT_NOTE_(name_, args_) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n"                                       /* no semaphore */ \
+    ".asciz \"hsm\"\n" \
+    ".asciz \"" #name_ "\"\n" \
+    ".asciz \"" args_ "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"\
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+   /* pointer arguments, HSM_PROBE3I ends with an int; arguments are kept
+      in registers, the one operand form every SDT consumer can decode */
+#define HSM_PROBE2(name_, a1_, a2_) \
+    __asm__ __volatile__ (HSM_SDT_NOTE_(name_, "8@%[a1] 8@%[a2]") \
+        :: [a1] "r" (a1_), [a2] "r" (a2_))
+#define HSM_PROBE3(name_, a1_, a2_, a3_) \
+    __asm__ __volatile__ (HSM_SDT_NOTE_(name_, "8@%[a1] 8@%[a2] 8@%[a3]") \
+        :: [a1] "r" (a1_), [a2] "r" (a2_), [a3] "r" (a3_))
+#define HSM_PROBE3I(name_, a1_, a2_, a3_) \
+    __asm__ __volatile__ (HSM_SDT_NOTE_(name_, "8@%[a1] 8@%[a2] -4@%[a3]") \
+        :: [a1] "r" (a1_), [a2] "r" (a2_), [a3] "r" ((int)(a3_)))
+#endif
+#endif /* HSM_USDT */
+
+#ifndef HSM_PROBE3
+#define HSM_PROBE2(name_, a1_, a2_)        ((void)0)
+#define HSM_PROBE3(name_, a1_, a2_, a3_)   ((void)0)
+#define HSM_PROBE3I(name_, a1_, a2_, a3_)  ((void)0)
+#endif
+
+#endif /* probe_h */
@@ -0,0 +1,135 @@
+/** registry.cpp -- concurrent ID to machine table implementation
+ */
+#include <stdlib.h>
+#include "registry.h"
+
+static void freeTable(void *p, void *) {
+    free(p);
+}
+
+void Registry::release_(void *ao, void *me) {
+    Registry *r = (Registry *)me;
+    (*r->released)((Active *)ao, r->ctx);
+}
+
+RegTable *Registry::newTable_(unsigned long slots) {
+    RegTable *t = (RegTable *)calloc(1, sizeof(RegTable)
+                                        + (slots - 1) * sizeof(RegSlot));
+    assert(t != 0);                         /* zero pages: all slots empty */
+    t->mask = slots - 1;
+    return t;
+}
+
+/* Registry Ctor............................................................*/
+Registry::Registry(RegistryHook release, RegistryHook post, void *c)
+        : table(newTable_(REGISTRY_MIN_SLOTS)), nUsed(0), nLive(0),
+          released(release), posted(post), ctx(c)
+{}
+
+Registry::~Registry() {
+    Epoch::barrier();                     /* our retirements call back here */
+    RegTable *t = table.load();
+    for (unsigned long i = 0; i <= t->mask; ++i) {
+        Active *ao = t->slot[i].ao.load(std::memory_order_relaxed);
+        if (ao != 0) {
+            (*released)(ao, ctx);
+        }
+    }
+    free(t);
+}
+
+/* rebuild without the removed slots, at most 1/2 full, and publish it.....*/
+RegTable *Registry::grow_() {
+    RegTable *old = table.load(std::memory_order_relaxed);
+    unsigned long live = nLive.load(std::memory_order_relaxed);
+    unsigned long slots = old->mask + 1;
+    while ((live + 1) * 2 > slots) {
+        slots *= 2;
+    }
+    RegTable *t = newTable_(slots);
+    for (unsigned long i = 0; i <= old->mask; ++i) {
+        Active *ao = old->slot[i].ao.load(std::memory_order_relaxed);
+        if (ao == 0) {
+            continue;
+        }
+        unsigned long long id = old->slot[i].id.load(std::memory_order_relaxed);
+        unsigned long j = hash_(id);
+        while (t->slot[j & t->mask].id.load(std::memory_order_relaxed) != 0) {
+            ++j;
+        }
+        t->slot[j & t->mask].id.store(id, std::memory_order_relaxed);
+        t->slot[j & t->mask].ao.store(ao, std::memory_order_relaxed);
+    }
+    nUsed = live;
+    table.store(t, std::memory_order_release);
+    return old;                               /* lookups may still be in it */
+}
+
+/* retire() may run the release hooks of earlier removals right away, so
+   add() and remove() call it only once writeLock is released */
+bool Registry::add(unsigned long long id, Active *ao) {
+    assert(id != 0 && ao != 0);
+    RegTable *old = 0;
+    bool added = true;
+    {
+        std::lock_guard<std::mutex> lock(writeLock);
+        RegTable *t = table.load(std::memory_order_relaxed);
+        if ((nUsed + 1) * 4 > (t->mask + 1) * 3) {         /* 3/4 full */
+            old = grow_();
+            t = table.load(std::memory_order_relaxed);
+        }
+        for (unsigned long i = hash_(id);; ++i) {
+            RegSlot &s = t->slot[i & t->mask];
+            unsigned long long k = s.id.load(std::memory_order_relaxed);
+            if (k == id) {                     /* removed before: reuse */
+                if (s.ao.load(std::memory_order_relaxed) != 0) {
+                    added = false;
+                    break;
+                }
+                s.ao.store(ao, std::memory_order_release);
+                break;
+            }
+            if (k == 0) {                   /* ao first, readers go by id */
+                s.ao.store(ao, std::memory_order_relaxed);
+                s.id.store(id, std::memory_order_release);
+                ++nUsed;
+                break;
+            }
+        }
+        if (added) {
+            nLive.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (old != 0) {
+        Epoch::retire(old, &freeTable, 0);
+    }
+    return added;
+}
+
+bool Registry::remove(unsigned long long id) {
+    Active *ao = 0;
+    {
+        std::lock_guard<std::mutex> lock(writeLock);
+        RegTable *t = table.load(std::memory_order_relaxed);
+        for (unsigned long i = hash_(id);; ++i) {
+            RegSlot &s = t->slot[i & t->mask];
+            unsigned long long k = s.id.load(std::memory_order_relaxed);
+            if (k == 0) {
+                break;
+            }
+            if (k == id) {
+                ao = s.ao.load(std::memory_order_relaxed);
+                if (ao != 0) {
+                    s.ao.store(0, std::memory_order_release);
+                    nLive.fetch_sub(1, std::memory_order_relaxed);
+                }
+                break;
+            }
+        }
+    }
+    if (ao == 0) {
+        return false;
+    }
+    Epoch::retire(ao, &Registry::release_, this);
+    return true;
+}
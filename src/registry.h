@@ -0,0 +1,92 @@
+/** registry.h -- concurrent routing of events to machines by ID
+ *
+ * A Registry maps 64-bit machine IDs to the Active objects running the
+ * machines, so any thread can post(id, msg) without knowing where the
+ * machine lives. Lookups take no lock and write nothing shared: the table
+ * is open addressing with linear probing over (id, Active *) slots, read
+ * inside an EpochGuard (see epoch.h). add() and remove() are serialised
+ * by a mutex and meant to be rare next to posts.
+ *
+ * A removed Active is passed to the release hook only once no post that
+ * may have found it is still running, so the hook can destroy the machine.
+ * Retirements happen after the mutex is released, so a hook may add() or
+ * remove() on the same Registry, though not while it is being destroyed.
+ * When the table gets crowded it is rebuilt, twice as large if need be,
+ * and the old one is retired the same way, so lookups never wait.
+ *
+ * The optional posted hook runs after every successful post, in the
+ * posting thread, to tell whoever dispatches the Active that it has work
+ * (e.g. set its bit in a ready set). ID 0 is reserved.
+ */
+#ifndef registry_h
+#define registry_h
+
+#include <mutex>
+#include "active.h"
+#include "epoch.h"
+
+#define REGISTRY_MIN_SLOTS 1024                          /* power of 2 */
+
+typedef void (*RegistryHook)(Active *ao, void *ctx);
+
+struct RegSlot {
+    std::atomic<unsigned long long> id;                     /* 0: empty */
+    std::atomic<Active *> ao;               /* 0: removed, id stays put */
+};
+
+struct RegTable {
+    unsigned long mask;                                /* slots - 1 */
+    RegSlot slot[1];                                  /* mask + 1 of them */
+};
+
+class Registry {
+    std::atomic<RegTable *> table;
+    std::mutex writeLock;                       /* add(), remove(), ~ */
+    unsigned long nUsed;                   /* slots with an id, writers' */
+    std::atomic<unsigned long> nLive;
+    RegistryHook released, posted;
+    void *ctx;
+
+    static unsigned long hash_(unsigned long long id) {
+        id *= 0x9E3779B97F4A7C15ULL;
+        return (unsigned long)(id ^ id >> 32);
+    }
+    static RegTable *newTable_(unsigned long slots);
+    static void release_(void *ao, void *me);          /* an EpochFree */
+    RegTable *grow_();                     /* the old table, to retire */
+public:
+    Registry(RegistryHook release, RegistryHook post = 0, void *ctx = 0);
+    ~Registry();       /* releases what is left, not inside a guard */
+    bool add(unsigned long long id, Active *ao);    /* false: id taken */
+    bool remove(unsigned long long id);           /* false: no such id */
+    unsigned long size() const { return nLive.load(); }
+
+    /* inside an EpochGuard, valid until it ends; 0: no such id */
+    Active *find(unsigned long long id) const {
+        RegTable const *t = table.load(std::memory_order_acquire);
+        for (unsigned long i = hash_(id);; ++i) {
+            RegSlot const &s = t->slot[i & t->mask];
+            unsigned long long k = s.id.load(std::memory_order_acquire);
+            if (k == id) {
+                return s.ao.load(std::memory_order_acquire);
+            }
+            if (k == 0) {
+                return 0;
+            }
+        }
+    }
+    /* any thread; false: no such id or its queue is full */
+    bool post(unsigned long long id, Msg const *msg) {
+        EpochGuard guard;
+        Active *ao = find(id);
+        if (ao == 0 || !ao->post(msg)) {
+            return false;
+        }
+        if (posted) {
+            (*posted)(ao, ctx);
+        }
+        return true;
+    }
+};
+
+#endif /* registry_h */
@@ -0,0 +1,109 @@
+/** setclock.cpp -- the setting sequence of the Watch as a submachine
+ */
+#include "setclock.h"
+#include "log.h"
+
+static unsigned int const daysPerMonth[12] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+unsigned int monthDays(unsigned int month, unsigned int year) {
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return daysPerMonth[month - 1] + (month == 2 && leap ? 1 : 0);
+}
+
+/* SetClock Ctor............................................................*/
+SetClock::SetClock(ClockFields *c, Event mode, Event set)
+        : SubHsm("SetClock", &topo), clock(c), modeEvt(mode), setEvt(set)
+{}
+
+Msg const *SetClock::topHndlr(Msg const *msg) {
+    if (msg->evt == START_EVT) {
+        STATE_START(&states[S_HOUR]);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *SetClock::hourHndlr(Msg const *msg) {
+    if (msg->evt == setEvt) {
+        STATE_TRAN(&states[S_MINUTE]);
+        return 0;
+    }
+    if (msg->evt == modeEvt) {
+        if (++clock->thour == 24) {
+            clock->thour = 0;
+        }
+        LOG("SetClock::hour++: %d", clock->thour);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *SetClock::minuteHndlr(Msg const *msg) {
+    if (msg->evt == setEvt) {
+        STATE_TRAN(&states[S_DAY]);
+        return 0;
+    }
+    if (msg->evt == modeEvt) {
+        if (++clock->tmin == 60) {
+            clock->tmin = 0;
+        }
+        LOG("SetClock::min++: %d", clock->tmin);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *SetClock::dayHndlr(Msg const *msg) {
+    if (msg->evt == setEvt) {
+        STATE_TRAN(&states[S_MONTH]);
+        return 0;
+    }
+    if (msg->evt == modeEvt) {
+        if (++clock->dday > clock->daysInMonth()) {  /* or left past it */
+            clock->dday = 1;
+        }
+        LOG("SetClock::day++: %d", clock->dday);
+        return 0;
+    }
+    return msg;
+}
+
+Msg const *SetClock::monthHndlr(Msg const *msg) {
+    if (msg->evt == setEvt) {
+        SUB_EXIT(SETCLOCK_DONE);                /* the parent moves on */
+        return 0;
+    }
+    if (msg->evt == modeEvt) {
+        if (++clock->dmonth == 13) {
+            clock->dmonth = 1;
+        }
+        LOG("SetClock::month++: %d", clock->dmonth);
+        return 0;
+    }
+    return msg;
+}
+
+/* SetClock topology, one copy for every clock that embeds it..............*/
+State const SetClock::states[S_COUNT] = {
+    State(S_TOP, HSM_NO_SUPER),
+      State(S_HOUR, S_TOP),
+      State(S_MINUTE, S_TOP),
+      State(S_DAY, S_TOP),
+      State(S_MONTH, S_TOP)
+};
+
+EvtHndlr const SetClock::hndlrs[S_COUNT] = {
+    (EvtHndlr)&SetClock::topHndlr,
+      (EvtHndlr)&SetClock::hourHndlr,
+      (EvtHndlr)&SetClock::minuteHndlr,
+      (EvtHndlr)&SetClock::dayHndlr,
+      (EvtHndlr)&SetClock::monthHndlr
+};
+
+char const *const SetClock::names[S_COUNT] = {
+    "setting", "hour", "minute", "day", "month"
+};
+
+HsmTopo const SetClock::topo = { states, hndlrs, names, S_COUNT };
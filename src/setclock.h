@@ -0,0 +1,51 @@
+/** setclock.h -- the setting sequence of the Watch as a submachine
+ *
+ * The setting mode of the Watch (see watch.h) as a SubHsm that any clock
+ * can embed. SET moves on to the next field and MODE increments the
+ * current one. SET on the month raises SETCLOCK_DONE. The parent chooses
+ * the signal numbers of MODE and SET and the fields that are set.
+ * Ticks and everything else go back to the parent.
+ */
+#ifndef setclock_h
+#define setclock_h
+
+#include <assert.h>
+#include "submachine.h"
+
+/* days of a month (1..12) of the Gregorian calendar, 29 for a leap Feb;
+   the Watch counts its days with it as well */
+unsigned int monthDays(unsigned int month, unsigned int year);
+
+struct ClockFields {                           /* what the sequence sets */
+    unsigned int tsec, tmin, thour, dday, dmonth, tyear;
+
+    unsigned int daysInMonth() const { return monthDays(dmonth, tyear); }
+};
+
+enum SetClockEntry {                           /* entry points, state ids */
+    SETCLOCK_HOUR = 1, SETCLOCK_MINUTE, SETCLOCK_DAY, SETCLOCK_MONTH
+};
+enum SetClockExit { SETCLOCK_DONE = 1 };                 /* exit points */
+
+class SetClock : public SubHsm {
+    ClockFields *clock;
+    Event modeEvt, setEvt;
+
+    enum StateIds {
+        S_TOP, S_HOUR, S_MINUTE, S_DAY, S_MONTH, S_COUNT
+    };
+    static State const states[S_COUNT];
+    static EvtHndlr const hndlrs[S_COUNT];
+    static char const *const names[S_COUNT];
+    static HsmTopo const topo;
+public:
+    SetClock(ClockFields *clock, Event modeEvt, Event setEvt);
+    static State const *at(SetClockEntry e) { return &states[e]; }
+    Msg const *topHndlr(Msg const *msg);
+    Msg const *hourHndlr(Msg const *msg);
+    Msg const *minuteHndlr(Msg const *msg);
+    Msg const *dayHndlr(Msg const *msg);
+    Msg const *monthHndlr(Msg const *msg);
+};
+
+#endif /* setclock_h */
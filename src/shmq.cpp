@@ -0,0 +1,274 @@
+/** shmq.cpp -- shared-memory event transport implementation
+ */
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <new>
+#include "shmq.h"
+
+#define SHMQ_MAGIC 0x48534D51u                                 /* "HSMQ" */
+#define CACHE_LINE 64
+
+struct ShmRec {                                   /* one slot of the ring */
+    std::atomic<unsigned> seq;              /* Vyukov lap/sequence number */
+    ShmMsg msg;
+};
+
+struct ShmHdr {             /* fixed layout at the start of the mapping */
+    unsigned magic;
+    unsigned nRecs, nSlabs, slabSize;
+    unsigned long recOff, nextOff, slabOff;    /* offsets from the header */
+    alignas(CACHE_LINE) std::atomic<unsigned> tail;        /* producers */
+    alignas(CACHE_LINE) std::atomic<unsigned> head;         /* consumer */
+    alignas(CACHE_LINE) std::atomic<unsigned long long> freeTop;  /* tag|slab */
+    alignas(CACHE_LINE) std::atomic<unsigned> futexWord;
+    std::atomic<unsigned> sleeping;             /* consumer parked in wait */
+    std::atomic<unsigned long> nWakeups;
+};
+
+#define RECS(h_)  ((ShmRec *)((char *)(h_) + (h_)->recOff))
+#define NEXT(h_)  ((std::atomic<unsigned> *)((char *)(h_) + (h_)->nextOff))
+#define SLAB(h_, i_) ((char *)(h_) + (h_)->slabOff \
+                      + (unsigned long)(i_) * (h_)->slabSize)
+
+static unsigned long roundUp(unsigned long n) {
+    return (n + CACHE_LINE - 1) & ~(unsigned long)(CACHE_LINE - 1);
+}
+
+static long futex(std::atomic<unsigned> *word, int op, unsigned val,
+                  timespec const *ts)
+{                   /* shared, not FUTEX_PRIVATE: waiters in many processes */
+    return syscall(SYS_futex, (unsigned *)word, op, val, ts, 0, 0);
+}
+
+/* ShmQueue Ctor............................................................*/
+ShmQueue::ShmQueue()
+        : hdr(0), size(0)
+{}
+
+ShmQueue::~ShmQueue() {
+    if (hdr) {
+        munmap(hdr, size);
+    }
+}
+
+/* map the region, lay it out when init is set..............................*/
+bool ShmQueue::map_(int fd, bool init, unsigned nRecs, unsigned nSlabs,
+                    unsigned slabSize)
+{
+    unsigned long recOff  = roundUp(sizeof(ShmHdr));
+    unsigned long nextOff = roundUp(recOff + nRecs * sizeof(ShmRec));
+    unsigned long slabOff = roundUp(nextOff
+                                    + nSlabs * sizeof(std::atomic<unsigned>));
+    size = slabOff + (unsigned long)nSlabs * roundUp(slabSize);
+    if (fd >= 0 && init && ftruncate(fd, (off_t)size) != 0) {
+        return false;
+    }
+    void *p = mmap(0, size, PROT_READ | PROT_WRITE,
+                   fd >= 0 ? MAP_SHARED : MAP_SHARED | MAP_ANONYMOUS, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    hdr = (ShmHdr *)p;
+    if (!init) {
+        return hdr->magic == SHMQ_MAGIC;
+    }
+    new (hdr) ShmHdr;
+    hdr->nRecs = nRecs;
+    hdr->nSlabs = nSlabs;
+    hdr->slabSize = (unsigned)roundUp(slabSize);
+    hdr->recOff = recOff;
+    hdr->nextOff = nextOff;
+    hdr->slabOff = slabOff;
+    hdr->tail.store(0, std::memory_order_relaxed);
+    hdr->head.store(0, std::memory_order_relaxed);
+    hdr->futexWord.store(0, std::memory_order_relaxed);
+    hdr->sleeping.store(0, std::memory_order_relaxed);
+    hdr->nWakeups.store(0, std::memory_order_relaxed);
+    ShmRec *recs = RECS(hdr);
+    for (unsigned i = 0; i < nRecs; ++i) {
+        new (&recs[i]) ShmRec;
+        recs[i].seq.store(i, std::memory_order_relaxed);
+    }
+    std::atomic<unsigned> *next = NEXT(hdr);
+    for (unsigned i = 0; i < nSlabs; ++i) {           /* chain free slabs */
+        new (&next[i]) std::atomic<unsigned>(i + 1 < nSlabs ? i + 1
+                                                            : SHMQ_NO_SLAB);
+    }
+    hdr->freeTop.store(nSlabs ? 0 : SHMQ_NO_SLAB, std::memory_order_relaxed);
+    __atomic_store_n(&hdr->magic, SHMQ_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* create a new transport, anonymous (fork-shared) when name is 0...........*/
+bool ShmQueue::create(char const *name, unsigned nRecs, unsigned nSlabs,
+                      unsigned slabSize)
+{
+    assert(hdr == 0);
+    assert(nRecs != 0 && (nRecs & (nRecs - 1)) == 0);
+    if (name == 0) {
+        return map_(-1, true, nRecs, nSlabs, slabSize);
+    }
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = map_(fd, true, nRecs, nSlabs, slabSize);
+    close(fd);
+    return ok;
+}
+
+/* attach to a transport created by another process.........................*/
+bool ShmQueue::attach(char const *name) {
+    assert(hdr == 0);
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+    ShmHdr h;
+    bool ok = ::read(fd, &h, sizeof(h)) == (ssize_t)sizeof(h)
+              && h.magic == SHMQ_MAGIC
+              && map_(fd, false, h.nRecs, h.nSlabs, h.slabSize);
+    close(fd);
+    return ok;
+}
+
+void ShmQueue::unlink(char const *name) {
+    shm_unlink(name);
+}
+
+/* take a payload slab from the shared free list............................*/
+void *ShmQueue::alloc(unsigned len) {
+    if (len > hdr->slabSize) {
+        return 0;
+    }
+    std::atomic<unsigned> *next = NEXT(hdr);
+    unsigned long long top = hdr->freeTop.load(std::memory_order_acquire);
+    for (;;) {
+        unsigned slab = (unsigned)top;
+        if (slab == SHMQ_NO_SLAB) {
+            return 0;                                     /* pool drained */
+        }
+        unsigned long long nxt = (((top >> 32) + 1) << 32)
+                      | next[slab].load(std::memory_order_relaxed);
+        if (hdr->freeTop.compare_exchange_weak(top, nxt,
+                                               std::memory_order_acquire))
+        {
+            return SLAB(hdr, slab);
+        }
+    }
+}
+
+/* push a slab back on the shared free list................................*/
+void ShmQueue::release_(unsigned slab) {
+    std::atomic<unsigned> *next = NEXT(hdr);
+    unsigned long long top = hdr->freeTop.load(std::memory_order_relaxed);
+    unsigned long long nxt;
+    do {
+        next[slab].store((unsigned)top, std::memory_order_relaxed);
+        nxt = (((top >> 32) + 1) << 32) | slab;
+    } while (!hdr->freeTop.compare_exchange_weak(top, nxt,
+                                                 std::memory_order_release));
+}
+
+void ShmQueue::free(void *payload) {
+    if (payload != 0) {
+        release_((unsigned)(((char *)payload - SLAB(hdr, 0))
+                            / hdr->slabSize));
+    }
+}
+
+/* post a record; payload, if any, must come from alloc()...................*/
+bool ShmQueue::post(unsigned dst, Event evt, void *payload, unsigned len) {
+    ShmRec *recs = RECS(hdr);
+    unsigned mask = hdr->nRecs - 1;
+    unsigned pos = hdr->tail.load(std::memory_order_relaxed);
+    ShmRec *rec;
+    for (;;) {
+        rec = &recs[pos & mask];
+        int dif = (int)(rec->seq.load(std::memory_order_acquire) - pos);
+        if (dif == 0) {
+            if (hdr->tail.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return false;                                      /* ring full */
+        }
+        else {
+            pos = hdr->tail.load(std::memory_order_relaxed);
+        }
+    }
+    rec->msg.evt = evt;
+    rec->msg.dst = dst;
+    rec->msg.len = len;
+    rec->msg.slab = payload == 0 ? SHMQ_NO_SLAB
+        : (unsigned)(((char *)payload - SLAB(hdr, 0)) / hdr->slabSize);
+    rec->seq.store(pos + 1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);  /* pairs w. wait */
+    if (hdr->sleeping.load(std::memory_order_relaxed)) {
+        hdr->futexWord.fetch_add(1, std::memory_order_release);
+        futex(&hdr->futexWord, FUTEX_WAKE, 1, 0);
+        hdr->nWakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void *ShmQueue::payload(ShmMsg const *msg) const {
+    return msg->slab == SHMQ_NO_SLAB ? 0 : SLAB(hdr, msg->slab);
+}
+
+/* deliver records to their machines in place, then recycle them...........*/
+unsigned ShmQueue::dispatch(Hsm *const *machines, unsigned nMachines,
+                            unsigned max)
+{
+    ShmRec *recs = RECS(hdr);
+    unsigned mask = hdr->nRecs - 1;
+    unsigned n = 0;
+    while (n < max) {
+        unsigned pos = hdr->head.load(std::memory_order_relaxed);
+        ShmRec *rec = &recs[pos & mask];
+        if ((int)(rec->seq.load(std::memory_order_acquire) - (pos + 1)) < 0) {
+            break;                                             /* empty */
+        }
+        hdr->head.store(pos + 1, std::memory_order_relaxed);
+        if (rec->msg.dst < nMachines) {
+            machines[rec->msg.dst]->onEvent(&rec->msg);
+        }
+        if (rec->msg.slab != SHMQ_NO_SLAB) {          /* back to the pool */
+            release_(rec->msg.slab);
+        }
+        rec->seq.store(pos + mask + 1, std::memory_order_release);
+        ++n;
+    }
+    return n;
+}
+
+/* park the consumer until a producer posts.................................*/
+bool ShmQueue::wait(int timeoutMs) {
+    ShmRec *recs = RECS(hdr);
+    unsigned pos = hdr->head.load(std::memory_order_relaxed);
+    ShmRec *rec = &recs[pos & (hdr->nRecs - 1)];
+    unsigned word = hdr->futexWord.load(std::memory_order_acquire);
+    hdr->sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);  /* pairs w. post */
+    if ((int)(rec->seq.load(std::memory_order_acquire) - (pos + 1)) < 0) {
+        timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+        futex(&hdr->futexWord, FUTEX_WAIT, word, timeoutMs < 0 ? 0 : &ts);
+    }
+    hdr->sleeping.store(0, std::memory_order_relaxed);
+    return (int)(rec->seq.load(std::memory_order_acquire) - (pos + 1)) >= 0;
+}
+
+unsigned long ShmQueue::wakeups() const {
+    return hdr->nWakeups.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,63 @@
+/** shmq.h -- shared-memory event transport between processes
+ *
+ * A ShmQueue lives in one memory mapping shared by every process on the
+ * host that talks to the consumer: a multi-producer ring of fixed-layout
+ * ShmMsg records plus a pool of payload slabs. A producer takes a slab,
+ * builds its payload in place and posts a record naming the slab, so
+ * nothing is copied and no syscall is made on the way. The consuming
+ * process dispatches each record straight out of the mapping into the
+ * machine it addresses and then recycles the slot and the slab. A futex
+ * wakeup is only issued while the consumer is parked in wait().
+ *
+ * create(0, ...) makes an anonymous mapping that forked children
+ * inherit; create(name, ...) and attach(name) use POSIX shm_open().
+ */
+#ifndef shmq_h
+#define shmq_h
+
+#include <assert.h>
+#include <atomic>
+#include "hsm.h"
+
+#define SHMQ_NO_SLAB 0xFFFFFFFFu                 /* record has no payload */
+
+struct ShmMsg : public Msg {      /* event record inside the shared ring */
+    unsigned dst;                      /* machine index in the consumer */
+    unsigned slab;                          /* payload slab or SHMQ_NO_SLAB */
+    unsigned len;                                      /* payload bytes */
+};
+
+struct ShmHdr;                                     /* see shmq.cpp */
+
+class ShmQueue {
+    ShmHdr *hdr;                                  /* start of the mapping */
+    unsigned long size;                            /* bytes mapped */
+
+    bool map_(int fd, bool init, unsigned nRecs, unsigned nSlabs,
+              unsigned slabSize);
+    void release_(unsigned slab);
+public:
+    ShmQueue();
+    ~ShmQueue();
+    bool create(char const *name, unsigned nRecs, unsigned nSlabs,
+                unsigned slabSize);            /* nRecs: power of 2 */
+    bool attach(char const *name);
+    static void unlink(char const *name);
+
+                                                   /* producer side */
+    void *alloc(unsigned len);              /* payload slab, 0 if none */
+    void free(void *payload);         /* a slab alloc() gave, not posted */
+    /* false when the ring is full: the payload is still the caller's, to
+       post again later or to free() */
+    bool post(unsigned dst, Event evt, void *payload, unsigned len);
+    bool post(unsigned dst, Event evt) { return post(dst, evt, 0, 0); }
+
+                                                   /* consumer side */
+    void *payload(ShmMsg const *msg) const;
+    unsigned dispatch(Hsm *const *machines, unsigned nMachines,
+                      unsigned max);            /* returns # dispatched */
+    bool wait(int timeoutMs);      /* park until posted, false on timeout */
+    unsigned long wakeups() const;            /* futex wakes issued so far */
+};
+
+#endif /* shmq_h */
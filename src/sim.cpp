@@ -0,0 +1,305 @@
+/** sim.cpp -- scripted bulk event driver implementation
+ */
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "log.h"
+
+#define SIM_MAGIC_LEN 8
+#define SIM_WORD_SIG  0x00000000u                     /* top two bits */
+#define SIM_WORD_SEL  0x40000000u
+#define SIM_WORD_REP  0x80000000u
+#define SIM_WORD_OP   0xC0000000u
+#define SIM_WORD_ARG  0x3FFFFFFFu
+#define SIM_ALL       SIM_WORD_ARG               /* selects every machine */
+
+enum { OP_SIGNAL, OP_SELECT, OP_BAD };
+
+struct SimOp {                                       /* one parsed token */
+    int kind;
+    unsigned long val;                    /* signal, machine or SIM_ALL */
+    unsigned long count;                       /* times, signals only */
+};
+
+/* streaming parser over the mapped script, text or binary.................*/
+class SimCursor {
+    char const *p, *end;
+    bool binary;
+
+    static unsigned long num(char const **q, char const *e) {
+        unsigned long v = 0;
+        for (; *q < e && '0' <= **q && **q <= '9'; ++*q) {
+            v = v * 10 + (unsigned long)(**q - '0');
+        }
+        return v;
+    }
+    static unsigned word(char const *q) {                /* little-endian */
+        unsigned char const *u = (unsigned char const *)q;
+        return u[0] | u[1] << 8 | u[2] << 16 | (unsigned)u[3] << 24;
+    }
+    bool nextBinary(SimOp *op) {
+        op->count = 1;
+        while (end - p >= 4) {
+            unsigned w = word(p);
+            p += 4;
+            switch (w & SIM_WORD_OP) {
+            case SIM_WORD_SIG:
+                op->kind = OP_SIGNAL;
+                op->val = w & SIM_WORD_ARG;
+                return true;
+            case SIM_WORD_SEL:
+                op->kind = OP_SELECT;
+                op->val = w & SIM_WORD_ARG;
+                return true;
+            case SIM_WORD_REP:
+                op->count = w & SIM_WORD_ARG;       /* for the next signal */
+                break;
+            default:
+                op->kind = OP_BAD;
+                op->val = 0;                   /* compile() tests val too */
+                return true;
+            }
+        }
+        return false;
+    }
+    bool nextText(SimOp *op) {
+        for (;;) {
+            if (p == end) {
+                return false;
+            }
+            char c = *p;
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                ++p;
+            }
+            else if (c == '#') {
+                char const *nl = (char const *)memchr(p, '\n', end - p);
+                p = nl ? nl + 1 : end;
+            }
+            else {
+                break;
+            }
+        }
+        op->count = 1;
+        if (*p == '@') {
+            op->kind = OP_SELECT;
+            if (++p < end && *p == '*') {
+                ++p;
+                op->val = SIM_ALL;
+            }
+            else {
+                char const *d = p;
+                op->val = num(&p, end);
+                op->kind = p == d ? OP_BAD : OP_SELECT;
+            }
+        }
+        else {
+            char const *d = p;
+            op->kind = OP_SIGNAL;
+            op->val = num(&p, end);
+            if (p == d) {
+                op->kind = OP_BAD;
+            }
+            else if (p < end && *p == '*') {
+                ++p;
+                op->count = num(&p, end);
+            }
+        }
+        if (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'
+            && *p != '#')
+        {
+            op->kind = OP_BAD;                       /* skip the rest of it */
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\r'
+                   && *p != '\n')
+            {
+                ++p;
+            }
+        }
+        return true;
+    }
+public:
+    SimCursor(SimScript const *s, char const *base, size_t len)
+            : p(base), end(base + len), binary(s->isBinary())
+    {
+        if (binary) {
+            p += SIM_MAGIC_LEN;
+        }
+    }
+    bool next(SimOp *op) {
+        return binary ? nextBinary(op) : nextText(op);
+    }
+};
+
+/* buffered trace output, formatted by hand................................*/
+class SimOut {
+    FILE *f;
+    size_t n;
+    char buf[SIM_OUT_BUF];
+public:
+    explicit SimOut(FILE *out) : f(out), n(0) {}
+    ~SimOut() { flush(); }
+    void flush() {
+        if (n != 0) {
+            fwrite(buf, 1, n, f);
+            n = 0;
+        }
+    }
+    void str(char const *s, size_t len) {
+        if (n + len > sizeof(buf)) {
+            flush();
+        }
+        memcpy(buf + n, s, len);
+        n += len;
+    }
+    void num(long v) {
+        char d[24];
+        int i = sizeof(d);
+        unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+        do {
+            d[--i] = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0) {
+            d[--i] = '-';
+        }
+        str(d + i, sizeof(d) - i);
+    }
+};
+
+/* SimScript................................................................*/
+SimScript::~SimScript() {
+    if (base) {
+        munmap((void *)base, len);
+    }
+}
+
+bool SimScript::open(char const *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);                                   /* the mapping stays */
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    base = (char const *)p;
+    len = (size_t)st.st_size;
+    return true;
+}
+
+bool SimScript::isBinary() const {
+    return len >= SIM_MAGIC_LEN && memcmp(base, SIM_MAGIC, SIM_MAGIC_LEN) == 0;
+}
+
+static void putWord(FILE *out, unsigned w) {
+    unsigned char b[4] = { (unsigned char)w, (unsigned char)(w >> 8),
+                           (unsigned char)(w >> 16),
+                           (unsigned char)(w >> 24) };
+    fwrite(b, 1, 4, out);
+}
+
+bool SimScript::compile(FILE *out) const {
+    if (isBinary()) {
+        return false;
+    }
+    SimCursor cur(this, base, len);
+    SimOp op{};
+    fwrite(SIM_MAGIC, 1, SIM_MAGIC_LEN, out);
+    while (cur.next(&op)) {
+        if (op.kind == OP_BAD || op.val > SIM_WORD_ARG) {
+            putWord(out, SIM_WORD_OP);                /* kept, and skipped */
+        }
+        else if (op.kind == OP_SELECT) {
+            putWord(out, SIM_WORD_SEL | (unsigned)op.val);
+        }
+        else {
+            for (unsigned long left = op.count; left != 0;) {
+                unsigned long n = left < SIM_WORD_ARG ? left : SIM_WORD_ARG;
+                if (n != 1) {
+                    putWord(out, SIM_WORD_REP | (unsigned)n);
+                }
+                putWord(out, SIM_WORD_SIG | (unsigned)op.val);
+                left -= n;
+            }
+        }
+    }
+    return ferror(out) == 0;
+}
+
+/* Sim Ctor.................................................................*/
+Sim::Sim(Hsm *const *m, unsigned nm, Msg const *const *ms, unsigned nms)
+        : machines(m), nMachines(nm), msgs(ms), nMsgs(nms), nSkipped(0)
+{}
+
+unsigned long Sim::run(SimScript const *script, FILE *out, SimTraceMode mode)
+{
+    SimCursor cur(script, script->base, script->len);
+    SimOut trace(out);
+    SimOp op{};
+    unsigned long n = 0, sel = 0;
+    FILE *logOut = Log::out;
+    int logMode = Log::mode.load();
+    if (mode == SIM_TRACE_ACTIONS) {
+        Log::out = out;
+        Log::setMode(LOG_SYNC);
+    }
+    while (cur.next(&op)) {
+        if (op.kind == OP_SELECT) {
+            sel = op.val;
+            continue;
+        }
+        unsigned long first = sel == SIM_ALL ? 0 : sel;
+        unsigned long last = sel == SIM_ALL ? nMachines : sel + 1;
+        if (op.kind == OP_BAD || op.val >= nMsgs || last > nMachines) {
+            nSkipped += op.count;
+            continue;
+        }
+        Msg const *msg = msgs[op.val];
+        n += op.count * (last - first);
+        if (mode == SIM_TRACE_OFF) {
+            for (unsigned long c = 0; c < op.count; ++c) {
+                for (unsigned long m = first; m < last; ++m) {
+                    machines[m]->onEvent(msg);
+                }
+            }
+            continue;
+        }
+        for (unsigned long c = 0; c < op.count; ++c) {
+            for (unsigned long m = first; m < last; ++m) {
+                Hsm *h = machines[m];
+                if (nMachines > 1) {
+                    trace.str("m", 1);
+                    trace.num((long)m);
+                    trace.str(" ", 1);
+                }
+                trace.str("Event<-", 7);
+                trace.num((long)op.val);
+                trace.str("\t", 1);
+                if (mode == SIM_TRACE_ACTIONS) {
+                    trace.flush();         /* handlers print to out now */
+                    h->onEvent(msg);
+                }
+                else {
+                    h->onEvent(msg);
+                    char const *s = h->getStateName(h->curr);
+                    trace.str(s, strlen(s));
+                }
+                trace.str("\n", 1);
+            }
+        }
+    }
+    trace.flush();
+    if (mode == SIM_TRACE_ACTIONS) {
+        Log::out = logOut;
+        Log::setMode((LogMode)logMode);
+    }
+    return n;
+}
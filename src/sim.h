@@ -0,0 +1,67 @@
+/** sim.h -- scripted bulk event driver for offline simulation
+ *
+ * A SimScript is a memory-mapped event script, in text or in a compiled
+ * binary form, that a Sim parses as it goes and dispatches into one or
+ * many machines, writing a trace that can be diffed against a golden file.
+ *
+ * Text scripts are whitespace-separated tokens, '#' comments to the end
+ * of the line:
+ *
+ *     1 1 1 1        # signal numbers, the index into the Msg table
+ *     2*1000         # signal 2, a thousand times
+ *     @3 0           # from now on to machine 3 only (initially @0) ...
+ *     @* 2           # ... or to every machine, in order
+ *
+ * The binary form (compile()) starts with SIM_MAGIC and holds one 32-bit
+ * little-endian word per token: the top two bits tell a signal, a machine
+ * selection (all ones: every machine) or a repeat count for the signal in
+ * the following word.
+ *
+ * Traces, one line per dispatch, prefixed with "m<index> " when there is
+ * more than one machine:
+ *   SIM_TRACE_STATES   "Event<-<signal>\t<state after the event>"
+ *   SIM_TRACE_ACTIONS  "Event<-<signal>\t" plus whatever the handlers LOG,
+ *                      the form of test/manTest.txt. This switches Log to
+ *                      LOG_SYNC into the trace file and runs at the speed
+ *                      of printf(); the other modes are meant for volume.
+ */
+#ifndef sim_h
+#define sim_h
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "hsm.h"
+
+#define SIM_MAGIC   "HSMSIM1\n"                /* 8 bytes, binary scripts */
+#define SIM_OUT_BUF (1 << 16)             /* bytes of trace buffered */
+
+enum SimTraceMode { SIM_TRACE_OFF, SIM_TRACE_STATES, SIM_TRACE_ACTIONS };
+
+class SimScript {
+    char const *base;                                   /* mapped file */
+    size_t len;
+public:
+    SimScript() : base(0), len(0) {}
+    ~SimScript();
+    bool open(char const *path);
+    bool isBinary() const;
+    bool compile(FILE *out) const;      /* write the binary form of a text */
+    friend class Sim;
+};
+
+class Sim {
+    Hsm *const *machines;
+    unsigned nMachines;
+    Msg const *const *msgs;                       /* by signal number */
+    unsigned nMsgs;
+    unsigned long nSkipped;          /* unknown signals or machine numbers */
+public:
+    Sim(Hsm *const *machines, unsigned nMachines, Msg const *const *msgs,
+        unsigned nMsgs);
+    /* started machines; out may be 0 with SIM_TRACE_OFF. # dispatched */
+    unsigned long run(SimScript const *script, FILE *out, SimTraceMode mode);
+    unsigned long skipped() const { return nSkipped; }
+};
+
+#endif /* sim_h */
@@ -0,0 +1,120 @@
+/** snapshot.cpp -- compact records of a machine's state
+ */
+#include <string.h>
+#include "snapshot.h"
+
+/* Snapshot Ctor............................................................*/
+Snapshot::Snapshot(Hsm const *p)
+        : proto(p), nFields(0), len(2)                 /* the current state */
+{}
+
+Snapshot::Field *Snapshot::add_(void const *field, unsigned size) {
+    long off = (char const *)field - (char const *)proto;
+    assert(0 <= off && off < SNAP_MAX_OFFSET && nFields < SNAP_MAX_FIELDS);
+    Field *f = &fields[nFields++];
+    f->off = (unsigned short)off;
+    f->size = (unsigned short)size;
+    f->isState = false;
+    f->base = f->period = 0;
+    len += size;
+    return f;
+}
+
+/* register extended state the machine's behavior depends on................*/
+void Snapshot::reg(void const *field, unsigned size) {
+    unsigned short off = (unsigned short)((char const *)field
+                                          - (char const *)proto);
+    if (nFields != 0) {               /* adjacent members: one memcpy() */
+        Field *f = &fields[nFields - 1];
+        if (!f->isState && f->period == 0 && f->off + f->size == off) {
+            f->size = (unsigned short)(f->size + size);
+            len += size;
+            return;
+        }
+    }
+    add_(field, size);
+}
+
+void Snapshot::regState(State const *const *slot) {
+    add_(slot, 2)->isState = true;
+}
+
+/* a counter >= base that behaves the same modulo period....................*/
+void Snapshot::regPeriodic(unsigned const *field, unsigned base,
+                           unsigned period)
+{
+    assert(period != 0);
+    Field *f = add_(field, sizeof(*field));
+    f->base = base;
+    f->period = period;
+}
+
+/* State member: offset in the machine; constant State: after all those....*/
+unsigned short Snapshot::offsetOf(Hsm const *m, State const *s) const {
+    if (s == 0) {
+        return SNAP_NO_STATE;
+    }
+    HsmTopo const *t = m->topo;
+    if (t->states && t->states <= s && s < t->states + t->nStates) {
+        return (unsigned short)(SNAP_MAX_OFFSET + (s - t->states));
+    }
+    long off = (char const *)s - (char const *)m;
+    assert(0 <= off && off < SNAP_MAX_OFFSET);
+    return (unsigned short)off;
+}
+
+State const *Snapshot::stateAt(Hsm const *m, unsigned short off) const {
+    if (off == SNAP_NO_STATE) {
+        return 0;
+    }
+    if (off >= SNAP_MAX_OFFSET) {
+        return &m->topo->states[off - SNAP_MAX_OFFSET];
+    }
+    return (State const *)((char const *)m + off);
+}
+
+void Snapshot::encode(Hsm const *m, unsigned char *snap) const {
+    unsigned short off = offsetOf(m, m->curr);
+    unsigned char *k = snap + 2;
+    memcpy(snap, &off, 2);
+    for (unsigned i = 0; i < nFields; ++i) {
+        char const *p = (char const *)m + fields[i].off;
+        if (fields[i].isState) {
+            off = offsetOf(m, *(State const *const *)p);
+            memcpy(k, &off, 2);
+        }
+        else if (fields[i].period != 0) {
+            unsigned v = (*(unsigned const *)p - fields[i].base)
+                         % fields[i].period;
+            memcpy(k, &v, sizeof(v));
+        }
+        else {
+            memcpy(k, p, fields[i].size);
+        }
+        k += fields[i].size;
+    }
+}
+
+void Snapshot::decode(Hsm *m, unsigned char const *snap) const {
+    unsigned short off;
+    unsigned char const *k = snap + 2;
+    memcpy(&off, snap, 2);
+    m->curr = stateAt(m, off);
+    m->next = 0;
+    for (unsigned i = 0; i < nFields; ++i) {
+        char *p = (char *)m + fields[i].off;
+        if (fields[i].isState) {
+            memcpy(&off, k, 2);
+            *(State const **)p = stateAt(m, off);
+        }
+        else if (fields[i].period != 0) {
+            unsigned v;
+            memcpy(&v, k, sizeof(v));
+            *(unsigned *)p = fields[i].base + v;
+        }
+        else {
+            memcpy(p, k, fields[i].size);
+        }
+        k += fields[i].size;
+    }
+}
@@ -0,0 +1,55 @@
+/** snapshot.h -- compact records of a machine's state
+ *
+ * A Snapshot describes what of a machine class makes up its state: the
+ * current state, always, and the fields registered with reg(), regState()
+ * and regPeriodic(). encode() writes a machine into size() bytes and
+ * decode() writes them back into another instance of the class, so the
+ * machine is in the state it was in without running an entry action.
+ *
+ * State pointers are stored as 2 bytes: the offset of a State member in
+ * the machine, or for a constant topology (HsmTopo) the index of the
+ * state after all possible offsets. Plain fields are copied as bytes,
+ * adjacent ones with one memcpy(). A periodic field is an unsigned that
+ * counts from a base and only matters modulo its period, such as a year
+ * for the Gregorian calendar; it is stored modulo the period and comes
+ * back within the first period from the base.
+ *
+ * The Explorer keys its visited set by snapshots, and HsmClass hibernates
+ * machines as them. Fields are registered against a prototype instance,
+ * before the first encode().
+ */
+#ifndef snapshot_h
+#define snapshot_h
+
+#include <assert.h>
+#include "hsm.h"
+
+#define SNAP_MAX_FIELDS 32
+#define SNAP_MAX_OFFSET 0x8000               /* sizeof the machine, at most */
+#define SNAP_NO_STATE   0xFFFF                 /* a State pointer that is 0 */
+
+class Snapshot {
+    struct Field {
+        unsigned short off, size;
+        bool isState;                   /* State pointer, stored as 2 bytes */
+        unsigned base, period;          /* regPeriodic(), period 0: plain */
+    };
+    Hsm const *proto;                                  /* fields are in it */
+    Field fields[SNAP_MAX_FIELDS];
+    unsigned nFields;
+    unsigned len;                                   /* bytes of a snapshot */
+
+    Field *add_(void const *field, unsigned size);
+public:
+    explicit Snapshot(Hsm const *proto);
+    void reg(void const *field, unsigned size);      /* a member of proto */
+    void regState(State const *const *slot);  /* e.g. a history pointer */
+    void regPeriodic(unsigned const *field, unsigned base, unsigned period);
+    unsigned size() const { return len; }
+    void encode(Hsm const *m, unsigned char *snap) const;   /* size() bytes */
+    void decode(Hsm *m, unsigned char const *snap) const;  /* same class */
+    unsigned short offsetOf(Hsm const *m, State const *s) const;
+    State const *stateAt(Hsm const *m, unsigned short off) const;
+};
+
+#endif /* snapshot_h */
@@ -0,0 +1,24 @@
+/** submachine.cpp -- state hierarchies shared by several machine classes
+ */
+#include "submachine.h"
+
+/* enter the top and down to the entry point, then its initial transitions..*/
+void SubHsm::enter(State const *entryPoint) {
+    curr = &topo->states[0];
+    next = 0;
+    exitPoint = 0;
+    enter_(curr);
+    if (entryPoint != 0) {
+        next = entryPoint;
+        enterNext_();
+    }
+    start_();
+}
+
+/* exit the active states up to and including the top......................*/
+void SubHsm::leave() {
+    for (State const *s = curr; s != 0; s = s->getSuper()) {
+        leave_(s);
+    }
+    curr = &topo->states[0];
+}
@@ -0,0 +1,60 @@
+/** submachine.h -- state hierarchies shared by several machine classes
+ *
+ * A SubHsm is a hierarchy of states written once, with a constant
+ * topology (HsmTopo) of its own, and embedded as a member in any number
+ * of parent machines of different classes. Its handlers, tables and
+ * names exist once in the program. The parents add only a member and
+ * the few lines of the one state that hosts it:
+ *
+ *   case ENTRY_EVT: sub.enter(entryPoint); return 0;
+ *   case EXIT_EVT:  sub.leave(); return 0;
+ *   case START_EVT: return 0;
+ *   default:
+ *       if (sub.onEvent(msg) != 0) {
+ *           return msg;                  // not for the sub: bubble up
+ *       }
+ *       if (sub.takeExit() == SOME_EXIT) {
+ *           STATE_TRAN(&states[S_WHERE_NEXT]);
+ *       }
+ *       return 0;
+ *
+ * Entry points are states of the submachine. enter() runs the entry
+ * actions from its top down to the entry point, then the entry point's
+ * initial transitions. 0 means the usual initial transition of the top.
+ * Exit points are small numbers the handlers of the submachine raise with
+ * SUB_EXIT(). The host reads them with takeExit() after each dispatch and
+ * maps them to transitions of the parent. Leaving the host state by any
+ * transition runs the exit actions of the submachine through leave().
+ *
+ * The submachine keeps its own current state and is traced, timed and
+ * probed under its own name. The Explorer and HsmClass see the host state
+ * only. A parent that is explored or hibernated must also register the
+ * extended state the submachine changes.
+ */
+#ifndef submachine_h
+#define submachine_h
+
+#include <assert.h>
+#include "hsm.h"
+
+class SubHsm : public Hsm {
+    unsigned char exitPoint;             /* raised by SUB_EXIT(), 0 none */
+public:
+    SubHsm(char const *name, HsmTopo const *topo)
+            : Hsm(name, topo), exitPoint(0) {}
+    void enter(State const *entryPoint);             /* 0: the top's start */
+    void leave();                    /* exit every active state, top too */
+    unsigned char takeExit() {                  /* and forget it, 0 none */
+        unsigned char x = exitPoint;
+        exitPoint = 0;
+        return x;
+    }
+protected:
+    void exitTo_(unsigned char x) {
+        assert(x != 0 && exitPoint == 0);
+        exitPoint = x;
+    }
+# define SUB_EXIT(exitPoint_) exitTo_(exitPoint_)
+};
+
+#endif /* submachine_h */
@@ -0,0 +1,167 @@
+/** threaded.cpp -- status-code handlers and a threaded dispatch engine
+ */
+#include "threaded.h"
+#include "probe.h"
+#include "hdr.h"
+
+#define STATUS_CALL_(me_, s_, msg_) \
+    ((me_)->*statusHndlr_((me_)->hndlrs[(s_)->id]))(msg_)
+
+/* StatusHsm Ctor...........................................................*/
+StatusHsm::StatusHsm(char const *n, StatusHndlr topHndlr)
+        : Hsm(n, STATUS_HNDLR(topHndlr)), path(0)
+{}
+
+/* the handler of s, status handlers or those of hsm.h...................*/
+template<bool NATIVE>
+inline void StatusHsm::handle_(Hsm *me, State const *s, Msg const *msg) {
+    if (NATIVE) {
+        (void)STATUS_CALL_(me, s, msg);
+    }
+    else {
+        (void)me->call_(s, msg);
+    }
+}
+
+/* the entry and exit steps of hsm.h, with either kind of handler.........*/
+template<bool NATIVE>
+void StatusHsm::enterState_(Hsm *me, State const *s) {
+    me->hookEntry_(s);
+    handle_<NATIVE>(me, s, &entryMsg_);
+}
+
+template<bool NATIVE>
+void StatusHsm::leaveState_(Hsm *me, State const *s) {
+    me->hookExit_(s);
+    handle_<NATIVE>(me, s, &exitMsg_);
+}
+
+template<bool NATIVE>
+void StatusHsm::enterNext_(Hsm *me) {
+    me->enterNext_([me](State const *s) { enterState_<NATIVE>(me, s); });
+}
+
+/* enter and start the top state, handlers returning HsmStatus..............*/
+void StatusHsm::onStart() {
+    curr = topo->states ? &topo->states[0] : &top;
+    next = 0;
+    enterState_<true>(this, curr);
+    while (STATUS_CALL_(this, curr, &startMsg_), next) {
+        enterNext_<true>(this);
+    }
+}
+
+/* the exits and entries of the transition source -> next from curr........*/
+void StatusHsm::record_(Hsm const *me, HsmPath *p) {
+    State const *s, *lca;
+    State const *entryPath[THREADED_MAX_NESTING];
+    unsigned n = 0, toLca;
+    p->nExit = 0;
+    for (s = me->curr; s != me->source; s = s->getSuper()) {
+        ++p->nExit;
+    }
+    toLca = const_cast<Hsm *>(me)->toLCA_(me->next);
+    for (lca = me->source; toLca; --toLca, lca = lca->getSuper()) {
+        ++p->nExit;
+    }
+    for (s = me->next; s != lca; s = s->getSuper()) {
+        assert(n < THREADED_MAX_NESTING);
+        entryPath[n++] = s;
+    }
+    p->nEntry = (unsigned char)n;
+    for (unsigned i = 0; i < n; ++i) {               /* outermost first */
+        long d = (char const *)entryPath[n - 1 - i]
+                 - (char const *)me->curr;
+        assert(-32768 <= d && d <= 32767);
+        p->entry[i] = (short)d;
+    }
+    p->from = me->curr->id;
+    p->to = me->next->id;
+}
+
+/* the engine: one indirect jump per handler status........................*/
+template<bool NATIVE>
+Msg const *StatusHsm::dispatch_(Hsm *me, Msg const *msg) {
+    static void *const on[] = { &&handled, &&super, &&tran, &&ignored };
+    State const *s = me->curr;
+    HsmTimer const timed = Hsm::timer.load(std::memory_order_acquire);
+    Event const evt = msg->evt;
+    unsigned long long const t0 = timed ? hdrTicks() : 0;
+    HSM_PROBE3I(dispatch, me->name, me->getStateName(s), evt);
+    HsmTracer const traced = Hsm::tracer.load(std::memory_order_acquire);
+    if (traced) {
+        (*traced)(me, s, HSM_TRACE_DISPATCH, evt);
+    }
+#define STATUS_NEXT_() do { \
+    me->source = s; \
+    if (NATIVE) { \
+        goto *on[STATUS_CALL_(me, s, msg)]; \
+    } \
+    Msg const *r_ = me->call_(s, msg);  /* adapted: bubble, tran or not */ \
+    goto *on[r_ ? HSM_SUPER : me->next ? HSM_TRAN : HSM_HANDLED]; \
+} while (0)
+
+    STATUS_NEXT_();
+super:
+    if ((s = s->getSuper()) == 0) {
+        goto ignored;
+    }
+    STATUS_NEXT_();
+tran:
+    HSM_PROBE3(tran, me->name, me->getStateName(me->source),
+               me->getStateName(me->next));
+    if (NATIVE) {                    /* STATE_TRAN() has not exited yet */
+        HsmPath local;
+        HsmPath *p = ((StatusHsm *)me)->path;
+        if (p->ready.load(std::memory_order_acquire) != 2
+            || p->from != me->curr->id || p->to != me->next->id)
+        {
+            unsigned char free = 0;
+            record_(me, &local);
+            if (p->ready.compare_exchange_strong(free, 1)) {
+                p->nExit = local.nExit;         /* first path of the site */
+                p->nEntry = local.nEntry;
+                p->from = local.from;
+                p->to = local.to;
+                for (unsigned i = 0; i < local.nEntry; ++i) {
+                    p->entry[i] = local.entry[i];
+                }
+                p->ready.store(2, std::memory_order_release);
+            }
+            p = &local;
+        }
+        char const *from = (char const *)me->curr;
+        s = me->curr;
+        for (unsigned n = p->nExit; n != 0; --n, s = s->getSuper()) {
+            leaveState_<true>(me, s);
+        }
+        for (unsigned i = 0; i < p->nEntry; ++i) {
+            enterState_<true>(me, (State const *)(from + p->entry[i]));
+        }
+        me->curr = me->next;
+        me->next = 0;
+    }
+    else {                                        /* exited up to the LCA */
+        enterNext_<false>(me);
+    }
+    while (handle_<NATIVE>(me, me->curr, &startMsg_), me->next) {
+        enterNext_<NATIVE>(me);
+    }
+handled:
+    msg = 0;
+ignored:
+#undef STATUS_NEXT_
+    if (timed) {                         /* source: the handler, or top */
+        (*timed)(me, me->source, evt, hdrTicks() - t0);
+    }
+    HSM_PROBE3I(done, me->name, me->getStateName(me->curr), msg == 0);
+    return msg;
+}
+
+Msg const *StatusHsm::onEvent(Msg const *msg) {
+    return dispatch_<true>(this, msg);
+}
+
+Msg const *StatusHsm::adapt(Hsm *me, Msg const *msg) {
+    return dispatch_<false>(me, msg);
+}
@@ -0,0 +1,103 @@
+/** threaded.h -- status-code handlers and a threaded dispatch engine
+ *
+ * In hsm.h a handler returns the message to bubble it up and 0 when it
+ * took it, and the engine works out from 'next' whether a transition
+ * came with it. Handlers of a StatusHsm say what happened instead:
+ *
+ *   HSM_HANDLED   taken, no transition (also for ENTRY_EVT and EXIT_EVT)
+ *   HSM_SUPER     not taken here, try the superstate
+ *   HSM_TRAN      taken with STATUS_TRAN(), or STATE_START() on START_EVT
+ *   HSM_IGNORED   not taken and not to be offered further (top state)
+ *
+ * The engine jumps on the status through a table of label addresses
+ * (GCC/Clang computed goto), one indirect jump per handler call and no
+ * compare chain. The handler does not exit any states. STATUS_TRAN()
+ * only names the target. The engine exits and enters from a path
+ * recorded the first time the call site is taken. That HsmPath is a
+ * static at the STATUS_TRAN() call site, like the LCA depth of
+ * STATE_TRAN(), and holds for the current state and the target it was
+ * recorded with. It keeps the entry states as offsets from the current
+ * state, so it is valid for every instance. Any other pair at the same
+ * call site, another current state or a target that varies, computes its
+ * path on the stack each time.
+ *
+ * Existing handlers need no change. adapt() runs any Hsm, including
+ * Msg-returning handlers, through the same threaded loop. It turns
+ * their return value and 'next' into a status, and STATE_TRAN() exits
+ * as before. Status handlers are registered through STATUS_HNDLR(), so
+ * they share the handler table of hsm.h. A StatusHsm must be driven by
+ * its own onStart() and onEvent(). Hsm::onEvent() would take the status
+ * codes for messages, so a StatusHsm is not an Hsm to other code: the
+ * base is protected and a StatusHsm * does not convert to an Hsm *.
+ */
+#ifndef threaded_h
+#define threaded_h
+
+#include <assert.h>
+#include <string.h>
+#include <atomic>
+#include "hsm.h"
+
+#define THREADED_MAX_NESTING HSM_MAX_NESTING /* entered by one transition */
+
+enum HsmStatus { HSM_HANDLED, HSM_SUPER, HSM_TRAN, HSM_IGNORED };
+
+typedef HsmStatus (Hsm::*StatusHndlr)(Msg const *);
+#define STATUS_HNDLR(h_) statusSlot_((StatusHndlr)(h_))   /* State ctor */
+
+/* the bits of a status handler in an EvtHndlr slot and back: only a
+   StatusHsm calls them, as StatusHndlr, so no function type is cast.....*/
+static_assert(sizeof(EvtHndlr) == sizeof(StatusHndlr), "handler slot");
+inline EvtHndlr statusSlot_(StatusHndlr h) {
+    EvtHndlr e;
+    memcpy(&e, &h, sizeof(e));
+    return e;
+}
+inline StatusHndlr statusHndlr_(EvtHndlr e) {
+    StatusHndlr h;
+    memcpy(&h, &e, sizeof(h));
+    return h;
+}
+
+struct HsmPath {          /* a transition, recorded when first taken */
+    std::atomic<unsigned char> ready;   /* 0 free, 1 recording, 2 ready */
+    unsigned char nExit;                 /* curr up to, not incl., LCA */
+    unsigned char nEntry;
+    unsigned short from;                       /* id of curr when taken */
+    unsigned short to;                               /* id of the target */
+    short entry[THREADED_MAX_NESTING];   /* LCA down to target, from curr */
+};
+
+class StatusHsm : protected Hsm {
+    HsmPath *path;                 /* of the STATUS_TRAN() being taken */
+public:
+    StatusHsm(char const *name, StatusHndlr topHndlr);
+    void onStart();
+    Msg const *onEvent(Msg const *msg);   /* msg back if ignored, else 0 */
+    static Msg const *adapt(Hsm *me, Msg const *msg);  /* hsm.h handlers */
+    using Hsm::getName;
+    using Hsm::getStateName;
+    using Hsm::isTop;
+protected:
+    void tranTo_(HsmPath *p, State const *target) {
+        assert(next == 0);
+        next = target;
+        path = p;
+    }
+# define STATUS_TRAN(target_) if (1) { \
+    static HsmPath path_; \
+    tranTo_(&path_, (target_)); \
+    return HSM_TRAN; \
+} else ((void)0)
+private:
+    template<bool NATIVE>
+    static Msg const *dispatch_(Hsm *me, Msg const *msg);
+    template<bool NATIVE>
+    static void handle_(Hsm *me, State const *s, Msg const *msg);
+    template<bool NATIVE> static void enterState_(Hsm *me, State const *s);
+    template<bool NATIVE> static void leaveState_(Hsm *me, State const *s);
+    template<bool NATIVE> static void enterNext_(Hsm *me);
+    static void record_(Hsm const *me, HsmPath *p);
+};
+
+#endif /* threaded_h */
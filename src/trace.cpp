@@ -0,0 +1,388 @@
+/** trace.cpp -- Chrome trace-event exporter implementation
+ */
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "epoch.h"
+#include "trace.h"
+
+#define CACHE_LINE 64
+
+struct TraceBuf {               /* single-producer ring of one thread */
+    alignas(CACHE_LINE) std::atomic<unsigned> head;           /* writer */
+    alignas(CACHE_LINE) std::atomic<unsigned> tail;         /* producer */
+    std::atomic<bool> owned;              /* a live thread produces here */
+    std::atomic<long> tid;                      /* OS thread that owns it */
+    TraceBuf *next;                                  /* all rings, ever */
+    TraceRec rec[TRACE_RING];
+};
+
+struct TraceOwner {        /* hands the ring back when its thread exits */
+    TraceBuf *buf;
+    ~TraceOwner() {
+        if (buf) {
+            buf->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+struct Staged {                              /* a record waiting for order */
+    TraceRec rec;
+    long tid;
+};
+
+struct Track {                                  /* one machine's timeline */
+    unsigned pid;
+    unsigned depth;
+    struct {
+        char const *state;
+        unsigned long long ts;
+    } open[TRACE_MAX_DEPTH];
+};
+
+static std::atomic<TraceBuf *> bufs(0);
+static thread_local TraceOwner myBuf;
+static std::mutex drainLock;
+static std::thread writer;
+static std::atomic<bool> running(false);
+static HsmHook<HsmTracer> hook(&Hsm::tracer, &Trace::record);
+static std::atomic<unsigned long> nDropped(0);
+static unsigned long nWritten;
+
+static FILE *out;                         /* the rest belongs to the writer */
+static TraceSigName sigName;
+static std::vector<Staged> staged;
+static std::unordered_map<Hsm const *, Track> tracks;
+static std::unordered_set<unsigned long long> namedThreads;
+static unsigned nPids;
+static unsigned long long t0, tLast;
+
+static unsigned long long nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ring of the calling thread, recycled from exited threads if possible....*/
+static TraceBuf *threadBuf() {
+    TraceBuf *b;
+    for (b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        bool free = false;
+        if (b->owned.compare_exchange_strong(free, true,
+                                             std::memory_order_acquire)) {
+            break;
+        }
+    }
+    if (b == 0) {
+        b = new TraceBuf;
+        b->head.store(0, std::memory_order_relaxed);
+        b->tail.store(0, std::memory_order_relaxed);
+        b->owned.store(true, std::memory_order_relaxed);
+        b->next = bufs.load(std::memory_order_relaxed);
+        while (!bufs.compare_exchange_weak(b->next, b,
+                                           std::memory_order_release)) {
+        }
+    }
+    b->tid.store(syscall(SYS_gettid), std::memory_order_relaxed);
+    return b;
+}
+
+/* hot path: copy the record into this thread's ring, never block..........*/
+void Trace::record(Hsm const *me, State const *s, int kind, Event evt) {
+    EpochGuard guard;                     /* stop() waits for us to leave */
+    if (running.load()) {
+        TraceBuf *b = myBuf.buf;
+        if (b == 0) {
+            b = myBuf.buf = threadBuf();
+        }
+        unsigned t = b->tail.load(std::memory_order_relaxed);
+        if (t - b->head.load(std::memory_order_acquire) == TRACE_RING) {
+            nDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            TraceRec *r = &b->rec[t & (TRACE_RING - 1)];
+            r->ts = nowNs();
+            r->hsm = me;
+            r->machine = me->getName();
+            r->state = me->getStateName(s);
+            r->evt = evt;
+            r->kind = kind;
+            r->started = kind == HSM_TRACE_ENTRY && me->isTop(s);
+            b->tail.store(t + 1, std::memory_order_release);
+        }
+    }
+    HsmTracer const next = hook.next();
+    if (next) {
+        (*next)(me, s, kind, evt);
+    }
+}
+
+/* JSON output, one event per line, formatted by hand for speed...........*/
+#define TRACE_MAX_NAME 96                    /* longer names are truncated */
+
+static char line[8 * TRACE_MAX_NAME];                /* event being built */
+
+static char *cat(char *p, char const *s) {
+    while (*s) {
+        *p++ = *s++;
+    }
+    return p;
+}
+
+static char *catStr(char *p, char const *s) {  /* quoted, escaped if need be */
+    char const *end = p + TRACE_MAX_NAME;
+    *p++ = '"';
+    for (; *s && p < end; ++s) {
+        if (*s == '"' || *s == '\\') {
+            *p++ = '\\';
+        }
+        if ((unsigned char)*s >= ' ') {
+            *p++ = *s;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+static char *catU(char *p, unsigned long long v) {
+    char d[24];
+    int n = 0;
+    do {
+        d[n++] = (char)('0' + v % 10);
+    } while (v /= 10);
+    while (n) {
+        *p++ = d[--n];
+    }
+    return p;
+}
+
+static char *catUs(char *p, unsigned long long ns) { /* ns as us.nnn */
+    p = catU(p, ns / 1000);
+    unsigned f = (unsigned)(ns % 1000);
+    *p++ = '.';
+    *p++ = (char)('0' + f / 100);
+    *p++ = (char)('0' + f / 10 % 10);
+    *p++ = (char)('0' + f % 10);
+    return p;
+}
+
+static void put(char *p) {                /* the event that ends before p */
+    if (nWritten++) {
+        fputs(",\n", out);
+    }
+    else {
+        fputc('\n', out);
+    }
+    fwrite(line, 1, (size_t)(p - line), out);
+}
+
+static void meta(unsigned pid, long tid, char const *what,
+                 char const *arg, char const *val)
+{
+    char *p = cat(line, "{\"ph\":\"M\",\"name\":\"");
+    p = cat(p, what);
+    p = cat(p, "\",\"pid\":");
+    p = catU(p, pid);
+    if (tid >= 0) {
+        p = cat(p, ",\"tid\":");
+        p = catU(p, (unsigned long long)tid);
+    }
+    p = cat(p, ",\"args\":{\"");
+    p = cat(p, arg);
+    p = cat(p, "\":");
+    p = val[0] == '-' ? cat(p, val) : catStr(p, val);
+    put(cat(p, "}}"));
+}
+
+static void slice(Track const *k, char const *state,
+                  unsigned long long from, unsigned long long to);
+
+static Track *trackOf(TraceRec const *r) {
+    if (r->started) {           /* a new machine, or restarted: new track */
+        auto m = tracks.find(r->hsm);
+        if (m != tracks.end()) {
+            Track *k = &m->second;
+            for (unsigned d = k->depth; d-- > 0; ) {
+                slice(k, k->open[d].state, k->open[d].ts, r->ts);
+            }
+            tracks.erase(m);
+        }
+    }
+    Track *k = &tracks[r->hsm];
+    if (k->pid == 0) {                                  /* first sighting */
+        k->pid = ++nPids;
+        meta(k->pid, -1, "process_name", "name", r->machine);
+        meta(k->pid, 0, "thread_name", "name", "states");
+        meta(k->pid, 0, "thread_sort_index", "sort_index", "-1");
+    }
+    return k;
+}
+
+static void slice(Track const *k, char const *state,
+                  unsigned long long from, unsigned long long to)
+{
+    char *p = cat(line, "{\"ph\":\"X\",\"name\":");
+    p = catStr(p, state);
+    p = cat(p, ",\"cat\":\"state\",\"pid\":");
+    p = catU(p, k->pid);
+    p = cat(p, ",\"tid\":0,\"ts\":");
+    p = catUs(p, from - t0);
+    p = cat(p, ",\"dur\":");
+    p = catUs(p, to - from);
+    put(cat(p, "}"));
+}
+
+static void emit(Staged const *st) {
+    TraceRec const *r = &st->rec;
+    Track *k = trackOf(r);
+    tLast = r->ts;
+    switch (r->kind) {
+    case HSM_TRACE_ENTRY:
+        if (k->depth < TRACE_MAX_DEPTH) {          /* deeper ones not shown */
+            k->open[k->depth].state = r->state;
+            k->open[k->depth].ts = r->ts;
+            ++k->depth;
+        }
+        break;
+    case HSM_TRACE_EXIT:
+        for (unsigned d = k->depth; d-- > 0; ) {
+            if (k->open[d].state == r->state) {  /* above it: lost exits */
+                slice(k, r->state, k->open[d].ts, r->ts);
+                k->depth = d;
+                break;
+            }
+        }
+        break;                 /* not open: entered before start() or lost */
+    default: {                                         /* HSM_TRACE_DISPATCH */
+        if (namedThreads.insert((unsigned long long)k->pid << 32 |
+                                (unsigned)st->tid).second)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "thread %ld", st->tid);
+            meta(k->pid, st->tid, "thread_name", "name", name);
+        }
+        char *p = cat(line, "{\"ph\":\"i\",\"s\":\"t\",\"name\":");
+        char const *sig = sigName ? (*sigName)(r->evt) : 0;
+        if (sig) {
+            p = catStr(p, sig);
+        }
+        else {
+            p = cat(p, "\"evt ");
+            if (r->evt < 0) {
+                *p++ = '-';
+            }
+            p = catU(p, (unsigned long long)(r->evt < 0 ? -(long long)r->evt
+                                                        : r->evt));
+            *p++ = '"';
+        }
+        p = cat(p, ",\"cat\":\"msg\",\"pid\":");
+        p = catU(p, k->pid);
+        p = cat(p, ",\"tid\":");
+        p = catU(p, (unsigned long long)st->tid);
+        p = cat(p, ",\"ts\":");
+        p = catUs(p, r->ts - t0);
+        p = cat(p, ",\"args\":{\"state\":");
+        p = catStr(p, r->state);
+        put(cat(p, "}}"));
+        break;
+    }
+    }
+}
+
+/* move new records to the staging area, write those old enough to order...*/
+static unsigned drain(unsigned long long cutoff) {  /* holds drainLock */
+    unsigned n = 0;
+    for (TraceBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        unsigned h = b->head.load(std::memory_order_relaxed);
+        unsigned t = b->tail.load(std::memory_order_acquire);
+        for (; h != t; ++h, ++n) {
+            Staged st = { b->rec[h & (TRACE_RING - 1)],
+                           b->tid.load(std::memory_order_relaxed) };
+            if (st.rec.ts >= t0) {             /* not from an earlier run */
+                staged.push_back(st);
+            }
+        }
+        b->head.store(h, std::memory_order_release);
+    }
+    std::stable_sort(staged.begin(), staged.end(),
+                     [](Staged const &a, Staged const &b) {
+                         return a.rec.ts < b.rec.ts;
+                     });
+    size_t i = 0;
+    for (; i < staged.size() && staged[i].rec.ts <= cutoff; ++i) {
+        emit(&staged[i]);
+    }
+    staged.erase(staged.begin(), staged.begin() + i);
+    return n;
+}
+
+static void writerMain() {
+    while (running.load(std::memory_order_relaxed)) {
+        unsigned n;
+        {
+            std::lock_guard<std::mutex> lock(drainLock);
+            n = drain(nowNs() - TRACE_SLACK_NS);
+        }
+        if (n == 0) {
+            usleep(1000);                              /* nothing to do */
+        }
+    }
+}
+
+bool Trace::start(FILE *o, TraceSigName names) {
+    if (running.load()) {
+        return false;
+    }
+    out = o;
+    sigName = names;
+    nWritten = 0;
+    nPids = 0;
+    tracks.clear();
+    namedThreads.clear();
+    for (TraceBuf *b = bufs.load(std::memory_order_acquire); b; b = b->next) {
+        b->head.store(b->tail.load(std::memory_order_acquire),
+                      std::memory_order_release);    /* left from before */
+    }
+    t0 = tLast = nowNs();
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    running.store(true);
+    writer = std::thread(&writerMain);
+    hook.install();
+    return true;
+}
+
+void Trace::stop() {
+    if (!running.load()) {
+        return;
+    }
+    hook.remove();
+    running.store(false);
+    Epoch::barrier();              /* no record() still writes a ring */
+    writer.join();
+    std::lock_guard<std::mutex> lock(drainLock);
+    drain(~0ULL);
+    for (auto &m : tracks) {              /* close what is still occupied */
+        Track *k = &m.second;
+        for (unsigned d = k->depth; d-- > 0; ) {
+            slice(k, k->open[d].state, k->open[d].ts, tLast);
+        }
+        k->depth = 0;
+    }
+    fprintf(out, "\n]}\n");
+    fflush(out);
+}
+
+unsigned long Trace::dropped() {
+    return nDropped.load(std::memory_order_relaxed);
+}
+
+unsigned long Trace::written() {
+    return nWritten;
+}
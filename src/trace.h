@@ -0,0 +1,63 @@
+/** trace.h -- timeline export in Chrome trace-event format
+ *
+ * Trace::start() hooks Hsm::tracer and streams what every machine does to
+ * a JSON file that chrome://tracing and ui.perfetto.dev open directly.
+ * Each machine gets a process of its own in the timeline. Its "states"
+ * track shows the nested state occupancy as duration slices, entry to
+ * exit, and each thread that dispatched to it gets a track with one
+ * instant event per Msg, tagged with the state it was delivered in.
+ *
+ * Recording only copies a few words into a lock-free ring owned by the
+ * calling thread, as Log does. A background writer drains the rings about
+ * once a millisecond, puts the records in time order and writes them out,
+ * so memory stays bounded however long the capture runs: the rings, a
+ * millisecond or so of records being ordered, and an open-slice stack per
+ * machine. Records that find their ring full are counted and dropped.
+ *
+ * States a machine already occupied when tracing started show no slice,
+ * and slices still open at stop() are closed at the last recorded time.
+ * stop() should follow the last dispatch of the traced threads. It waits
+ * for record() calls under way with an Epoch::barrier(), so it must not
+ * be called from inside an EpochGuard or a handler. A machine is known
+ * by its address; onStart() opens a new timeline for it, so a machine
+ * built where another one was starts afresh.
+ *
+ * The hook chains to a tracer installed before start(). stop() restores
+ * it, unless another hook was installed over this one meanwhile; record()
+ * then only passes the calls on.
+ */
+#ifndef trace_h
+#define trace_h
+
+#include <assert.h>
+#include <stdio.h>
+#include "hsm.h"
+
+#define TRACE_RING      4096            /* records per thread, power of 2 */
+#define TRACE_MAX_DEPTH 16                /* nested states per machine */
+#define TRACE_SLACK_NS  1000000    /* wait for records this late, in ns */
+
+typedef char const *(*TraceSigName)(Event evt);       /* 0: print number */
+
+struct TraceRec {                           /* one record in a thread ring */
+    unsigned long long ts;                           /* CLOCK_MONOTONIC ns */
+    Hsm const *hsm;
+    char const *machine;                     /* names outlive the machine */
+    char const *state;
+    Event evt;
+    int kind;                                         /* see HsmTraceKind */
+    bool started;                      /* entry of the top, by onStart() */
+};
+
+class Trace {
+public:
+    static bool start(FILE *out, TraceSigName sigName = 0);
+    static void stop();                  /* unhook, drain, close the JSON */
+    static unsigned long dropped();        /* records lost to full rings */
+    static unsigned long written();                 /* trace events out */
+
+    static void record(Hsm const *me, State const *s, int kind,
+                       Event evt);                      /* an HsmTracer */
+};
+
+#endif /* trace_h */
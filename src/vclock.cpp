@@ -0,0 +1,271 @@
+/** vclock.cpp -- discrete-event simulation in virtual time
+ */
+#include <sched.h>
+#include <algorithm>
+#include <functional>
+#include "vclock.h"
+
+static thread_local VShard *inShard;        /* shard whose window runs here */
+
+static inline unsigned slotOf(VTime at, unsigned mask) {
+    return (unsigned)((at * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+/* VShard: due time to bucket, without a node allocated per time...........*/
+unsigned VShard::probe_(VTime at) const {
+    unsigned mask = (unsigned)bucketOf.size() - 1;
+    unsigned i = slotOf(at, mask);
+    while (bucketOf[i].at != at && bucketOf[i].at != VT_NEVER) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void VShard::unmap_(VTime at) {      /* shift the run back over the hole */
+    unsigned mask = (unsigned)bucketOf.size() - 1;
+    unsigned i = probe_(at);
+    assert(bucketOf[i].at == at);
+    for (unsigned j = (i + 1) & mask; bucketOf[j].at != VT_NEVER;
+         j = (j + 1) & mask)
+    {
+        if (((j - slotOf(bucketOf[j].at, mask)) & mask) >= ((j - i) & mask)) {
+            bucketOf[i] = bucketOf[j];
+            i = j;
+        }
+    }
+    bucketOf[i].at = VT_NEVER;
+    --nMapped;
+}
+
+void VShard::grow_() {            /* at most half full; grows, never shrinks */
+    std::vector<VSlot> old;
+    old.swap(bucketOf);
+    bucketOf.assign(old.empty() ? 64 : old.size() * 2, VSlot{VT_NEVER, 0});
+    for (VSlot const &x : old) {
+        if (x.at != VT_NEVER) {
+            bucketOf[probe_(x.at)] = x;
+        }
+    }
+}
+
+/* VShard...................................................................*/
+void VShard::schedule_(VTime at, VEvent const &e) {
+    assert(at != VT_NEVER);
+    if (at != lastDue) {          /* periodic events all land in one bucket */
+        if ((nMapped + 1) * 2 > bucketOf.size()) {
+            grow_();
+        }
+        unsigned i = probe_(at);
+        if (bucketOf[i].at == at) {
+            lastBucket = bucketOf[i].bucket;
+        }
+        else {
+            if (!spare.empty()) {                   /* the roomiest one */
+                std::pop_heap(spare.begin(), spare.end(), Roomier{this});
+                lastBucket = spare.back();
+                spare.pop_back();
+            }
+            else {
+                lastBucket = (unsigned)buckets.size();
+                buckets.emplace_back();
+            }
+            bucketOf[i].at = at;
+            bucketOf[i].bucket = lastBucket;
+            ++nMapped;
+            due.push_back(at);
+            std::push_heap(due.begin(), due.end(), std::greater<VTime>());
+        }
+        lastDue = at;
+    }
+    /* a full bucket trades storage with a roomier spare rather than grow,
+       so once the load is steady no bucket allocates */
+    std::vector<VEvent> &b = buckets[lastBucket];
+    if (b.size() == b.capacity() && !spare.empty()
+        && buckets[spare.front()].capacity() > b.size())
+    {
+        std::pop_heap(spare.begin(), spare.end(), Roomier{this});
+        std::vector<VEvent> &r = buckets[spare.back()];
+        r.assign(b.begin(), b.end());
+        r.swap(b);
+        r.clear();
+        std::push_heap(spare.begin(), spare.end(), Roomier{this});
+    }
+    b.push_back(e);
+}
+
+/* dispatch every bucket due before end, in time order.....................*/
+void VShard::window_(VTime end) {
+    while (!due.empty() && due.front() < end) {
+        VTime t = due.front();
+        unsigned b = bucketOf[probe_(t)].bucket;
+        now = t;
+        for (size_t i = 0; i < buckets[b].size(); ++i) {  /* may grow, at t */
+            if (i + VCLOCK_PREFETCH < buckets[b].size()) {   /* a fleet is */
+                __builtin_prefetch(                  /* bigger than cache */
+                    machines[buckets[b][i + VCLOCK_PREFETCH].local], 1);
+            }
+            VEvent e = buckets[b][i];
+            curr = e.local;
+            machines[e.local]->onEvent(e.msg);
+            if (e.period != 0) {
+                schedule_(t + e.period, e);
+            }
+        }
+        nDispatched += buckets[b].size();
+        std::pop_heap(due.begin(), due.end(), std::greater<VTime>());
+        due.pop_back();
+        unmap_(t);
+        buckets[b].clear();                         /* keeps its capacity */
+        spare.push_back(b);
+        std::push_heap(spare.begin(), spare.end(), Roomier{this});
+        if (lastDue == t) {
+            lastDue = VT_NEVER;
+        }
+    }
+}
+
+void *VShard::run_(void *arg) {
+    VShard *s = (VShard *)arg;
+    VClock *c = s->clock;
+    int go;
+    while ((go = c->go.load()) == 0) {        /* until every thread is up */
+        sched_yield();
+    }
+    if (go != 1) {
+        return 0;
+    }
+    inShard = s;
+    s->now = 0;
+    for (unsigned i = 0; i < s->machines.size(); ++i) {
+        s->curr = i;
+        s->machines[i]->onStart();
+    }
+    for (;;) {
+        pthread_barrier_wait(&c->barrier);     /* all windows done: merge */
+        for (unsigned src = 0; src < c->nShards; ++src) {
+            std::vector<VCross> &in = c->shards[src].out[s->idx];
+            for (VCross const &x : in) {
+                s->schedule_(x.due, x.evt);
+            }
+            in.clear();
+        }
+        c->next[s->idx] = s->due.empty() ? VT_NEVER : s->due.front();
+        pthread_barrier_wait(&c->barrier);   /* all merged: agree on start */
+        VTime t = c->firstDue_();
+        if (t == VT_NEVER || t >= c->horizon) {
+            break;
+        }
+        VTime end = t + c->lookahead;
+        if (end > c->horizon || end < t) {
+            end = c->horizon;
+        }
+        if (s->idx == 0) {
+            ++c->nWindows;
+        }
+        s->window_(end);
+    }
+    inShard = 0;
+    return 0;
+}
+
+/* VClock Ctor..............................................................*/
+VClock::VClock(unsigned n, VTime la)
+        : nShards(n), nMachines(0), lookahead(la), horizon(0), nWindows(0),
+          go(0)
+{
+    assert(0 < n && n <= VCLOCK_MAX_SHARDS && la != 0);
+    for (unsigned i = 0; i < n; ++i) {
+        shards[i].clock = this;
+        shards[i].idx = i;
+    }
+}
+
+VClock::~VClock() {}
+
+unsigned VClock::add(Hsm *m) {
+    shards[nMachines % nShards].machines.push_back(m);
+    return nMachines++;
+}
+
+void VClock::every(unsigned id, VTime period, VTime first, Msg const *msg) {
+    assert(id < nMachines && period != 0);
+    VEvent e = { id / nShards, msg, period };
+    shards[id % nShards].schedule_(first, e);
+}
+
+void VClock::at(unsigned id, VTime when, Msg const *msg) {
+    assert(id < nMachines);
+    VEvent e = { id / nShards, msg, 0 };
+    shards[id % nShards].schedule_(when, e);
+}
+
+VTime VClock::firstDue_() const {
+    VTime t = VT_NEVER;
+    for (unsigned i = 0; i < nShards; ++i) {
+        t = std::min(t, next[i]);
+    }
+    return t;
+}
+
+/* shard 0 runs in the caller, the others on threads of their own.........*/
+bool VClock::run(VTime h) {
+    horizon = h;
+    nWindows = 0;
+    if (pthread_barrier_init(&barrier, 0, nShards) != 0) {
+        return false;
+    }
+    go.store(0);
+    unsigned started = 1;
+    for (; started < nShards; ++started) {
+        if (pthread_create(&shards[started].thread, 0, &VShard::run_,
+                           &shards[started]) != 0) {
+            break;
+        }
+    }
+    go.store(started == nShards ? 1 : 2);        /* 2: the others return */
+    if (started == nShards) {
+        VShard::run_(&shards[0]);
+    }
+    for (unsigned i = 1; i < started; ++i) {
+        pthread_join(shards[i].thread, 0);
+    }
+    pthread_barrier_destroy(&barrier);
+    return started == nShards;
+}
+
+unsigned long VClock::dispatched() const {
+    unsigned long n = 0;
+    for (unsigned i = 0; i < nShards; ++i) {
+        n += shards[i].nDispatched;
+    }
+    return n;
+}
+
+/* handler side.............................................................*/
+VTime VClock::now() {
+    assert(inShard != 0);
+    return inShard->now;
+}
+
+void VClock::after(VTime delay, Msg const *msg) {
+    VShard *s = inShard;
+    assert(s != 0);
+    VEvent e = { s->curr, msg, 0 };
+    s->schedule_(s->now + delay, e);
+}
+
+void VClock::post(unsigned id, VTime delay, Msg const *msg) {
+    VShard *s = inShard;
+    assert(s != 0);
+    VClock *c = s->clock;
+    unsigned to = id % c->nShards;
+    VEvent e = { id / c->nShards, msg, 0 };
+    if (to == s->idx) {
+        s->schedule_(s->now + delay, e);
+    }
+    else {                        /* can't be in the window we are in */
+        assert(delay >= c->lookahead);
+        VCross x = { s->now + delay, e };
+        s->out[to].push_back(x);
+    }
+}
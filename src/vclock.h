@@ -0,0 +1,123 @@
+/** vclock.h -- discrete-event simulation of machines in virtual time
+ *
+ * A VClock runs machines against a virtual clock instead of the wall
+ * clock: every event carries the virtual time it is due at, and the
+ * clock jumps straight from one due time to the next, however far apart
+ * they are. A day of 1 Hz ticks takes as long as dispatching the ticks.
+ *
+ * Machines are spread over shards, one thread each, in the order add()
+ * sees them. Shards advance in lock step through windows of virtual time
+ * (conservative synchronisation): a window starts at the earliest event
+ * due anywhere and is lookahead long; every shard dispatches its events
+ * due within it and then waits for the others. An event for a machine of
+ * another shard must therefore be due at least lookahead later, it is
+ * handed over at the end of the window. Events of one machine are always
+ * dispatched in time order, ties in the order they were posted, and the
+ * result does not depend on how the threads were scheduled.
+ *
+ * Handlers use the static functions, which act on the shard running
+ * them: now(), after() for their own timeouts and retries, post() to
+ * other machines.
+ */
+#ifndef vclock_h
+#define vclock_h
+
+#include <assert.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include "hsm.h"
+
+typedef unsigned long long VTime;                      /* nanoseconds */
+
+#define VT_US    1000ULL
+#define VT_MS    (1000 * VT_US)
+#define VT_SEC   (1000 * VT_MS)
+#define VT_NEVER (~0ULL)
+#define VCLOCK_MAX_SHARDS 64
+#define VCLOCK_PREFETCH   8          /* machines touched ahead of dispatch */
+
+struct VEvent {                          /* due at the time of its bucket */
+    unsigned local;                             /* machine in the shard */
+    Msg const *msg;
+    VTime period;                            /* 0: once, else re-armed */
+};
+
+struct VSlot {                   /* due time to bucket, open addressing */
+    VTime at;                                        /* VT_NEVER: free */
+    unsigned bucket;
+};
+
+struct VCross {                 /* an event handed to another shard */
+    VTime due;
+    VEvent evt;
+};
+
+class VClock;
+
+class VShard {                   /* machines of one thread, and their events */
+    VClock *clock;
+    unsigned idx;
+    std::vector<Hsm *> machines;
+    std::vector<VTime> due;                      /* min-heap of bucket times */
+    std::vector<VSlot> bucketOf;     /* by due time, size a power of 2 */
+    unsigned nMapped;                       /* slots of bucketOf in use */
+    std::vector<std::vector<VEvent> > buckets;
+    std::vector<unsigned> spare;       /* unused buckets, roomiest first */
+    VTime lastDue;               /* bucket last scheduled into, memoised */
+    unsigned lastBucket;
+    std::vector<VCross> out[VCLOCK_MAX_SHARDS];        /* by target shard */
+    VTime now;
+    unsigned curr;                               /* machine dispatching */
+    unsigned long nDispatched;
+    pthread_t thread;
+
+    struct Roomier {              /* orders spare by capacity, a max-heap */
+        VShard const *s;
+        bool operator()(unsigned a, unsigned b) const {
+            return s->buckets[a].capacity() < s->buckets[b].capacity();
+        }
+    };
+
+    unsigned probe_(VTime at) const;    /* slot holding at, or a free one */
+    void unmap_(VTime at);
+    void grow_();
+    void schedule_(VTime at, VEvent const &e);
+    void window_(VTime end);               /* dispatch what is due < end */
+    static void *run_(void *me);
+    friend class VClock;
+public:
+    VShard() : clock(0), idx(0), nMapped(0), lastDue(VT_NEVER),
+               lastBucket(0), now(0), curr(0), nDispatched(0) {}
+};
+
+class VClock {
+    VShard shards[VCLOCK_MAX_SHARDS];
+    unsigned nShards, nMachines;
+    VTime lookahead, horizon;
+    VTime next[VCLOCK_MAX_SHARDS];            /* earliest due, per shard */
+    unsigned long nWindows;
+    pthread_barrier_t barrier;
+    std::atomic<int> go;           /* 0 while threads start, 1 run, 2 not */
+
+    VTime firstDue_() const;
+    friend class VShard;
+public:
+    VClock(unsigned nShards, VTime lookahead);
+    ~VClock();
+    unsigned add(Hsm *m);         /* not started: its shard starts it at 0 */
+    void every(unsigned id, VTime period, VTime first, Msg const *msg);
+    void at(unsigned id, VTime when, Msg const *msg);          /* before run */
+    /* once: start the machines and dispatch everything due before
+       horizon; false if the shard threads could not be started */
+    bool run(VTime horizon);
+    unsigned long dispatched() const;
+    unsigned long windows() const { return nWindows; }
+
+    /* from inside a handler, on the shard dispatching it */
+    static VTime now();
+    static void after(VTime delay, Msg const *msg);        /* to ourselves */
+    static void post(unsigned id, VTime delay, Msg const *msg);
+};
+
+#endif /* vclock_h */
@@ -3,123 +3,29 @@
  * M. Samek, 01/07/00
  */
 
-/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * 
-To illustrate the use of the HSM pattern,  consider  a  simple  digital  watch.  
-The  watch  has  two  buttons—which  generate  external events—and  an  internally  generated
-tick event.  
-The  different  events  are handled  differently  depending  upon the  mode  of  operation.  
-The  basic watch operates as follows:
-
-• In timekeeping mode, the user can toggle  between  displaying  date  or  current  time  by  pressing  the
-“mode” button
-• Pressing  the  “set”  button  switches  the watch into setting mode. The sequence  of  adjustments  in  this
-mode is: hour, minute, day, month.
-Adjustments are made by pressing the  “mode”  button,  which  increments the chosen quantity by one.
-Pressing  the  “set”  button  while adjusting  month  puts  the  watch back into timekeeping mode
-• While  in  setting mode  the  watch ignores tick events
-• Upon return to timekeeping mode the watch displays the most recently  selected  information,  that  is,  if
-date  was  selected  prior  to  leaving timekeeping mode,  the  watch resumes displaying the date, otherwise 
-it displays the current time
-* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
-
-
-/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * 
-We apply the HSM pattern according to the following recipe:
-1. Declare a new class, inheriting from Hsm class (the Watch class) 
-2. Put into this new class all states (State class instances) and other attributes (tsec, tmin, thour, and so on)
-3. Declare an event handler method (member function) for every state.
-   Don’t forget to declare event handlers for inherited states, like top, 
-   whose behavior you intend to customize
-4. Define the state machine topology (nesting of states) in the new class (the Watch class) constructor
-5. Define events for the state machine (for example, as enumeration).
-   You can use event-types starting from 0, because the pre-defined events use the upper limit of the Event type range.
-6. Define event handler methods.
-   Code entry/exit actions and start-up transitions as response to pre-defined events ENTRY_EVT,EXIT_EVT, and START_EVT, 
-   respectively. Provide code for other events using STATE_TRAN() macro for state transitions. Remember to return 0
-   (NULL pointer) if you handle the event and the initial message pointer if you don’t
-7. Execute the initial start transition by invoking Hsm::onStart()
-8. Arrange to invoke Hsm::onEvent() for each incoming event
-* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
-
-#include <assert.h>
-#include <stdio.h>
-#include "hsm.h"
-
-
-class Watch : public Hsm {
- // date parameters
-  unsigned int tsec, tmin, thour, dday, dmonth;
-
-protected:
-  State state_timekeeping;
-  // substates of timekeeping
-    State ss_time, ss_date;
-
-  State state_setting;
-  // substates of setting
-    State ss_hour, ss_minute, ss_day, ss_month;
-
-  // 
-  State *state_timekeepingHist;
-
-public:
-  Watch();
-  /* All Transitions have to defined and created for the state machine. */
-  /* Typically this is achieved using a single-level switch statement. Event handlers  communicate  with  the  state
-     machine  engine through  a  return  value  of  type  Msg*.
-     The semantic is simple: if an event is processed, the event handler returns 0 (NULL pointer); otherwise it returns
-     (“throws”)  the  message  for  further processing by higher-level states. 
-     To be compliant  with  UML  statecharts,  the returned  message  is  the  same  as  the received message, although return of
-     a  different  message  type  can  be  considered. As we discuss later, returning
-     the  message  provides  a  mechanism similar to “throwing” exceptions.  */
-  Msg const *topHndlr(Msg const *msg);  
-  Msg const *timekeepingHndlr(Msg const *msg);  
-  Msg const *timeHndlr(Msg const *msg);  
-  Msg const *dateHndlr(Msg const *msg);  
-  Msg const *settingHndlr(Msg const *msg);  
-  Msg const *hourHndlr(Msg const *msg);  
-  Msg const *minuteHndlr(Msg const *msg);  
-  Msg const *dayHndlr(Msg const *msg);  
-  Msg const *monthHndlr(Msg const *msg);  
-
-  /* Standard functions, to show behaviour */
-  void tick();
-  void showTime();
-  void showDate();
-
-private:
-
-  static constexpr unsigned int cHoursOnDay=24;
-  static constexpr unsigned int cMinutesInHour=60;
-  static constexpr unsigned int cSecondsInMinute=60;
-  static constexpr unsigned int cMonthInYear=12;
-  static constexpr unsigned int cReset0=0;
-  unsigned int const cDaysPerMonth[cMonthInYear]={/* Jan, Feb, ... ,Dez */31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-  /* if an event is processed, the event handler returns 0 (NULL pointer); otherwise it returns (“throws”)  the  message  for  further processing by higher-level states. */
-  const Msg* cEventIsProcessed=0;
-
- 
-};
+#include "watch.h"
+#include "setclock.h"
+#include "explore.h"
+#include "hibernate.h"
+#include "introspect.h"
+#include "log.h"
 
 // ----------------------------------------------------------------------------------------
 // CPP file definitions
 // ----------------------------------------------------------------------------------------
 
 
-enum WatchEvents {
-  Watch_MODE_EVT,/* Adjustments are made by pressing the “mode” button, which increments the chosen quantity by one. */
-  Watch_SET_EVT, /* Pressing the “set” button switches the watch into setting mode.  */
-  Watch_TICK_EVT /*  */
-};
-
 // ---  Watch class individual functions  ---
 void Watch::showTime() {
-  printf("time: %2d:%02d:%02d", thour, tmin, tsec);
+  LOG("time: %2d:%02d:%02d", thour, tmin, tsec);
 }
 
 void Watch::showDate() {
-  // todo year is missing
-  printf("date: %02d-%02d-0000", dday, dmonth);
+  LOG("date: %02d-%02d-%04d", dday, dmonth, tyear);
+}
+
+unsigned int Watch::daysInMonth() const {
+  return monthDays(dmonth, tyear);  /* the calendar of setclock.h */
 }
 
 void Watch::tick() {
@@ -131,31 +37,104 @@ void Watch::tick() {
       tmin = cReset0;
       if (++thour == cHoursOnDay) {
         thour = cReset0;
-        if (++dday == cDaysPerMonth[dmonth-1]+1) {
-          dday = 1;
-          if (++dmonth == cMonthInYear+1) 
+        if (++dday > daysInMonth()) {
+          dday -= daysInMonth();  /* 1, or past a 31-02 left by setting, as advance() */
+          if (++dmonth == cMonthInYear+1) {
             dmonth = 1;
-            /* todo increase year, todo add year as well */
+            ++tyear;
+          }
         }
       }
     }
   }
 }
 
+/* days since 1970-01-01 of a proleptic Gregorian date, and back again,
+   in constant time (H. Hinnant's days_from_civil/civil_from_days) */
+static long daysFromCivil(long y, unsigned int m, unsigned int d) {
+  y -= m <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  unsigned long yoe = (unsigned long)(y - era * 400);                  /* [0, 399] */
+  unsigned long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;  /* [0, 365] */
+  unsigned long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;           /* [0, 146096] */
+  return era * 146097 + (long)doe - 719468;
+}
+
+static void civilFromDays(long z, unsigned int *y, unsigned int *m, unsigned int *d) {
+  z += 719468;
+  long era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned long doe = (unsigned long)(z - era * 146097);
+  unsigned long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned long mp = (5 * doy + 2) / 153;
+  *d = (unsigned int)(doy - (153 * mp + 2) / 5 + 1);
+  *m = (unsigned int)(mp < 10 ? mp + 3 : mp - 9);
+  *y = (unsigned int)((long)yoe + era * 400 + (*m <= 2));
+}
+
+void Watch::advance(unsigned long seconds) {
+  /* same result as calling tick() `seconds` times, without the loop. A day
+     made invalid in setting mode (e.g. 31-02) rolls over into the next month. */
+  unsigned long s = tsec + cSecondsInMinute * (tmin + cMinutesInHour * thour) + seconds;
+  long days = daysFromCivil(tyear, dmonth, dday) + (long)(s / cSecondsPerDay);
+  s %= cSecondsPerDay;
+  thour = (unsigned int)(s / (cMinutesInHour * cSecondsInMinute));
+  tmin = (unsigned int)(s / cSecondsInMinute % cMinutesInHour);
+  tsec = (unsigned int)(s % cSecondsInMinute);
+  civilFromDays(days, &tyear, &dmonth, &dday);
+}
+
+/* everything the behaviour depends on besides the current state, but the
+   year, which reg() adds as each needs it */
+template<typename R> void Watch::regFields(R *r) {
+  r->reg(&tsec, sizeof(tsec));
+  r->reg(&tmin, sizeof(tmin));
+  r->reg(&thour, sizeof(thour));
+  r->reg(&dday, sizeof(dday));
+  r->reg(&dmonth, sizeof(dmonth));
+  r->regState(&state_timekeepingHist);
+}
+
+/* the extended state and the transitions of the statechart, for the
+   state-space explorer; the year only counts for leap days, so modulo
+   the Gregorian cycle, which keeps the state space finite */
+void Watch::reg(Explorer *x) {
+  regFields(x);
+  x->regPeriodic(&tyear, cStartYear, cYearsInCycle);
+  x->expect(&states[S_TIMEKEEPING], Watch_SET_EVT, &states[S_SETTING]);
+  x->expect(&states[S_TIME], Watch_MODE_EVT, &states[S_DATE]);
+  x->expect(&states[S_DATE], Watch_MODE_EVT, &states[S_TIME]);
+  x->expect(&states[S_HOUR], Watch_SET_EVT, &states[S_MINUTE]);
+  x->expect(&states[S_MINUTE], Watch_SET_EVT, &states[S_DAY]);
+  x->expect(&states[S_DAY], Watch_SET_EVT, &states[S_MONTH]);
+  x->expect(&states[S_MONTH], Watch_SET_EVT, &states[S_TIMEKEEPING]);
+}
+
+/* the same state, all a hibernated Watch needs to come back as it was */
+void Watch::reg(HsmClass *c) {
+  regFields(c);
+  c->reg(&tyear, sizeof(tyear));
+}
+
+/* the history a live view lists next to the current state */
+void Watch::reg(Introspect *in, int idx) {
+  in->history(idx, &state_timekeepingHist);
+}
+
 /*  */
 
 /* TBD: Watch_TICK_EVT, can be used, but makes confsion. Usually first state should be named for user.  */
 Msg const *Watch::topHndlr(Msg const *msg) {
   switch (msg->evt) {
   case START_EVT:
-    STATE_START(&state_setting);
-    printf("Watch::topHndlr::STATE_START;\n");
+    STATE_START(&states[S_SETTING]);
+    LOG("Watch::topHndlr::STATE_START;\n");
 
     return cEventIsProcessed;
   case Watch_TICK_EVT:
     if (++tsec == cMinutesInHour)
       tsec = cReset0;
-    printf("Watch::top-TICK;");
+    LOG("Watch::top-TICK;");
     showTime();
     return cEventIsProcessed;
   } 
@@ -172,8 +151,8 @@ Msg const *Watch::timekeepingHndlr(Msg const *msg) {
     STATE_START(state_timekeepingHist);
     return cEventIsProcessed;
   case Watch_SET_EVT:
-    STATE_TRAN(&state_setting);
-    printf("Watch::timekeeping-SET;\n");
+    STATE_TRAN(&states[S_SETTING]);
+    LOG("Watch::timekeeping-SET;\n");
     return cEventIsProcessed;
   } 
   return msg;
@@ -190,14 +169,19 @@ Msg const *Watch::timeHndlr(Msg const *msg) {
     showTime();
     return cEventIsProcessed;
   case Watch_MODE_EVT:
-    STATE_TRAN(&ss_date);
-    printf("Watch::go to show date\n");        
+    STATE_TRAN(&states[S_DATE]);
+    LOG("Watch::go to show date\n");        
     return cEventIsProcessed;
   case Watch_TICK_EVT:
-    printf("Watch::time-TICK;\n");        
+    LOG("Watch::time-TICK;\n");        
     tick();
     showTime();
     return cEventIsProcessed;
+  case Watch_ADVANCE_EVT:
+    LOG("Watch::time-ADVANCE: %lus;\n", ((AdvanceMsg const *)msg)->count);
+    advance(((AdvanceMsg const *)msg)->count);
+    showTime();
+    return cEventIsProcessed;
   } 
   return msg;
 }
@@ -210,15 +194,20 @@ Msg const *Watch::dateHndlr(Msg const *msg) {
     showDate();
     return cEventIsProcessed;
   case Watch_MODE_EVT:
-    STATE_TRAN(&ss_time);
-    printf("Watch::go to show time\n");        
+    STATE_TRAN(&states[S_TIME]);
+    LOG("Watch::go to show time\n");        
     return cEventIsProcessed;
   
   case Watch_TICK_EVT:
-    printf("Watch::date-TICK;\n");        
+    LOG("Watch::date-TICK;\n");        
     tick();
     showDate();
     return cEventIsProcessed; 
+  case Watch_ADVANCE_EVT:
+    LOG("Watch::date-ADVANCE: %lus;\n", ((AdvanceMsg const *)msg)->count);
+    advance(((AdvanceMsg const *)msg)->count);
+    showDate();
+    return cEventIsProcessed;
   } 
   return msg;
 }
@@ -228,7 +217,7 @@ Msg const *Watch::dateHndlr(Msg const *msg) {
 Msg const *Watch::settingHndlr(Msg const *msg) {
   switch (msg->evt) {
   case START_EVT:
-    STATE_START(&ss_hour);
+    STATE_START(&states[S_HOUR]);
     return cEventIsProcessed;
 
   } 
@@ -240,13 +229,13 @@ Msg const *Watch::settingHndlr(Msg const *msg) {
 Msg const *Watch::hourHndlr(Msg const *msg) {
   switch (msg->evt) {
   case Watch_SET_EVT:
-    STATE_TRAN(&ss_minute);
-    printf("Watch::go to hour change");
+    STATE_TRAN(&states[S_MINUTE]);
+    LOG("Watch::go to hour change");
     return cEventIsProcessed;
   case Watch_MODE_EVT:
     if (++thour == cHoursOnDay)
         thour = cReset0;
-    printf("Watch::hour-SET: hour++: %d", thour);
+    LOG("Watch::hour-SET: hour++: %d", thour);
     return cEventIsProcessed; 
     /* if an event is processed, the event handler returns 0 (NULL pointer); otherwise it returns
      (“throws”)  the  message  for  further processing by higher-level states.  */
@@ -260,13 +249,13 @@ Msg const *Watch::hourHndlr(Msg const *msg) {
 Msg const *Watch::minuteHndlr(Msg const *msg) {
   switch (msg->evt) {
   case Watch_SET_EVT:
-    STATE_TRAN(&ss_day);
-    printf("Watch:: go to day chaning");
+    STATE_TRAN(&states[S_DAY]);
+    LOG("Watch:: go to day chaning");
     return cEventIsProcessed;
   case Watch_MODE_EVT:
     if (++tmin == cMinutesInHour)
         tmin = cReset0;
-    printf("Watch::min-SET: min++: %d", tmin);
+    LOG("Watch::min-SET: min++: %d", tmin);
     return cEventIsProcessed; //todo clarify which number shall be used as return value
   } 
   /* While in setting mode the watch ignores tick events */
@@ -278,13 +267,13 @@ Msg const *Watch::minuteHndlr(Msg const *msg) {
 Msg const *Watch::dayHndlr(Msg const *msg) {
   switch (msg->evt) {
   case Watch_SET_EVT:
-    STATE_TRAN(&ss_month);
-    printf("Watch:: go to month ");
+    STATE_TRAN(&states[S_MONTH]);
+    LOG("Watch:: go to month ");
     return cEventIsProcessed;
   case Watch_MODE_EVT:
-    if (++dday == Watch::cDaysPerMonth[dmonth-1]+1) 
+    if (++dday > daysInMonth())  /* also past a day left invalid by the month */
       dday = 1;
-    printf("Watch::day-SET: day++: %d", dday);
+    LOG("Watch::day-SET: day++: %d", dday);
     return cEventIsProcessed; //todo clarify which number shall be used as return value
   }
   /* While in setting mode the watch ignores tick events */
@@ -296,13 +285,13 @@ Msg const *Watch::monthHndlr(Msg const *msg) {
   switch (msg->evt) {
   case Watch_SET_EVT:
   /* Pressing the “set” button while adjusting month puts the watch back into timekeeping mode. */
-    STATE_TRAN(&state_timekeeping);
-    printf("Watch:: go back to timekeeping");
+    STATE_TRAN(&states[S_TIMEKEEPING]);
+    LOG("Watch:: go back to timekeeping");
     return cEventIsProcessed;
   case Watch_MODE_EVT:
     if (++dmonth == cMonthInYear+1) 
             dmonth = 1;
-    printf("Watch::month-SET: month++: %d", dmonth);
+    LOG("Watch::month-SET: month++: %d", dmonth);
     return cEventIsProcessed; 
   } 
   /* While in setting mode the watch ignores tick events */
@@ -312,89 +301,57 @@ Msg const *Watch::monthHndlr(Msg const *msg) {
 /* todo year Handler where the year can be set. */
 
 
-/* Watch Constructor 
-  The
-constructor  of  the  concrete  HSM  is
-responsible for initialization of all par-
-ticipating State objects by setting the
-super-state pointers and the event han-
-dlers.
- In our approach we
+/* Watch topology
+  All watches share one read-only topology: states[i] names its superstate
+  by index, and the handler and name of state i are hndlrs[i] and names[i].
+  It is constant-initialized, so no code runs for it at startup, and the
+  constructor only sets the current state and the extended state.
+  In our approach we
 do not distinguish between composite-
 states (states containing substates) and
 leaf  states.  All  states  are  potentially
 composite.
-
-
 */
-Watch::Watch() 
-: Hsm("Watch", (EvtHndlr)topHndlr),
+State const Watch::states[S_COUNT] = {
+  State(S_TOP, HSM_NO_SUPER),
   //  State
-  state_timekeeping("timekeeping", &top, (EvtHndlr)&Watch::timekeepingHndlr),
+  State(S_TIMEKEEPING, S_TOP),
   // substates
-  ss_time("time", &state_timekeeping, (EvtHndlr)&Watch::timeHndlr),
-  ss_date("date", &state_timekeeping, (EvtHndlr)&Watch::dateHndlr),
+    State(S_TIME, S_TIMEKEEPING),
+    State(S_DATE, S_TIMEKEEPING),
   // State
-  state_setting("setting", &top, (EvtHndlr)&Watch::settingHndlr),
+  State(S_SETTING, S_TOP),
   // substates
-  ss_hour("hour", &state_setting, (EvtHndlr)&Watch::hourHndlr),
-  ss_minute("minute", &state_setting, (EvtHndlr)&Watch::minuteHndlr),
-  ss_day("day", &state_setting, (EvtHndlr)&Watch::dayHndlr),
-  ss_month("month", &state_setting, (EvtHndlr)&Watch::monthHndlr),
-  // define members
-  tsec(cReset0), tmin(cReset0), thour(cReset0), dday(1), dmonth(1)
-{
-  state_timekeepingHist = &ss_time; 
-}
-
-/* Εvents */
-const Msg watchMsg[] = { 
-  Watch_MODE_EVT, // Button
-  Watch_SET_EVT, // Button
-  Watch_TICK_EVT // trigger of seconds, done manually.
-
-/*  Pressing the “set” button switches
-the watch into setting mode. 
-
-The sequence of adjustments in this
-mode is: hour, minute, day, month.
-
-Adjustments are made by pressing
-the “mode” button, which incre-
-ments the chosen quantity by one.
-
-Pressing the “set” button while
-adjusting month puts the watch
-back into timekeeping mode
-
-• While in setting mode the watch
-ignores tick events
-
-• Upon return to timekeeping mode
-the watch displays the most recently selected information, that is, if
-date was selected prior to leaving
-timekeeping mode, the watch
-resumes displaying the date, other-
-wise it displays the current time */
-
+    State(S_HOUR, S_SETTING),
+    State(S_MINUTE, S_SETTING),
+    State(S_DAY, S_SETTING),
+    State(S_MONTH, S_SETTING)
+};
 
+EvtHndlr const Watch::hndlrs[S_COUNT] = {
+  (EvtHndlr)&Watch::topHndlr,
+  (EvtHndlr)&Watch::timekeepingHndlr,
+    (EvtHndlr)&Watch::timeHndlr,
+    (EvtHndlr)&Watch::dateHndlr,
+  (EvtHndlr)&Watch::settingHndlr,
+    (EvtHndlr)&Watch::hourHndlr,
+    (EvtHndlr)&Watch::minuteHndlr,
+    (EvtHndlr)&Watch::dayHndlr,
+    (EvtHndlr)&Watch::monthHndlr
 };
 
+char const *const Watch::names[S_COUNT] = {
+  "top", "timekeeping", "time", "date",
+  "setting", "hour", "minute", "day", "month"
+};
 
+HsmTopo const Watch::topo = { states, hndlrs, names, S_COUNT };
 
-/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * 
- * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
-int main() {
-  Watch watch;         
-  watch.onStart();
-  printf("\nThe sequence of adjustments in this mode is: hour, minute, day, month.\n\n");
-  for (;;)  {
-    int i;
-    printf("\nEvent[0=mode,1=set,2=tick]->");
-    scanf("%d", &i);
-    if (i < 0 || sizeof(watchMsg)/sizeof(Msg) <= i) 
-      break;
-    watch.onEvent(&watchMsg[i]); 
-  }
-  return 0;
+/* Watch Constructor */
+Watch::Watch() 
+: Hsm("Watch", &topo),
+  // define members
+  tsec(cReset0), tmin(cReset0), thour(cReset0), dday(1), dmonth(1), tyear(cStartYear)
+{
+  state_timekeepingHist = &states[S_TIME]; 
 }
@@ -0,0 +1,136 @@
+/**
+ * watch.h -- Simple digital watch example
+ * M. Samek, 01/07/00
+ */
+#ifndef watch_h
+#define watch_h
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * 
+To illustrate the use of the HSM pattern,  consider  a  simple  digital  watch.  
+The  watch  has  two  buttons—which  generate  external events—and  an  internally  generated
+tick event.  
+The  different  events  are handled  differently  depending  upon the  mode  of  operation.  
+The  basic watch operates as follows:
+
+• In timekeeping mode, the user can toggle  between  displaying  date  or  current  time  by  pressing  the
+“mode” button
+• Pressing  the  “set”  button  switches  the watch into setting mode. The sequence  of  adjustments  in  this
+mode is: hour, minute, day, month.
+Adjustments are made by pressing the  “mode”  button,  which  increments the chosen quantity by one.
+Pressing  the  “set”  button  while adjusting  month  puts  the  watch back into timekeeping mode
+• While  in  setting mode  the  watch ignores tick events
+• Upon return to timekeeping mode the watch displays the most recently  selected  information,  that  is,  if
+date  was  selected  prior  to  leaving timekeeping mode,  the  watch resumes displaying the date, otherwise 
+it displays the current time
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * 
+We apply the HSM pattern according to the following recipe:
+1. Declare a new class, inheriting from Hsm class (the Watch class) 
+2. Put into this new class all states (State class instances) and other attributes (tsec, tmin, thour, and so on)
+3. Declare an event handler method (member function) for every state.
+   Don’t forget to declare event handlers for inherited states, like top, 
+   whose behavior you intend to customize
+4. Define the state machine topology (nesting of states) in the new class (the Watch class) constructor,
+   or, as the Watch does, once for the class as constant data (see HsmTopo in hsm.h)
+5. Define events for the state machine (for example, as enumeration).
+   You can use event-types starting from 0, because the pre-defined events use the upper limit of the Event type range.
+6. Define event handler methods.
+   Code entry/exit actions and start-up transitions as response to pre-defined events ENTRY_EVT,EXIT_EVT, and START_EVT, 
+   respectively. Provide code for other events using STATE_TRAN() macro for state transitions. Remember to return 0
+   (NULL pointer) if you handle the event and the initial message pointer if you don’t
+7. Execute the initial start transition by invoking Hsm::onStart()
+8. Arrange to invoke Hsm::onEvent() for each incoming event
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <assert.h>
+#include "hsm.h"
+
+class Explorer;
+class HsmClass;
+class Introspect;
+
+/* Watch_ADVANCE_EVT: move the clock forward by a number of seconds at once.
+   The count is the seconds, so a conflated burst of ticks reads as one. */
+typedef CountMsg AdvanceMsg;
+
+class Watch : public Hsm {
+ // date parameters
+  unsigned int tsec, tmin, thour, dday, dmonth, tyear;
+
+protected:
+  /* the topology is read-only data shared by all watches, states[S_x] */
+  enum StateIds {
+    S_TOP,
+    S_TIMEKEEPING,
+    // substates of timekeeping
+      S_TIME, S_DATE,
+    S_SETTING,
+    // substates of setting
+      S_HOUR, S_MINUTE, S_DAY, S_MONTH,
+    S_COUNT
+  };
+  static State const states[S_COUNT];
+  static EvtHndlr const hndlrs[S_COUNT];
+  static char const *const names[S_COUNT];
+  static HsmTopo const topo;
+
+  // 
+  State const *state_timekeepingHist;
+
+public:
+  Watch();
+  /* All Transitions have to defined and created for the state machine. */
+  /* Typically this is achieved using a single-level switch statement. Event handlers  communicate  with  the  state
+     machine  engine through  a  return  value  of  type  Msg*.
+     The semantic is simple: if an event is processed, the event handler returns 0 (NULL pointer); otherwise it returns
+     (“throws”)  the  message  for  further processing by higher-level states. 
+     To be compliant  with  UML  statecharts,  the returned  message  is  the  same  as  the received message, although return of
+     a  different  message  type  can  be  considered. As we discuss later, returning
+     the  message  provides  a  mechanism similar to “throwing” exceptions.  */
+  Msg const *topHndlr(Msg const *msg);  
+  Msg const *timekeepingHndlr(Msg const *msg);  
+  Msg const *timeHndlr(Msg const *msg);  
+  Msg const *dateHndlr(Msg const *msg);  
+  Msg const *settingHndlr(Msg const *msg);  
+  Msg const *hourHndlr(Msg const *msg);  
+  Msg const *minuteHndlr(Msg const *msg);  
+  Msg const *dayHndlr(Msg const *msg);  
+  Msg const *monthHndlr(Msg const *msg);  
+
+  /* Standard functions, to show behaviour */
+  void reg(Explorer *x);  /* register extended state and transitions, see explore.h */
+  void reg(HsmClass *c);  /* register extended state to hibernate, see hibernate.h */
+  void reg(Introspect *in, int idx);  /* register the history to show, see introspect.h */
+  void tick();
+  void advance(unsigned long seconds);  /* constant time, any duration */
+  void showTime();
+  void showDate();
+
+private:
+  template<typename R> void regFields(R *r);  /* what reg() records for both */
+
+  static constexpr unsigned int cHoursOnDay=24;
+  static constexpr unsigned int cMinutesInHour=60;
+  static constexpr unsigned int cSecondsInMinute=60;
+  static constexpr unsigned int cMonthInYear=12;
+  static constexpr unsigned int cSecondsPerDay=cHoursOnDay*cMinutesInHour*cSecondsInMinute;
+  static constexpr unsigned int cReset0=0;
+  static constexpr unsigned int cStartYear=2000;
+  static constexpr unsigned int cYearsInCycle=400;  /* the Gregorian calendar repeats */
+  unsigned int daysInMonth() const;  /* of dmonth in tyear, 29 for a leap February */
+  /* if an event is processed, the event handler returns 0 (NULL pointer); otherwise it returns (“throws”)  the  message  for  further processing by higher-level states. */
+  const Msg* cEventIsProcessed=0;
+
+ 
+};
+
+enum WatchEvents {
+  Watch_MODE_EVT,/* Adjustments are made by pressing the “mode” button, which increments the chosen quantity by one. */
+  Watch_SET_EVT, /* Pressing the “set” button switches the watch into setting mode.  */
+  Watch_TICK_EVT, /*  */
+  Watch_ADVANCE_EVT /* AdvanceMsg: catch up after downtime or simulate a long period in one dispatch */
+};
+
+#endif /* watch_h */